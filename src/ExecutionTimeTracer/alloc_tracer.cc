@@ -0,0 +1,258 @@
+// VProf headers
+#include "trace_tool.h"
+
+#if VPROF_ENABLED
+
+// Allocator interposer for glibc, to be linked together with trace_tool.cc.
+// It replaces malloc, calloc, realloc, free, the aligned allocation functions
+// and every global operator new and delete, the aligned and nothrow ones too,
+// with versions which call the glibc allocator and add the call, the
+// bytes asked for and the time spent to the thread's vprofAllocCounters, which
+// the probes read around every traced call. The counters live in the initial TLS block,
+// so updating them never allocates, and the cost on every allocation is two
+// clock reads whether or not a call is being traced.
+
+// C headers
+#include <errno.h>
+#include <malloc.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <time.h>
+
+// C++ headers
+#include <new>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void *__libc_pvalloc(size_t size);
+void __libc_free(void *ptr);
+}
+
+class AllocationTimer {
+    public:
+        explicit AllocationTimer(size_t bytes) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            vprofAllocCounters.calls++;
+            vprofAllocCounters.bytes += bytes;
+        }
+
+        ~AllocationTimer() {
+            timespec end;
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            vprofAllocCounters.ns += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+        }
+
+    private:
+        timespec start;
+};
+
+// Same as the default operator new, on top of the counted malloc.
+static void *allocateOrThrow(size_t size) {
+    if (size == 0) {
+        size = 1;
+    }
+    void *ptr;
+    while ((ptr = malloc(size)) == nullptr) {
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+    return ptr;
+}
+
+#if __cpp_aligned_new
+static void *allocateAlignedOrThrow(size_t size, std::align_val_t alignment) {
+    if (size == 0) {
+        size = 1;
+    }
+    void *ptr;
+    while ((ptr = memalign(static_cast<size_t>(alignment), size)) == nullptr) {
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+    return ptr;
+}
+#endif
+
+static bool isPowerOfTwo(size_t n) {
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+extern "C" {
+
+void *malloc(size_t size) noexcept {
+    AllocationTimer timer(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size) noexcept {
+    // Calls whose size overflows fail without allocating, so count 0 bytes.
+    size_t bytes;
+    if (__builtin_mul_overflow(num, size, &bytes)) {
+        bytes = 0;
+    }
+    AllocationTimer timer(bytes);
+    return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept {
+    AllocationTimer timer(size);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) noexcept {
+    AllocationTimer timer(size);
+    return __libc_memalign(alignment, size);
+}
+
+// The checks of glibc, which implements both on top of memalign.
+int posix_memalign(void **ptr, size_t alignment, size_t size) noexcept {
+    if (alignment % sizeof(void *) != 0 || !isPowerOfTwo(alignment)) {
+        return EINVAL;
+    }
+    void *allocated = memalign(alignment, size);
+    if (allocated == nullptr) {
+        return ENOMEM;
+    }
+    *ptr = allocated;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept {
+    if (!isPowerOfTwo(alignment)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    return memalign(alignment, size);
+}
+
+void *valloc(size_t size) noexcept {
+    AllocationTimer timer(size);
+    return __libc_valloc(size);
+}
+
+void *pvalloc(size_t size) noexcept {
+    AllocationTimer timer(size);
+    return __libc_pvalloc(size);
+}
+
+void free(void *ptr) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+    AllocationTimer timer(0);
+    __libc_free(ptr);
+}
+
+}
+
+void *operator new(size_t size) {
+    return allocateOrThrow(size);
+}
+
+void *operator new[](size_t size) {
+    return allocateOrThrow(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return allocateOrThrow(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return allocateOrThrow(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    free(ptr);
+}
+
+#if __cpp_sized_deallocation
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    free(ptr);
+}
+#endif
+
+#if __cpp_aligned_new
+void *operator new(size_t size, std::align_val_t alignment) {
+    return allocateAlignedOrThrow(size, alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return allocateAlignedOrThrow(size, alignment);
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    try {
+        return allocateAlignedOrThrow(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    try {
+        return allocateAlignedOrThrow(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+    free(ptr);
+}
+#endif
+
+#endif
@@ -1,18 +1,27 @@
 // VProf headers
 #include "trace_tool.h"
 
+// The header provides the no-op versions of everything when disabled.
+#if VPROF_ENABLED
+
 // C headers
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/msg.h>
 #include <limits.h>
+#include <linux/perf_event.h>
 #include <pthread.h>
 #include <time.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <unistd.h>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 // C++ headers
 #include <algorithm>
@@ -27,6 +36,7 @@
 #include <atomic>
 #include <exception>
 #include <unordered_map>
+#include <random>
 
 #include <boost/thread/shared_mutex.hpp>
 #include <boost/filesystem.hpp>
@@ -59,23 +69,439 @@ class Filesystem {
 };
 unordered_map<string, bool> Filesystem::dirInitialized;
 
+// Per-thread counters of the interference of the OS with the thread, read at
+// the boundaries of semantic intervals only: context switches and page faults
+// from getrusage, the time spent waiting on a run queue from the thread's
+// schedstat, and the CPU the thread is on. Disabled with VPROF_OS_COUNTERS=0.
+struct OsCounters {
+    OsCounters(): isValid(false), voluntarySwitches(0), involuntarySwitches(0),
+                  minorFaults(0), majorFaults(0), runQueueWait(-1), cpu(-1) {}
+
+    static OsCounters Read() {
+        OsCounters counters;
+        if (!isEnabled) {
+            return counters;
+        }
+        struct rusage usage;
+        if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+            counters.isValid = true;
+            counters.voluntarySwitches = usage.ru_nvcsw;
+            counters.involuntarySwitches = usage.ru_nivcsw;
+            counters.minorFaults = usage.ru_minflt;
+            counters.majorFaults = usage.ru_majflt;
+        }
+        counters.runQueueWait = readRunQueueWait();
+        counters.cpu = sched_getcpu();
+        return counters;
+    }
+
+    // Key=value pairs of the changes since start, for the extras column.
+    // Migrations are only seen as a change of CPU between the two reads.
+    std::string deltaSince(const OsCounters &start) const {
+        if (!isValid || !start.isValid) {
+            return "";
+        }
+        std::string pairs = "csw=" + std::to_string(voluntarySwitches - start.voluntarySwitches) +
+                            ";icsw=" + std::to_string(involuntarySwitches - start.involuntarySwitches) +
+                            ";minflt=" + std::to_string(minorFaults - start.minorFaults) +
+                            ";majflt=" + std::to_string(majorFaults - start.majorFaults);
+        if (runQueueWait >= 0 && start.runQueueWait >= 0) {
+            pairs += ";runq=" + std::to_string(runQueueWait - start.runQueueWait);
+        }
+        if (cpu >= 0 && start.cpu >= 0) {
+            pairs += ";migrated=" + std::to_string(cpu != start.cpu ? 1 : 0);
+        }
+        return pairs;
+    }
+
+    bool isValid;
+    long voluntarySwitches;
+    long involuntarySwitches;
+    long minorFaults;
+    long majorFaults;
+    long long runQueueWait;
+    int cpu;
+
+    private:
+        // Closed when the thread exits, so that pools which keep replacing
+        // their threads do not run out of file descriptors.
+        struct SchedstatFile {
+            SchedstatFile(): fd(-1), pid(0) {}
+
+            ~SchedstatFile() {
+                if (fd >= 0) {
+                    close(fd);
+                }
+            }
+
+            int fd;
+            pid_t pid;
+        };
+
+        static bool isEnabled;
+        static thread_local SchedstatFile schedstat;
+
+        // Second field of /proc/self/task/<tid>/schedstat, in nanoseconds. The
+        // file is kept open per thread, and reopened in a forked child.
+        static long long readRunQueueWait() {
+            SchedstatFile &file = schedstat;
+            if (file.pid != ::getpid()) {
+                if (file.fd >= 0) {
+                    close(file.fd);
+                }
+                std::string path = "/proc/self/task/" + std::to_string(syscall(SYS_gettid)) + "/schedstat";
+                file.fd = open(path.c_str(), O_RDONLY);
+                file.pid = ::getpid();
+            }
+            char buffer[128];
+            ssize_t length = file.fd >= 0 ? pread(file.fd, buffer, sizeof(buffer) - 1, 0) : -1;
+            if (length <= 0) {
+                return -1;
+            }
+            buffer[length] = '\0';
+            unsigned long long runTime, waitTime;
+            if (sscanf(buffer, "%llu %llu", &runTime, &waitTime) != 2) {
+                return -1;
+            }
+            return waitTime;
+        }
+
+        static bool readIsEnabled() {
+            const char *enabled = getenv("VPROF_OS_COUNTERS");
+            return enabled == nullptr || atoi(enabled) != 0;
+        }
+};
+bool OsCounters::isEnabled = OsCounters::readIsEnabled();
+thread_local OsCounters::SchedstatFile OsCounters::schedstat;
+
+// Per-thread group of the perf event counters named in VPROF_PERF_EVENTS,
+// opened on the first read of each thread and again in a forked child, and
+// closed when the thread exits.
+// Hardware events only count user space, so that they can be opened without
+// privileges, and software events fall back to it when they cannot count
+// the kernel.
+class PerfEvents {
+    public:
+        static const std::vector<std::string> &Names() {
+            return requested().names;
+        }
+
+        static void Read(long long *counts) {
+            Group &group = thisThreadGroup;
+            if (group.pid != ::getpid()) {
+                open(group);
+            }
+            uint64_t values[1 + VPROF_MAX_PERF_EVENTS];
+            bool isRead = group.fds[0] >= 0 && read(group.fds[0], values, sizeof(values)) > 0;
+            for (int i = 0; i < VPROF_MAX_PERF_EVENTS; i++) {
+                counts[i] = isRead && group.slots[i] >= 0 ? values[1 + group.slots[i]] : -1;
+            }
+        }
+
+    private:
+        struct Event {
+            const char *name;
+            uint32_t type;
+            uint64_t config;
+        };
+
+        struct Requested {
+            std::vector<std::string> names;
+            std::vector<Event> events;
+        };
+
+        struct Group {
+            Group(): pid(0) {
+                for (int i = 0; i < VPROF_MAX_PERF_EVENTS; i++) {
+                    fds[i] = -1;
+                    slots[i] = -1;
+                }
+            }
+
+            ~Group() {
+                closeAll();
+            }
+
+            void closeAll() {
+                for (int i = 0; i < VPROF_MAX_PERF_EVENTS; i++) {
+                    if (fds[i] >= 0) {
+                        close(fds[i]);
+                    }
+                    fds[i] = -1;
+                    slots[i] = -1;
+                }
+            }
+
+            pid_t pid;
+            // Leader first, in the order of the values of a group read.
+            int fds[VPROF_MAX_PERF_EVENTS];
+            // Position of each requested event in the group, -1 if not opened.
+            int slots[VPROF_MAX_PERF_EVENTS];
+        };
+
+        static thread_local Group thisThreadGroup;
+
+        static uint64_t cacheMiss(uint64_t cache) {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+
+        static Requested parse() {
+            static const Event KNOWN_EVENTS[] = {
+                { "task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+                { "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+                { "minor-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN },
+                { "major-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ },
+                { "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+                { "cpu-migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS },
+                { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+                { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+                { "cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+                { "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+                { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+                { "L1-dcache-load-misses", PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1D) },
+                { "LLC-load-misses", PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_LL) },
+                { "dTLB-load-misses", PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_DTLB) },
+                { "iTLB-load-misses", PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_ITLB) }
+            };
+
+            Requested requested;
+            const char *names = getenv("VPROF_PERF_EVENTS");
+            std::stringstream namesStream(names != nullptr ? names : "");
+            std::string name;
+            while (getline(namesStream, name, ',') && requested.events.size() < VPROF_MAX_PERF_EVENTS) {
+                for (const Event &event : KNOWN_EVENTS) {
+                    if (name == event.name) {
+                        requested.names.push_back(name);
+                        requested.events.push_back(event);
+                    }
+                }
+            }
+            return requested;
+        }
+
+        static const Requested &requested() {
+            static const Requested events = parse();
+            return events;
+        }
+
+        static int openEvent(const Event &event, int groupFd) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = event.type;
+            attr.config = event.config;
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_hv = 1;
+            attr.exclude_kernel = event.type != PERF_TYPE_SOFTWARE;
+            int fd = syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+            if (fd < 0 && !attr.exclude_kernel) {
+                attr.exclude_kernel = 1;
+                fd = syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+            }
+            return fd;
+        }
+
+        static void open(Group &group) {
+            // Counters inherited from the parent count the parent's thread.
+            group.closeAll();
+            group.pid = ::getpid();
+
+            const std::vector<Event> &events = requested().events;
+            int numOpen = 0;
+            for (size_t i = 0; i < events.size(); i++) {
+                int fd = openEvent(events[i], numOpen > 0 ? group.fds[0] : -1);
+                if (fd >= 0) {
+                    group.fds[numOpen] = fd;
+                    group.slots[i] = numOpen++;
+                }
+            }
+        }
+};
+thread_local PerfEvents::Group PerfEvents::thisThreadGroup;
+
+// Virtual speedup experiments, as in causal profiling. While the function
+// with index VPROF_SPEEDUP_INDEX runs for d ns on a thread, every other thread
+// is owed a delay of d times the speedup of the current experiment, which it
+// pays at its next probe, synchronization call or semantic interval boundary.
+// Delays owed while a thread blocks in a synchronization call are forgiven,
+// since they pass while it waits anyway. Each experiment lasts
+// VPROF_EXPERIMENT_MS and uses one of the percentages of VPROF_SPEEDUPS at
+// random. Semantic intervals which start and end in the same experiment
+// record its speedup and the total delay inserted meanwhile, which subtracted
+// from their latency gives their latency in virtual time.
+class VirtualSpeedup {
+    public:
+        // Speedup of the current experiment, starting the next one when it
+        // is over. experimentID identifies the experiment.
+        static int Speedup(int *experimentID = nullptr) {
+            long long now = nowNs();
+            if (now >= experimentEnd.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> lock(experimentMutex);
+                if (now >= experimentEnd.load(std::memory_order_relaxed)) {
+                    Config &speedupConfig = config();
+                    std::uniform_int_distribution<size_t> pick(0, speedupConfig.speedups.size() - 1);
+                    speedup.store(speedupConfig.speedups[pick(speedupConfig.rng)], std::memory_order_relaxed);
+                    experiment.fetch_add(1, std::memory_order_relaxed);
+                    experimentEnd.store(now + speedupConfig.experimentNs, std::memory_order_relaxed);
+                }
+            }
+            if (experimentID != nullptr) {
+                *experimentID = experiment.load(std::memory_order_relaxed);
+            }
+            return speedup.load(std::memory_order_relaxed);
+        }
+
+        static long long TotalDelay() {
+            return globalDelay.load(std::memory_order_relaxed);
+        }
+
+        // The sped up function ran for ns on the calling thread.
+        static void Credit(long long ns) {
+            long long delay = ns * Speedup() / 100;
+            if (delay > 0) {
+                Pay();
+                globalDelay.fetch_add(delay, std::memory_order_relaxed);
+                localDelay += delay;
+            }
+        }
+
+        static void Pay() {
+            long long total = TotalDelay();
+            if (localDelay < 0) {
+                localDelay = total;
+            }
+            long long pending = total - localDelay;
+            if (pending <= 0) {
+                return;
+            }
+            localDelay = total;
+
+            // Sleeps overshoot by tens of microseconds, short delays spin.
+            if (pending >= SPIN_LIMIT_NS) {
+                timespec duration = { static_cast<time_t>(pending / 1000000000),
+                                      static_cast<long>(pending % 1000000000) };
+                nanosleep(&duration, nullptr);
+            } else {
+                long long end = nowNs() + pending;
+                while (nowNs() < end) {}
+            }
+        }
+
+        static void Forgive() {
+            localDelay = TotalDelay();
+        }
+
+        static int ReadIndex() {
+            const char *index = getenv("VPROF_SPEEDUP_INDEX");
+            return index != nullptr ? atoi(index) : -1;
+        }
+
+    private:
+        static const long long SPIN_LIMIT_NS = 100000;
+
+        struct Config {
+            std::vector<int> speedups;
+            long long experimentNs;
+            std::mt19937 rng;
+        };
+
+        static std::atomic<long long> globalDelay;
+        static std::atomic<long long> experimentEnd;
+        static std::atomic<int> experiment;
+        static std::atomic<int> speedup;
+        static std::mutex experimentMutex;
+        // Delay the thread paid or was forgiven so far, -1 before its first
+        // probe, when it starts owing nothing.
+        static thread_local long long localDelay;
+
+        static long long nowNs() {
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            return now.tv_sec * 1000000000LL + now.tv_nsec;
+        }
+
+        static Config readConfig() {
+            Config speedupConfig;
+            const char *speedups = getenv("VPROF_SPEEDUPS");
+            std::stringstream speedupsStream(speedups != nullptr ? speedups : "0,20,40,60,80,100");
+            std::string percent;
+            while (getline(speedupsStream, percent, ',')) {
+                speedupConfig.speedups.push_back(std::min(100, std::max(0, atoi(percent.c_str()))));
+            }
+            if (speedupConfig.speedups.empty()) {
+                speedupConfig.speedups.push_back(0);
+            }
+            const char *experimentMs = getenv("VPROF_EXPERIMENT_MS");
+            speedupConfig.experimentNs = (experimentMs != nullptr ? atoll(experimentMs) : 1000) * 1000000;
+            speedupConfig.rng.seed(std::random_device()());
+            return speedupConfig;
+        }
+
+        static Config &config() {
+            static Config speedupConfig = readConfig();
+            return speedupConfig;
+        }
+};
+std::atomic<long long> VirtualSpeedup::globalDelay(0);
+std::atomic<long long> VirtualSpeedup::experimentEnd(0);
+std::atomic<int> VirtualSpeedup::experiment(0);
+std::atomic<int> VirtualSpeedup::speedup(0);
+std::mutex VirtualSpeedup::experimentMutex;
+thread_local long long VirtualSpeedup::localDelay = -1;
+
 class FunctionLog {
     public:
         FunctionLog():
-        semIntervalID("-1"), entityID(std::to_string(pthread_self()) + "_" + std::to_string(::getpid())) {}
+        semIntervalID("-1"), entityID(std::to_string(pthread_self()) + "_" + std::to_string(::getpid())),
+        nestedProbes(0), nestedSyncProbes(0), cpuTime(-1), weight(1) {}
 
         FunctionLog(std::string _semIntervalID):
-        semIntervalID(_semIntervalID) {
+        semIntervalID(_semIntervalID), nestedProbes(0), nestedSyncProbes(0), cpuTime(-1), weight(1) {
             entityID = std::to_string(pthread_self()) + "_" + std::to_string(::getpid());
         }
 
         FunctionLog(std::string _semIntervalID, 
                     timespec _functionStart,
                     timespec _functionEnd): semIntervalID(_semIntervalID),
-                    functionStart(_functionStart), functionEnd(_functionEnd) {
+                    functionStart(_functionStart), functionEnd(_functionEnd),
+                    nestedProbes(0), nestedSyncProbes(0), cpuTime(-1), weight(1) {
             entityID = std::to_string(pthread_self()) + "_" + std::to_string(::getpid());
         }
 
+        void setNestedProbes(unsigned int probes, unsigned int syncProbes) {
+            nestedProbes = probes;
+            nestedSyncProbes = syncProbes;
+        }
+
+        void setWeight(double val) {
+            weight = val;
+        }
+
+        void setCpuTime(long long val) {
+            cpuTime = val;
+        }
+
+        void setOsCounters(const std::string &val) {
+            osCounters = val;
+        }
+
+        void setPerfCounts(const long long *counts) {
+            perfCounts.assign(counts, counts + vprofNumPerfEvents);
+        }
+
+        void setAlloc(const VProfAllocCounters &val) {
+            alloc = val;
+        }
+
+        void setSpeedup(int percent, long long delay) {
+            speedup = percent;
+            virtualDelay = delay;
+        }
+
+        void setQueueSeq(long long seq) {
+            queueSeq = seq;
+        }
+
         void setFunctionStart(timespec val) {
             functionStart = val;
         }
@@ -86,17 +512,63 @@ class FunctionLog {
 
         void start() {
             clock_gettime(CLOCK_REALTIME, &functionStart);
+            if (VPROF_MEASURE_CPU_TIME()) {
+                clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuStart);
+            }
         }
 
         void end() {
+            if (VPROF_MEASURE_CPU_TIME()) {
+                cpuTime = VPROF_CPU_TIME_SINCE(&cpuStart);
+            }
             clock_gettime(CLOCK_REALTIME, &functionEnd);
         }
 
+        // Key=value pairs of the optional sixth column.
+        std::string extras() const {
+            std::string pairs;
+            if (nestedProbes > 0 || nestedSyncProbes > 0) {
+                pairs += "probes=" + std::to_string(nestedProbes) + ";sync=" + std::to_string(nestedSyncProbes);
+            }
+            if (cpuTime >= 0) {
+                pairs += (pairs.empty() ? "cpu=" : ";cpu=") + std::to_string(cpuTime);
+            }
+            if (weight != 1) {
+                pairs += (pairs.empty() ? "weight=" : ";weight=") + std::to_string(weight);
+            }
+            if (!osCounters.empty()) {
+                pairs += (pairs.empty() ? "" : ";") + osCounters;
+            }
+            if (speedup >= 0) {
+                pairs += (pairs.empty() ? "speedup=" : ";speedup=") + std::to_string(speedup) +
+                         ";vdelay=" + std::to_string(virtualDelay);
+            }
+            if (alloc.calls > 0) {
+                pairs += (pairs.empty() ? "allocs=" : ";allocs=") + std::to_string(alloc.calls) +
+                         ";allocbytes=" + std::to_string(alloc.bytes) + ";allocns=" + std::to_string(alloc.ns);
+            }
+            for (size_t i = 0; i < perfCounts.size(); i++) {
+                if (perfCounts[i] >= 0) {
+                    pairs += (pairs.empty() ? "pe." : ";pe.") + PerfEvents::Names()[i] + '=' +
+                             std::to_string(perfCounts[i]);
+                }
+            }
+            if (queueSeq >= 0) {
+                pairs += (pairs.empty() ? "seq=" : ";seq=") + std::to_string(queueSeq);
+            }
+            return pairs;
+        }
+
         void appendToString(std::string &other) const {
             other.append(std::string("1," + entityID + ',' + semIntervalID 
                                 + ',' + std::to_string((functionStart.tv_sec * 1000000000) 
                                 + functionStart.tv_nsec) + ',' 
-                                + std::to_string((functionEnd.tv_sec * 1000000000) + functionEnd.tv_nsec) + '\n'));
+                                + std::to_string((functionEnd.tv_sec * 1000000000) + functionEnd.tv_nsec)));
+            std::string pairs = extras();
+            if (!pairs.empty()) {
+                other.append(',' + pairs);
+            }
+            other.append("\n");
         }
 
         friend std::ostream& operator<<(std::ostream &os, const FunctionLog &funcLog) {
@@ -106,6 +578,12 @@ class FunctionLog {
                          + std::to_string((funcLog.functionEnd.tv_sec * 1000000000) 
                          + funcLog.functionEnd.tv_nsec));
 
+            // Optional sixth column of key=value pairs, left out when empty.
+            std::string extras = funcLog.extras();
+            if (!extras.empty()) {
+                os << ',' << extras;
+            }
+
             return os;
         }
 
@@ -120,6 +598,129 @@ class FunctionLog {
 
         timespec functionStart;
         timespec functionEnd;
+
+        // Probe pairs which fired while the function ran.
+        unsigned int nestedProbes;
+        unsigned int nestedSyncProbes;
+
+        // Nanoseconds the thread was on CPU, -1 if not measured.
+        long long cpuTime;
+        timespec cpuStart;
+
+        // Inverse of the probability that the semantic interval was kept.
+        double weight;
+
+        // Changes of the OS counters over a semantic interval, as key=value
+        // pairs.
+        std::string osCounters;
+
+        // Counts of the perf events during the function, -1 where not
+        // counted, empty unless VPROF_PERF_EVENTS is set.
+        std::vector<long long> perfCounts;
+
+        // Allocations during the function, all 0 unless alloc_tracer.cc is
+        // linked.
+        VProfAllocCounters alloc = VProfAllocCounters();
+
+        // Speedup of the experiment a semantic interval ran in, -1 if none,
+        // and the delay inserted during the interval.
+        int speedup = -1;
+        long long virtualDelay = 0;
+
+        // Sequence number of the item a queue operation enqueued or
+        // dequeued, -1 for other operations.
+        long long queueSeq = -1;
+};
+
+// Tail-based retention, enabled by setting VPROF_TAIL_QUANTILE. A semantic
+// interval is kept if its latency is at or above that quantile of the last
+// WINDOW_SIZE intervals, or else with probability VPROF_BASELINE_RATE, and
+// is weighted by the inverse of the probability it had of being kept, so that
+// weighted statistics over the kept intervals estimate those of all of them.
+// Everything is kept, with weight 1, until the window has filled up once.
+class TailSampler {
+    public:
+        TailSampler(double _quantile, double _baselineRate):
+        quantile(_quantile), baselineRate(_baselineRate), next(0), sinceUpdate(0),
+        threshold(0), rng(std::random_device()()), uniform(0, 1) {
+            window.reserve(WINDOW_SIZE);
+        }
+
+        // Returns the weight of the interval, 0 if it is to be dropped.
+        double Sample(double latency) {
+            std::lock_guard<std::mutex> lock(samplerMutex);
+            bool isWarm = window.size() == WINDOW_SIZE;
+            if (!isWarm) {
+                window.push_back(latency);
+            } else {
+                window[next] = latency;
+                next = (next + 1) % WINDOW_SIZE;
+            }
+            if (window.size() == WINDOW_SIZE && (!isWarm || ++sinceUpdate == UPDATE_PERIOD)) {
+                updateThreshold();
+            }
+
+            if (!isWarm || latency >= threshold) {
+                return 1;
+            }
+            return uniform(rng) < baselineRate ? 1 / baselineRate : 0;
+        }
+
+    private:
+        static const size_t WINDOW_SIZE = 1000;
+        static const size_t UPDATE_PERIOD = 100;
+
+        double quantile;
+        double baselineRate;
+
+        std::vector<double> window;
+        size_t next;
+        size_t sinceUpdate;
+        double threshold;
+
+        std::mt19937 rng;
+        std::uniform_real_distribution<double> uniform;
+        std::mutex samplerMutex;
+
+        void updateThreshold() {
+            std::vector<double> sorted(window);
+            size_t rank = std::min(WINDOW_SIZE - 1, static_cast<size_t>(quantile * WINDOW_SIZE));
+            std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+            threshold = sorted[rank];
+            sinceUpdate = 0;
+        }
+};
+
+// Running mean and variance of the latencies of one function index, merged
+// across threads with the pairwise update.
+struct LatencyStats {
+    LatencyStats(): count(0), mean(0), m2(0) {}
+
+    void add(double latency) {
+        count++;
+        double delta = latency - mean;
+        mean += delta / count;
+        m2 += delta * (latency - mean);
+    }
+
+    void merge(const LatencyStats &other) {
+        if (other.count == 0) {
+            return;
+        }
+        long total = count + other.count;
+        double delta = other.mean - mean;
+        mean += delta * other.count / total;
+        m2 += other.m2 + delta * delta * count * other.count / total;
+        count = total;
+    }
+
+    double variance() const {
+        return count > 1 ? m2 / count : 0;
+    }
+
+    long count;
+    double mean;
+    double m2;
 };
 
 class FunctionTracer {
@@ -138,7 +739,10 @@ public:
 
     void endSI(bool successful);
 
-    void addRecord(int functionIndex, timespec &start, timespec &end);
+    void addRecord(int functionIndex, timespec &start, timespec &end,
+                   unsigned int nestedProbes = 0, unsigned int nestedSyncProbes = 0,
+                   long long cpuTime = -1, const long long *perfCounts = nullptr,
+                   const VProfAllocCounters *alloc = nullptr);
 
     void expandNumFuncs(int numFuncs);
 
@@ -150,10 +754,42 @@ private:
 
     static thread_local std::vector<std::vector<FunctionLog>> localFunctionLogs;
 
-    std::unordered_map<std::string, timespec> siStarts;
+    // The probe counts are only meaningful if the interval ends on the thread
+    // which started it.
+    struct SIStart {
+        timespec start;
+        pthread_t thread;
+        unsigned int probes;
+        unsigned int syncProbes;
+        OsCounters os;
+        int experiment;
+        long long totalDelay;
+    };
+    std::unordered_map<std::string, SIStart> siStarts;
     std::mutex siStartMutex;
     
     std::vector<std::vector<FunctionLog>> committedLogs;
+    // Calibration and disabled probe lines, written out with the logs.
+    std::vector<std::string> metadataLines;
+
+    // Latency statistics of the target function at 0 and of its callees at
+    // their indices, gathered per thread and merged when an interval ends.
+    static thread_local std::vector<LatencyStats> localStats;
+    std::vector<LatencyStats> stats;
+    double disableFraction;
+    long disableMinSamples;
+    void disableNegligibleProbes();
+
+    // Null unless tail-based retention is on, in which case each thread
+    // buffers at most maxBufferedRecords records of open semantic intervals,
+    // and intervals which overflow it on any thread are dropped. They are
+    // kept in overflowedSIIDs, under commitStatusMutex, until they end.
+    std::unique_ptr<TailSampler> tailSampler;
+    size_t maxBufferedRecords;
+    static thread_local size_t numBufferedRecords;
+    static thread_local std::string lastOverflowedSIID;
+    std::set<std::string> overflowedSIIDs;
+    void dropOverflowedSI();
     std::mutex dataMutex;
     std::ofstream logFile;
 
@@ -169,6 +805,18 @@ private:
     static bool haveForkedSinceLastOp();
     static void refreshStateAfterFork();
 
+    static thread_local timespec lastCalibration;
+    static const int CALIBRATION_PERIOD = 10;
+    // Index the probes are calibrated with, past those whose probes can be
+    // disabled. addRecord moves its records to scratch storage, which is
+    // discarded.
+    static const int CALIBRATION_INDEX = VPROF_MAX_PROBE_INDEX;
+    static thread_local LatencyStats calibrationStats;
+    static thread_local std::vector<FunctionLog> calibrationLogs;
+    static double calibrateProbe();
+    static double calibrateSyncProbe();
+    void maybeCalibrate();
+
     timespec get_time();
     void submitToWriterThread();
 };
@@ -223,6 +871,9 @@ class SynchronizationTraceTool {
         static SynchronizationTraceTool *GetInstance();
 
         void addOperation(OperationLog opLog, FunctionLog funcLog);
+        void addLabel(const void *obj, const char *label);
+        static void SetQueueItem(long long key);
+        static void NumberQueueItem();
         
         void AddFIFOName(const char *path);
         void OnOpen(const char *path, int fd);
@@ -245,6 +896,22 @@ class SynchronizationTraceTool {
         static thread_local FunctionLog currFuncLog;
         static thread_local OperationLog currOpLog;
 
+        // Queue the current call of the thread enqueues into or dequeues
+        // from, null for other calls, and the key given to VPROF_QUEUE_ITEM
+        // or the number taken by VPROF_QUEUE_ITEM_IN_ORDER for it, -1 if
+        // none.
+        static thread_local const void *currQueue;
+        static thread_local Operation currQueueOp;
+        static thread_local long long currQueueItem;
+
+        // Items enqueued into and dequeued from each queue so far, which
+        // number the items of queues whose items have no key.
+        struct QueueSequence {
+            unsigned long long enqueued = 0;
+            unsigned long long dequeued = 0;
+        };
+        std::unordered_map<const void *, QueueSequence> queueSequences;
+
         boost::shared_mutex fifoNamesMutex;
         ulint fifoIDCounter;
         unordered_map<string, string> fifoNamesToIDs;
@@ -269,6 +936,8 @@ class SynchronizationTraceTool {
 
         std::vector<OperationLog> *opLogs;
         std::vector<FunctionLog> *funcLogs;
+        // L,objID,label lines naming objects, written before the operations.
+        std::vector<std::string> *labelLogs;
         static std::mutex dataMutex;
 
         static int numThingsLogged;
@@ -278,6 +947,10 @@ class SynchronizationTraceTool {
 
         static void maybeCreateInstance();
 
+        // Next number of the current call's queue, for enqueues or dequeues.
+        // Call with dataMutex held.
+        static long long nextQueueItem();
+
         SynchronizationTraceTool();
 
         template <typename T>
@@ -288,20 +961,71 @@ class SynchronizationTraceTool {
 
         static void writeLogWorker();
         static void writeLogs(std::vector<OperationLog> *opLogs,
-                              std::vector<FunctionLog> *funcLogs);
+                              std::vector<FunctionLog> *funcLogs,
+                              std::vector<std::string> *labelLogs);
 };
 
-static int TARGET_PATH_COUNT = 0;
-static thread_local int pathCount = 0;
+int vprofTargetPathCount = 0;
+__thread VProfThreadState vprofThreadState;
+__thread VProfAllocCounters vprofAllocCounters __attribute__((tls_model("initial-exec")));
+
+static int readCpuTimePeriod() {
+    const char *period = getenv("VPROF_CPU_TIME");
+    return period != nullptr ? atoi(period) : 0;
+}
+
+int vprofCpuTimePeriod = readCpuTimePeriod();
+static thread_local unsigned int cpu_time_samples;
+static thread_local timespec function_start_cpu;
+int vprofNumPerfEvents = PerfEvents::Names().size();
+static thread_local long long function_start_perf[VPROF_MAX_PERF_EVENTS];
+static thread_local VProfAllocCounters function_start_alloc;
+int vprofSpeedupIndex = VirtualSpeedup::ReadIndex();
+
+void VPROF_SPEEDUP_PAY() {
+    VirtualSpeedup::Pay();
+}
+
+void VPROF_SPEEDUP_END(int index, const timespec *start, const timespec *end) {
+    if (index == vprofSpeedupIndex) {
+        VirtualSpeedup::Credit((end->tv_sec - start->tv_sec) * 1000000000LL + (end->tv_nsec - start->tv_nsec));
+    }
+}
+
+void VPROF_PERF_READ(long long *counts) {
+    PerfEvents::Read(counts);
+}
+
+void VPROF_PERF_SINCE(long long *counts, const long long *start) {
+    PerfEvents::Read(counts);
+    for (int i = 0; i < VPROF_MAX_PERF_EVENTS; i++) {
+        counts[i] = counts[i] >= 0 && start[i] >= 0 ? counts[i] - start[i] : -1;
+    }
+}
+
+// Decides whether the target function call or semantic interval starting on
+// the thread is one of the sampled ones.
+static void sampleCpuTime() {
+    if (vprofCpuTimePeriod > 1) {
+        vprofThreadState.skipCpuTime = cpu_time_samples++ % vprofCpuTimePeriod != 0;
+    }
+}
 static thread_local timespec function_start;
 static thread_local timespec function_end;
-static thread_local timespec call_start;
-static thread_local timespec call_end;
+static thread_local unsigned int function_start_probes;
+static thread_local unsigned int function_start_sync_probes;
 std::unique_ptr<FunctionTracer> FunctionTracer::singleton;
 std::mutex FunctionTracer::singletonMutex;
 pid_t FunctionTracer::lastPID;
 thread_local std::vector<std::vector<FunctionLog>> FunctionTracer::localFunctionLogs;
+thread_local LatencyStats FunctionTracer::calibrationStats;
+thread_local std::vector<FunctionLog> FunctionTracer::calibrationLogs;
 thread_local std::string FunctionTracer::currentSIID;
+thread_local timespec FunctionTracer::lastCalibration;
+thread_local std::vector<LatencyStats> FunctionTracer::localStats;
+thread_local size_t FunctionTracer::numBufferedRecords;
+thread_local std::string FunctionTracer::lastOverflowedSIID;
+unsigned char vprofProbeDisabled[VPROF_MAX_PROBE_INDEX];
 
 FunctionTracer *FunctionTracer::GetInstance() {
     if (singleton == nullptr) {
@@ -320,6 +1044,24 @@ FunctionTracer::FunctionTracer() {
     shouldStop = false;
     writerThread = std::thread(writeLogs);
     lastPID = ::getpid();
+
+    // A callee is disabled once its latency's standard deviation is below
+    // VPROF_DISABLE_FRACTION of the target's, which bounds its share of the
+    // target's variance by the same fraction. Unset or 0 never disables, so
+    // that runs keep every callee unless asked otherwise.
+    const char *fraction = getenv("VPROF_DISABLE_FRACTION");
+    disableFraction = fraction != nullptr ? atof(fraction) : 0;
+    const char *minSamples = getenv("VPROF_DISABLE_MIN_SAMPLES");
+    disableMinSamples = minSamples != nullptr ? atol(minSamples) : 1000;
+
+    const char *tailQuantile = getenv("VPROF_TAIL_QUANTILE");
+    if (tailQuantile != nullptr) {
+        const char *baselineRate = getenv("VPROF_BASELINE_RATE");
+        tailSampler = std::unique_ptr<TailSampler>(
+            new TailSampler(atof(tailQuantile), baselineRate != nullptr ? atof(baselineRate) : 0.01));
+    }
+    const char *bufferSize = getenv("VPROF_SESSION_BUFFER_SIZE");
+    maxBufferedRecords = bufferSize != nullptr ? atol(bufferSize) : 65536;
 }
 
 FunctionTracer::~FunctionTracer() {
@@ -334,14 +1076,28 @@ std::string FunctionTracer::getCurrentSIID() {
 }
 
 void FunctionTracer::startSI(std::string SIID) {
+    VPROF_RECORD_SLOW();
+    maybeCalibrate();
+    sampleCpuTime();
     currentSIID = SIID;
-    timespec transStart = get_time();
+    SIStart siStart;
+    siStart.thread = pthread_self();
+    siStart.probes = vprofThreadState.numProbes;
+    siStart.syncProbes = vprofThreadState.numSyncProbes;
+    siStart.os = OsCounters::Read();
+    if (vprofSpeedupIndex >= 0) {
+        VirtualSpeedup::Pay();
+        VirtualSpeedup::Speedup(&siStart.experiment);
+        siStart.totalDelay = VirtualSpeedup::TotalDelay();
+    }
+    siStart.start = get_time();
     siStartMutex.lock();
-    siStarts[SIID] = transStart;
+    siStarts[SIID] = siStart;
     siStartMutex.unlock();
 }
 
 void FunctionTracer::switchSI(std::string SIID) {
+    VPROF_RECORD_SLOW();
     std::string originalSIID = currentSIID;
     FunctionLog funcLog(SIID);
     funcLog.start();
@@ -352,30 +1108,109 @@ void FunctionTracer::switchSI(std::string SIID) {
 }
 
 void FunctionTracer::endSI(bool successful) {
-    timespec transStart;
+    VPROF_RECORD_SLOW();
+    SIStart siStart;
     siStartMutex.lock();
-    transStart = siStarts[currentSIID];
+    siStart = siStarts[currentSIID];
     siStarts.erase(currentSIID);
     siStartMutex.unlock();
 
     timespec transEnd = get_time();
-    FunctionLog log(currentSIID, transStart, transEnd);
+    FunctionLog log(currentSIID, siStart.start, transEnd);
+    if (pthread_equal(siStart.thread, pthread_self())) {
+        log.setNestedProbes(vprofThreadState.numProbes - siStart.probes,
+                            vprofThreadState.numSyncProbes - siStart.syncProbes);
+        log.setOsCounters(OsCounters::Read().deltaSince(siStart.os));
+    }
+    if (vprofSpeedupIndex >= 0) {
+        int experiment;
+        int speedup = VirtualSpeedup::Speedup(&experiment);
+        if (experiment == siStart.experiment) {
+            log.setSpeedup(speedup, VirtualSpeedup::TotalDelay() - siStart.totalDelay);
+        }
+    }
+
+    // Dropped intervals are not committed, which frees their records below
+    // and on the other threads once they submit theirs.
+    double weight = 1;
+    if (tailSampler) {
+        weight = tailSampler->Sample((transEnd.tv_sec - siStart.start.tv_sec) * 1000000000.0 +
+                                     (transEnd.tv_nsec - siStart.start.tv_nsec));
+        log.setWeight(weight);
+    }
     localFunctionLogs[0].push_back(log);
     commitStatusMutex.lock();
-    commitStatus[currentSIID] = successful;
+    bool hasOverflowed = overflowedSIIDs.erase(currentSIID) > 0;
+    commitStatus[currentSIID] = successful && weight > 0 && !hasOverflowed;
     commitStatusMutex.unlock();
     submitToWriterThread();
+    maybeCalibrate();
 }
 
-void FunctionTracer::addRecord(int functionIndex, timespec &start, timespec &end) {
+void FunctionTracer::addRecord(int functionIndex, timespec &start, timespec &end,
+                               unsigned int nestedProbes, unsigned int nestedSyncProbes,
+                               long long cpuTime, const long long *perfCounts,
+                               const VProfAllocCounters *alloc) {
+    bool isCalibration = functionIndex == CALIBRATION_INDEX;
+    size_t statsIndex = functionIndex == -1 ? 0 : functionIndex;
+    if (!isCalibration && localStats.size() <= statsIndex) {
+        localStats.resize(statsIndex + 1);
+    }
+    LatencyStats &latencyStats = isCalibration ? calibrationStats : localStats[statsIndex];
+    latencyStats.add((end.tv_sec - start.tv_sec) * 1000000000.0 + (end.tv_nsec - start.tv_nsec));
+
+    if (tailSampler && !isCalibration) {
+        if (numBufferedRecords >= maxBufferedRecords) {
+            if (currentSIID != lastOverflowedSIID) {
+                dropOverflowedSI();
+            }
+            return;
+        }
+        numBufferedRecords++;
+    }
+
     FunctionLog log(currentSIID, start, end);
-    if (functionIndex == -1) {
+    log.setNestedProbes(nestedProbes, nestedSyncProbes);
+    log.setCpuTime(cpuTime);
+    if (perfCounts != nullptr) {
+        log.setPerfCounts(perfCounts);
+    }
+    if (alloc != nullptr) {
+        log.setAlloc(*alloc);
+    }
+    if (isCalibration) {
+        calibrationLogs.push_back(log);
+    } else if (functionIndex == -1) {
         localFunctionLogs.back().push_back(log);
     } else {
         localFunctionLogs[functionIndex].push_back(log);
     }
 }
 
+// Drops the current semantic interval, whose record of this thread did not
+// fit in its buffer. An interval which already ended on another thread is
+// only marked with an O,SIID line, for the analysis to drop the records of it
+// already written.
+void FunctionTracer::dropOverflowedSI() {
+    lastOverflowedSIID = currentSIID;
+    bool wasKept = false;
+    commitStatusMutex.lock();
+    auto it = commitStatus.find(currentSIID);
+    if (it == commitStatus.end()) {
+        overflowedSIIDs.insert(currentSIID);
+    } else {
+        wasKept = it->second;
+        it->second = false;
+    }
+    commitStatusMutex.unlock();
+
+    if (wasKept) {
+        dataMutex.lock();
+        metadataLines.push_back("O," + currentSIID);
+        dataMutex.unlock();
+    }
+}
+
 void FunctionTracer::expandNumFuncs(int numFuncs) {
     std::vector<FunctionLog> tempVector;
     while (localFunctionLogs.size() < numFuncs + 2) {
@@ -393,9 +1228,15 @@ void FunctionTracer::writeLogs() {
             refreshStateAfterFork();
         }
         std::vector<std::vector<FunctionLog>> logsToWrite;
+        std::vector<std::string> metadataToWrite;
         singleton->dataMutex.lock();
         logsToWrite.swap(singleton->committedLogs);
+        metadataToWrite.swap(singleton->metadataLines);
         singleton->dataMutex.unlock();
+
+        for (const std::string &metadata : metadataToWrite) {
+            singleton->logFile << metadata << std::endl;
+        }
         
         int count = 0;
         for (size_t i = 0; i < logsToWrite.size(); ++i) {
@@ -425,11 +1266,142 @@ void FunctionTracer::refreshStateAfterFork() {
     singleton->writerThread = std::thread(writeLogs);
 }
 
+// Cost of a fired TRACE_START/TRACE_END pair as seen by the function it is
+// nested in, measured on the probes themselves with CALIBRATION_INDEX. The
+// rounds are a whole number of record buffers, so that each pays its share of
+// VPROF_RECORD_SLOW. The fastest round is kept, so that preemption during
+// calibration is not counted. The thread state, buffered records included,
+// is restored after.
+double FunctionTracer::calibrateProbe() {
+    static const int ROUNDS = 5;
+    static const int PROBES = 32 * VPROF_RECORD_BUFFER_SIZE;
+    VProfThreadState *state = &vprofThreadState;
+    VProfThreadState savedState = *state;
+    state->pathCount = vprofTargetPathCount;
+    calibrationLogs.reserve(PROBES);
+    double best = -1;
+    for (int round = 0; round < ROUNDS; round++) {
+        state->numRecords = 0;
+        calibrationLogs.clear();
+        timespec roundStart, roundEnd;
+        clock_gettime(CLOCK_REALTIME, &roundStart);
+        for (int i = 0; i < PROBES; i++) {
+            TRACE_INDEX_START(CALIBRATION_INDEX);
+            TRACE_END(CALIBRATION_INDEX);
+        }
+        clock_gettime(CLOCK_REALTIME, &roundEnd);
+        double probeNs = ((roundEnd.tv_sec - roundStart.tv_sec) * 1000000000.0 +
+                          (roundEnd.tv_nsec - roundStart.tv_nsec)) / PROBES;
+        if (best < 0 || probeNs < best) {
+            best = probeNs;
+        }
+    }
+    *state = savedState;
+    calibrationLogs.clear();
+    calibrationStats = LatencyStats();
+    return best;
+}
+
+// Cost of SYNCHRONIZATION_CALL_START and END outside of the call they time,
+// replayed on scratch logs so that nothing reaches the synchronization log.
+double FunctionTracer::calibrateSyncProbe() {
+    static const int ROUNDS = 5;
+    static const int PROBES = 200;
+    std::mutex scratchMutex;
+    std::vector<OperationLog> scratchOps;
+    std::vector<FunctionLog> scratchFuncs;
+    scratchOps.reserve(PROBES);
+    scratchFuncs.reserve(PROBES);
+    double best = -1;
+    for (int round = 0; round < ROUNDS; round++) {
+        scratchOps.clear();
+        scratchFuncs.clear();
+        timespec roundStart, roundEnd;
+        clock_gettime(CLOCK_REALTIME, &roundStart);
+        for (int i = 0; i < PROBES; i++) {
+            scratchMutex.lock();
+            FunctionLog funcLog(currentSIID);
+            scratchOps.push_back(OperationLog(&scratchMutex, MUTEX_LOCK));
+            scratchMutex.unlock();
+            funcLog.start();
+            funcLog.end();
+            scratchMutex.lock();
+            scratchFuncs.push_back(funcLog);
+            scratchMutex.unlock();
+        }
+        clock_gettime(CLOCK_REALTIME, &roundEnd);
+        double probeNs = ((roundEnd.tv_sec - roundStart.tv_sec) * 1000000000.0 +
+                          (roundEnd.tv_nsec - roundStart.tv_nsec)) / PROBES;
+        if (best < 0 || probeNs < best) {
+            best = probeNs;
+        }
+    }
+    return best;
+}
+
+// Calibrates the probes of the calling thread when it first starts or ends a
+// semantic interval and every CALIBRATION_PERIOD seconds after that, always
+// outside of the intervals. The line written is
+// C,entity,clock,time,probe ns,sync probe ns, followed with VPROF_CPU_TIME by
+// the costs of the probes in the calls and intervals which sample CPU time.
+void FunctionTracer::maybeCalibrate() {
+    timespec now = get_time();
+    if (lastCalibration.tv_sec != 0 && now.tv_sec - lastCalibration.tv_sec < CALIBRATION_PERIOD) {
+        return;
+    }
+    lastCalibration = now;
+
+    int skipCpuTime = vprofThreadState.skipCpuTime;
+    vprofThreadState.skipCpuTime = 1;
+    double probeNs = calibrateProbe();
+    double syncProbeNs = calibrateSyncProbe();
+    std::string calibration = "C," + std::to_string(pthread_self()) + "_" + std::to_string(::getpid()) +
+                              ",realtime," + std::to_string(now.tv_sec * 1000000000 + now.tv_nsec) + ',' +
+                              std::to_string(probeNs) + ',' + std::to_string(syncProbeNs);
+    if (vprofCpuTimePeriod > 0) {
+        vprofThreadState.skipCpuTime = 0;
+        probeNs = calibrateProbe();
+        syncProbeNs = calibrateSyncProbe();
+        calibration += ',' + std::to_string(probeNs) + ',' + std::to_string(syncProbeNs);
+    }
+    vprofThreadState.skipCpuTime = skipCpuTime;
+    dataMutex.lock();
+    metadataLines.push_back(calibration);
+    dataMutex.unlock();
+}
+
 timespec FunctionTracer::get_time() {
     timespec now;
     clock_gettime(CLOCK_REALTIME, &now);
     return now;
 }
+// Called with dataMutex held. The line written for each disabled index is
+// D,index,time,samples,mean,variance.
+void FunctionTracer::disableNegligibleProbes() {
+    if (disableFraction <= 0 || stats.empty() || stats[0].count < disableMinSamples ||
+        stats[0].variance() <= 0) {
+        return;
+    }
+
+    double maxVariance = disableFraction * disableFraction * stats[0].variance();
+    for (size_t i = 1; i < stats.size() && i < VPROF_MAX_PROBE_INDEX; i++) {
+        // The function being virtually sped up keeps its probes, or its
+        // TRACE_END would stop crediting the delay and flatten the curve.
+        if (static_cast<int>(i) == vprofSpeedupIndex || vprofProbeDisabled[i] ||
+            stats[i].count < disableMinSamples ||
+            stats[i].variance() >= maxVariance) {
+            continue;
+        }
+
+        __atomic_store_n(&vprofProbeDisabled[i], 1, __ATOMIC_RELAXED);
+        timespec now = get_time();
+        metadataLines.push_back("D," + std::to_string(i) + ',' +
+                                std::to_string(now.tv_sec * 1000000000 + now.tv_nsec) + ',' +
+                                std::to_string(stats[i].count) + ',' + std::to_string(stats[i].mean) + ',' +
+                                std::to_string(stats[i].variance()));
+    }
+}
+
 void FunctionTracer::submitToWriterThread() {
     std::vector<std::vector<FunctionLog>> newLocalLogs;
     std::vector<FunctionLog> tempVector;
@@ -455,32 +1427,47 @@ void FunctionTracer::submitToWriterThread() {
         }
     }
     commitStatusMutex.unlock();
+
+    if (stats.size() < localStats.size()) {
+        stats.resize(localStats.size());
+    }
+    for (size_t i = 0; i < localStats.size(); ++i) {
+        stats[i].merge(localStats[i]);
+        localStats[i] = LatencyStats();
+    }
+    disableNegligibleProbes();
     dataMutex.unlock();
     localFunctionLogs = newLocalLogs;
+
+    numBufferedRecords = 0;
+    for (size_t i = 0; i < localFunctionLogs.size(); ++i) {
+        numBufferedRecords += localFunctionLogs[i].size();
+    }
 }
 
 void TARGET_PATH_SET(int pathCount) {
-    TARGET_PATH_COUNT = pathCount;
+    vprofTargetPathCount = pathCount;
 }
 
 void NUM_FUNCS_SET(int numFuncs) {
     FunctionTracer::GetInstance()->expandNumFuncs(numFuncs);
 }
 
-void PATH_INC(int expectedCount) {
-    if (pathCount == expectedCount) {
-        pathCount++;
+// Records are tagged with the semantic interval current when they are moved,
+// which is why every change of it moves the buffered records first.
+void VPROF_RECORD_SLOW() {
+    VProfThreadState *state = &vprofThreadState;
+    if (state->numRecords == 0) {
+        return;
     }
-}
-
-void PATH_DEC(int expectedCount) {
-    if (pathCount == expectedCount + 1) {
-        pathCount--;
+    FunctionTracer *tracer = FunctionTracer::GetInstance();
+    for (int i = 0; i < state->numRecords; i++) {
+        VProfRecord &record = state->records[i];
+        tracer->addRecord(record.index, record.start, record.end,
+                          record.nestedProbes, record.nestedSyncProbes, record.cpuTime,
+                          vprofNumPerfEvents > 0 ? record.perfCounts : nullptr, &record.alloc);
     }
-}
-
-int PATH_GET() {
-    return pathCount;
+    state->numRecords = 0;
 }
 
 void SESSION_START(const char *SIID) {
@@ -497,36 +1484,112 @@ void SESSION_END(int successful) {
 
 void TRACE_FUNCTION_START(int numFuncs) {
     FunctionTracer::GetInstance()->expandNumFuncs(numFuncs);
-    if (pathCount == TARGET_PATH_COUNT) {
+    if (vprofThreadState.pathCount == vprofTargetPathCount) {
+        sampleCpuTime();
+        function_start_probes = vprofThreadState.numProbes;
+        function_start_sync_probes = vprofThreadState.numSyncProbes;
+        function_start_alloc = vprofAllocCounters;
+        if (vprofNumPerfEvents > 0) {
+            VPROF_PERF_READ(function_start_perf);
+        }
         clock_gettime(CLOCK_REALTIME, &function_start);
+        if (VPROF_MEASURE_CPU_TIME()) {
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &function_start_cpu);
+        }
     }
 }
 
 void TRACE_FUNCTION_END() {
-    if (pathCount == TARGET_PATH_COUNT) {
+    if (vprofThreadState.pathCount == vprofTargetPathCount) {
+        long long cpuTime = VPROF_MEASURE_CPU_TIME() ? VPROF_CPU_TIME_SINCE(&function_start_cpu) : -1;
         clock_gettime(CLOCK_REALTIME, &function_end);
-        FunctionTracer::GetInstance()->addRecord(-1, function_start, function_end);
+        long long perfCounts[VPROF_MAX_PERF_EVENTS];
+        if (vprofNumPerfEvents > 0) {
+            VPROF_PERF_SINCE(perfCounts, function_start_perf);
+        }
+        VProfAllocCounters alloc;
+        VPROF_ALLOC_SINCE(&alloc, &function_start_alloc);
+        FunctionTracer::GetInstance()->addRecord(-1, function_start, function_end,
+                                                 vprofThreadState.numProbes - function_start_probes,
+                                                 vprofThreadState.numSyncProbes - function_start_sync_probes,
+                                                 cpuTime, vprofNumPerfEvents > 0 ? perfCounts : nullptr, &alloc);
+        vprofThreadState.numProbes++;
     }
 }
 
-int TRACE_START() {
-    if (pathCount == TARGET_PATH_COUNT) {
-        clock_gettime(CLOCK_REALTIME, &call_start);
+static int readActiveTarget() {
+    const char *target = getenv("VPROF_TARGET");
+    if (target != nullptr) {
+        return atoi(target);
+    }
+
+    int targetID = -1;
+    ifstream targetFile("vprof_target");
+    if (!(targetFile >> targetID)) {
+        targetID = -1;
     }
-    return 0;
+    return targetID;
 }
 
-int TRACE_END(int index) {
-    if (pathCount == TARGET_PATH_COUNT) {
-        clock_gettime(CLOCK_REALTIME, &call_end);
-        FunctionTracer::GetInstance()->addRecord(index, call_start, call_end);
+int vprofActiveTarget = -2;
+
+int ACTIVE_TARGET_GET() {
+    static const int activeTarget = readActiveTarget();
+    __atomic_store_n(&vprofActiveTarget, activeTarget, __ATOMIC_RELAXED);
+    return activeTarget;
+}
+
+// Calls of the active target open on the thread. Only the outermost one is
+// traced, as recursive calls, or calls through its callees, would otherwise
+// overwrite its start.
+static thread_local int target_depth;
+
+int TRACE_TARGET_FUNCTION_START(int targetID, int numFuncs) {
+    if (targetID == ACTIVE_TARGET_GET() && target_depth++ == 0) {
+        FunctionTracer::GetInstance()->expandNumFuncs(numFuncs);
+        sampleCpuTime();
+        function_start_probes = vprofThreadState.numProbes;
+        function_start_sync_probes = vprofThreadState.numSyncProbes;
+        function_start_alloc = vprofAllocCounters;
+        if (vprofNumPerfEvents > 0) {
+            VPROF_PERF_READ(function_start_perf);
+        }
+        clock_gettime(CLOCK_REALTIME, &function_start);
+        if (VPROF_MEASURE_CPU_TIME()) {
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &function_start_cpu);
+        }
     }
-    return 0;
+    return targetID;
+}
+
+void TRACE_TARGET_FUNCTION_END(int targetID) {
+    if (targetID == ACTIVE_TARGET_GET() && --target_depth == 0) {
+        long long cpuTime = VPROF_MEASURE_CPU_TIME() ? VPROF_CPU_TIME_SINCE(&function_start_cpu) : -1;
+        clock_gettime(CLOCK_REALTIME, &function_end);
+        long long perfCounts[VPROF_MAX_PERF_EVENTS];
+        if (vprofNumPerfEvents > 0) {
+            VPROF_PERF_SINCE(perfCounts, function_start_perf);
+        }
+        VProfAllocCounters alloc;
+        VPROF_ALLOC_SINCE(&alloc, &function_start_alloc);
+        FunctionTracer::GetInstance()->addRecord(-1, function_start, function_end,
+                                                 vprofThreadState.numProbes - function_start_probes,
+                                                 vprofThreadState.numSyncProbes - function_start_sync_probes,
+                                                 cpuTime, vprofNumPerfEvents > 0 ? perfCounts : nullptr, &alloc);
+        vprofThreadState.numProbes++;
+    }
+}
+
+void TRACE_TARGET_FUNCTION_CLEANUP(int *targetID) {
+    TRACE_TARGET_FUNCTION_END(*targetID);
 }
 
 int SynchronizationTraceTool::numThingsLogged = 0;
 thread_local OperationLog SynchronizationTraceTool::currOpLog;
 thread_local FunctionLog SynchronizationTraceTool::currFuncLog;
+thread_local const void *SynchronizationTraceTool::currQueue = nullptr;
+thread_local Operation SynchronizationTraceTool::currQueueOp;
+thread_local long long SynchronizationTraceTool::currQueueItem = -1;
 std::mutex SynchronizationTraceTool::dataMutex;
 pid_t SynchronizationTraceTool::lastPID;
 
@@ -541,6 +1604,18 @@ void SYNCHRONIZATION_CALL_END() {
     SynchronizationTraceTool::SynchronizationCallEnd();
 }
 
+void VPROF_LABEL_OBJECT(const void *obj, const char *label) {
+    SynchronizationTraceTool::GetInstance()->addLabel(obj, label);
+}
+
+void VPROF_QUEUE_ITEM(unsigned long long key) {
+    SynchronizationTraceTool::SetQueueItem(static_cast<long long>(key & LLONG_MAX));
+}
+
+void VPROF_QUEUE_ITEM_IN_ORDER() {
+    SynchronizationTraceTool::NumberQueueItem();
+}
+
 void Filesystem::CreateDirIfNotExists(const string &dirName) {
     boost::filesystem::path dir(dirName);
 
@@ -553,6 +1628,7 @@ void Filesystem::CreateDirIfNotExists(const string &dirName) {
 SynchronizationTraceTool::SynchronizationTraceTool() {
     opLogs = new vector<OperationLog>;
     funcLogs = new vector<FunctionLog>;
+    labelLogs = new vector<string>;
     doneWriting = false;
 
     opLogs->reserve(1000000);
@@ -585,8 +1661,13 @@ void SynchronizationTraceTool::SynchronizationCallStart(Operation op, void *obj)
         maybeCreateInstance();
     }
 
+    if (vprofSpeedupIndex >= 0) {
+        VirtualSpeedup::Pay();
+    }
     dataMutex.lock();
     currFuncLog = FunctionLog(FunctionTracer::GetInstance()->getCurrentSIID());
+    currQueue = op == QUEUE_ENQUEUE || op == QUEUE_DEQUEUE ? obj : nullptr;
+    currQueueOp = op;
 
     pushToVec(*instance->opLogs, OperationLog(obj, op));
     dataMutex.unlock();
@@ -598,8 +1679,25 @@ void SynchronizationTraceTool::SynchronizationCallEnd() {
     currFuncLog.end();
 
     dataMutex.lock();
+    // Items with neither a key nor a number yet are numbered when the call
+    // ends, which is after the queue's own lock is released.  Concurrent
+    // enqueues, or dequeues, may end in another order than the one they
+    // took the queue in, so their items must be numbered by
+    // VPROF_QUEUE_ITEM_IN_ORDER or given keys by VPROF_QUEUE_ITEM.
+    if (currQueue != nullptr) {
+        if (currQueueItem < 0) {
+            currQueueItem = nextQueueItem();
+        }
+        currFuncLog.setQueueSeq(currQueueItem);
+        currQueue = nullptr;
+        currQueueItem = -1;
+    }
     pushToVec(*instance->funcLogs, currFuncLog);
     dataMutex.unlock();
+    vprofThreadState.numSyncProbes++;
+    if (vprofSpeedupIndex >= 0) {
+        VirtualSpeedup::Forgive();
+    }
 }
 
 SynchronizationTraceTool* SynchronizationTraceTool::GetInstance() {
@@ -629,6 +1727,37 @@ void SynchronizationTraceTool::addOperation(OperationLog opLog, FunctionLog func
     dataMutex.unlock();
 }
 
+void SynchronizationTraceTool::SetQueueItem(long long key) {
+    currQueueItem = key;
+}
+
+void SynchronizationTraceTool::NumberQueueItem() {
+    if (currQueue == nullptr) {
+        return;
+    }
+    dataMutex.lock();
+    currQueueItem = nextQueueItem();
+    dataMutex.unlock();
+}
+
+long long SynchronizationTraceTool::nextQueueItem() {
+    QueueSequence &sequence = instance->queueSequences[currQueue];
+    return currQueueOp == QUEUE_ENQUEUE ? sequence.enqueued++ : sequence.dequeued++;
+}
+
+void SynchronizationTraceTool::addLabel(const void *obj, const char *label) {
+    std::stringstream line;
+    line << "L," << obj << ',';
+    for (const char *c = label; *c != '\0'; c++) {
+        line << (*c == ',' || *c == '\n' ? ' ' : *c);
+    }
+    line << '\n';
+
+    dataMutex.lock();
+    pushToVec(*instance->labelLogs, line.str());
+    dataMutex.unlock();
+}
+
 template <typename T>
 void SynchronizationTraceTool::pushToVec(vector<T> &vec, const T &val) {
     if (haveForkedSinceLastOp()) {
@@ -668,6 +1797,7 @@ void SynchronizationTraceTool::writeLogWorker() {
 
             vector<OperationLog> *newOpLogs = new vector<OperationLog>;
             vector<FunctionLog> *newFuncLogs = new vector<FunctionLog>;
+            vector<string> *newLabelLogs = new vector<string>;
 
             // TODO TODO TODO experiment with this size!!!!
             newOpLogs->reserve(instance->opLogs->size() * 4);
@@ -677,9 +1807,11 @@ void SynchronizationTraceTool::writeLogWorker() {
 
             vector<OperationLog> *oldOpLogs = instance->opLogs;
             vector<FunctionLog> *oldFuncLogs = instance->funcLogs;
+            vector<string> *oldLabelLogs = instance->labelLogs;
 
             instance->opLogs = newOpLogs;
             instance->funcLogs = newFuncLogs;
+            instance->labelLogs = newLabelLogs;
 
             if (instance->doneWriting) {
                 stopLogging = true;
@@ -687,15 +1819,20 @@ void SynchronizationTraceTool::writeLogWorker() {
 
             dataMutex.unlock();
 
-            writeLogs(oldOpLogs, oldFuncLogs);
+            writeLogs(oldOpLogs, oldFuncLogs, oldLabelLogs);
         }
     }
 }
 
 void SynchronizationTraceTool::writeLogs(vector<OperationLog> *opLogs, 
-                                         vector<FunctionLog> *funcLogs) {
+                                         vector<FunctionLog> *funcLogs,
+                                         vector<string> *labelLogs) {
     string writeStr = "";
 
+    for (string &labelLog : *labelLogs) {
+        writeStr += labelLog;
+    }
+
     for (OperationLog &opLog : *opLogs) {
         writeStr += opLog;
     }
@@ -708,6 +1845,7 @@ void SynchronizationTraceTool::writeLogs(vector<OperationLog> *opLogs,
 
     delete opLogs;
     delete funcLogs;
+    delete labelLogs;
 }
 
 void ON_MKNOD(const char *path, mode_t mode) {
@@ -803,6 +1941,7 @@ size_t SynchronizationTraceTool::OnRead(int fd, void *buf, size_t nbytes) {
         dataMutex.lock();
         pushToVec(*instance->funcLogs, currFuncLog);
         dataMutex.unlock();
+        vprofThreadState.numSyncProbes++;
     } else {
         result = read(fd, buf, nbytes);
     }
@@ -842,6 +1981,7 @@ size_t SynchronizationTraceTool::OnWrite(int fd, const void *buf, size_t nbytes)
         dataMutex.lock();
         pushToVec(*instance->funcLogs, currFuncLog);
         dataMutex.unlock();
+        vprofThreadState.numSyncProbes++;
     } else {
         result = write(fd, buf, nbytes);
     }
@@ -902,6 +2042,7 @@ int SynchronizationTraceTool::OnMsgSnd(int msqid, const void *msgp, size_t msgsz
     dataMutex.lock();
     pushToVec(*instance->funcLogs, currFuncLog);
     dataMutex.unlock();
+    vprofThreadState.numSyncProbes++;
     return result;
 }
 
@@ -931,6 +2072,7 @@ ssize_t SynchronizationTraceTool::OnMsgRcv(int msqid, void *msgp, size_t msgsz,
     dataMutex.lock();
     pushToVec(*instance->funcLogs, currFuncLog);
     dataMutex.unlock();
+    vprofThreadState.numSyncProbes++;
     return result;
 }
 
@@ -969,4 +2111,4 @@ std::ostream& operator<<(std::ostream &os, const Operation &op) {
     return os;
 }
 
-
+#endif
@@ -5,6 +5,20 @@
 #include <time.h>
 #include <sys/types.h>
 
+/* Instrumented sources keep calling the functions below. Building them with
+-DVPROF_ENABLED=0 turns every call into an inline no-op (or the plain system
+call for the ON_* functions), so the instrumentation can stay in the tree
+between profiling rounds without a restore. */
+#ifndef VPROF_ENABLED
+#define VPROF_ENABLED 1
+#endif
+
+#if !VPROF_ENABLED
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#endif
+
 enum Operation  { MUTEX_LOCK,
                   MUTEX_UNLOCK,
                   CV_WAIT,
@@ -19,6 +33,8 @@ enum Operation  { MUTEX_LOCK,
 typedef struct timespec timespec;
 typedef enum Operation Operation;
 
+#if VPROF_ENABLED
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -33,27 +49,314 @@ void SWITCH_SI(const char *SIID);
 
 void SESSION_END(int successful);
 
-void TARGET_PATH_SET(int pathCount);
+void TRACE_FUNCTION_START(int numFuncs);
 
-int PATH_GET();
+void TRACE_FUNCTION_END();
 
-void PATH_INC(int expectedCount);
+/********************************************************************//**
+Fast path of the probes in the generated wrappers. The per-thread state is
+plain data in __thread storage, so it needs no initialization guard, and a
+probe inlines to the path check, a clock read and a store into the thread's
+record buffer. Records are handed to the FunctionTracer out of line when the
+buffer fills up, and before the thread's semantic interval changes.
 
-void PATH_DEC(int expectedCount);
+Every fired pair of probes is counted, and each record keeps how many pairs
+fired while it was open, so that the analysis can subtract their calibrated
+cost from it.
 
-void TRACE_FUNCTION_START(int numFuncs);
+With VPROF_CPU_TIME=N, the probes also read the thread's CPU clock in one out
+of N target function calls or semantic intervals of each thread, so that
+records carry the time the thread was on CPU next to the wall time.
 
-void TRACE_FUNCTION_END();
+With VPROF_PERF_EVENTS set to a comma separated list of perf events, such as
+task-clock,page-faults,instructions,cache-misses, the probes of the target
+function and of its callees also read a per-thread group of perf_event
+counters, with a single read() of the whole group, just outside of the wall
+time they measure. At most VPROF_MAX_PERF_EVENTS are counted, and events the
+kernel or the hardware does not provide are left out.
+
+Linking alloc_tracer.cc as well interposes the allocator, which then counts
+the calls, bytes and time of every thread's allocations, and records carry
+the changes of these counters over the call. */
+#define VPROF_RECORD_BUFFER_SIZE 64
+
+#define VPROF_MAX_PERF_EVENTS 4
+
+typedef struct VProfAllocCounters {
+    unsigned long calls;
+    unsigned long long bytes;
+    long long ns;
+} VProfAllocCounters;
+
+typedef struct VProfRecord {
+    int index;
+    unsigned int nestedProbes;
+    unsigned int nestedSyncProbes;
+    /* Nanoseconds on CPU, -1 if not measured. */
+    long long cpuTime;
+    /* Counts of the perf events during the call, -1 where not counted. */
+    long long perfCounts[VPROF_MAX_PERF_EVENTS];
+    /* Allocations during the call. */
+    VProfAllocCounters alloc;
+    timespec start;
+    timespec end;
+} VProfRecord;
+
+typedef struct VProfThreadState {
+    int pathCount;
+    int numRecords;
+    /* Fired TRACE_START/TRACE_END pairs, and synchronization call pairs. */
+    unsigned int numProbes;
+    unsigned int numSyncProbes;
+    unsigned int callStartProbes;
+    unsigned int callStartSyncProbes;
+    /* Set while the calls being traced are not sampled for CPU time. */
+    int skipCpuTime;
+    timespec callStart;
+    timespec callStartCpu;
+    long long callStartPerf[VPROF_MAX_PERF_EVENTS];
+    VProfAllocCounters callStartAlloc;
+    VProfRecord records[VPROF_RECORD_BUFFER_SIZE];
+} VProfThreadState;
+
+extern __thread VProfThreadState vprofThreadState;
+
+/* Kept apart from the thread state and in the initial TLS block, so that the
+allocator can update it without allocating the thread's TLS. */
+extern __thread VProfAllocCounters vprofAllocCounters __attribute__((tls_model("initial-exec")));
+
+static inline void VPROF_ALLOC_SINCE(VProfAllocCounters *counters, const VProfAllocCounters *start) {
+    counters->calls = vprofAllocCounters.calls - start->calls;
+    counters->bytes = vprofAllocCounters.bytes - start->bytes;
+    counters->ns = vprofAllocCounters.ns - start->ns;
+}
+
+extern int vprofTargetPathCount;
 
-int TRACE_START();
+extern int vprofCpuTimePeriod;
 
-int TRACE_END(int index);
+static inline int VPROF_MEASURE_CPU_TIME() {
+    return vprofCpuTimePeriod > 0 && !vprofThreadState.skipCpuTime;
+}
+
+static inline long long VPROF_CPU_TIME_SINCE(const timespec *cpuStart) {
+    timespec cpuEnd;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuEnd);
+    return (cpuEnd.tv_sec - cpuStart->tv_sec) * 1000000000LL + (cpuEnd.tv_nsec - cpuStart->tv_nsec);
+}
+
+/* Number of perf events requested, 0 if none. */
+extern int vprofNumPerfEvents;
+
+/* Reads the thread's perf event counters into counts, opening them on first
+use, and the changes since start into counts for the _SINCE version. */
+void VPROF_PERF_READ(long long *counts);
+void VPROF_PERF_SINCE(long long *counts, const long long *start);
+
+/* Set by the FunctionTracer once the calls of a function index have been
+shown to contribute nothing to the variance of the target, after which its
+wrappers skip the probes. Flags only ever go from 0 to 1. */
+#define VPROF_MAX_PROBE_INDEX 4096
+
+extern unsigned char vprofProbeDisabled[VPROF_MAX_PROBE_INDEX];
+
+static inline int VPROF_PROBE_ENABLED(int index) {
+    return index < 0 || index >= VPROF_MAX_PROBE_INDEX ||
+           !__atomic_load_n(&vprofProbeDisabled[index], __ATOMIC_RELAXED);
+}
+
+/* Index of the function virtually sped up, -1 unless VPROF_SPEEDUP_INDEX is
+set. Every probe is then also a point where the thread pays the delays owed
+to the calls of that function on other threads. */
+extern int vprofSpeedupIndex;
+
+void VPROF_SPEEDUP_PAY();
+void VPROF_SPEEDUP_END(int index, const timespec *start, const timespec *end);
+
+/* Slow path, moves the buffered records to the FunctionTracer. */
+void VPROF_RECORD_SLOW();
+
+static inline int PATH_GET() {
+    return vprofThreadState.pathCount;
+}
+
+static inline void PATH_INC(int expectedCount) {
+    if (vprofThreadState.pathCount == expectedCount) {
+        vprofThreadState.pathCount++;
+    }
+}
+
+static inline void PATH_DEC(int expectedCount) {
+    if (vprofThreadState.pathCount == expectedCount + 1) {
+        vprofThreadState.pathCount--;
+    }
+}
+
+static inline int TRACE_START() {
+    VProfThreadState *state = &vprofThreadState;
+    if (vprofSpeedupIndex >= 0) {
+        VPROF_SPEEDUP_PAY();
+    }
+    if (state->pathCount == vprofTargetPathCount) {
+        state->callStartProbes = state->numProbes;
+        state->callStartSyncProbes = state->numSyncProbes;
+        state->callStartAlloc = vprofAllocCounters;
+        if (vprofNumPerfEvents > 0) {
+            VPROF_PERF_READ(state->callStartPerf);
+        }
+        clock_gettime(CLOCK_REALTIME, &state->callStart);
+        if (VPROF_MEASURE_CPU_TIME()) {
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &state->callStartCpu);
+        }
+    }
+    return 0;
+}
+
+/* TRACE_START of the wrappers which know their index, so that disabled ones
+do not even read the clock. */
+static inline int TRACE_INDEX_START(int index) {
+    if (VPROF_PROBE_ENABLED(index)) {
+        TRACE_START();
+    }
+    return 0;
+}
+
+static inline int TRACE_END(int index) {
+    VProfThreadState *state = &vprofThreadState;
+    if (state->pathCount == vprofTargetPathCount && VPROF_PROBE_ENABLED(index)) {
+        VProfRecord *record = &state->records[state->numRecords];
+        record->cpuTime = VPROF_MEASURE_CPU_TIME() ? VPROF_CPU_TIME_SINCE(&state->callStartCpu) : -1;
+        clock_gettime(CLOCK_REALTIME, &record->end);
+        if (vprofNumPerfEvents > 0) {
+            VPROF_PERF_SINCE(record->perfCounts, state->callStartPerf);
+        }
+        VPROF_ALLOC_SINCE(&record->alloc, &state->callStartAlloc);
+        record->start = state->callStart;
+        record->index = index;
+        if (vprofSpeedupIndex >= 0) {
+            VPROF_SPEEDUP_END(index, &record->start, &record->end);
+        }
+        record->nestedProbes = state->numProbes - state->callStartProbes;
+        record->nestedSyncProbes = state->numSyncProbes - state->callStartSyncProbes;
+        state->numProbes++;
+        if (++state->numRecords == VPROF_RECORD_BUFFER_SIZE) {
+            VPROF_RECORD_SLOW();
+        }
+    }
+    return 0;
+}
+
+/********************************************************************//**
+Multi-target instrumentation. Every instrumented function carries a
+compile-time target ID and only the active target, chosen at startup through
+the VPROF_TARGET environment variable or a vprof_target file in the working
+directory, is traced. Switching targets then needs a rerun but no rebuild. */
+int ACTIVE_TARGET_GET();
+
+/* The active target once read, -2 before. */
+extern int vprofActiveTarget;
+
+static inline int VPROF_IS_ACTIVE_TARGET(int targetID) {
+    int activeTarget = __atomic_load_n(&vprofActiveTarget, __ATOMIC_RELAXED);
+    if (activeTarget < -1) {
+        activeTarget = ACTIVE_TARGET_GET();
+    }
+    return targetID == activeTarget;
+}
+
+/* Only the outermost call of the active target on each thread is traced. */
+int TRACE_TARGET_FUNCTION_START(int targetID, int numFuncs);
+
+void TRACE_TARGET_FUNCTION_END(int targetID);
+
+/* Used through __attribute__((cleanup)) so that every return of the target
+function ends its trace. */
+void TRACE_TARGET_FUNCTION_CLEANUP(int *targetID);
+
+/* Start of a callee call of a target, kept by its wrapper so that nested or
+recursive calls of the callee do not overwrite each other's. */
+typedef struct VProfTargetCall {
+    unsigned int startProbes;
+    unsigned int startSyncProbes;
+    timespec start;
+    timespec startCpu;
+    long long startPerf[VPROF_MAX_PERF_EVENTS];
+    VProfAllocCounters startAlloc;
+} VProfTargetCall;
+
+static inline int TRACE_TARGET_START(int targetID, VProfTargetCall *call) {
+    VProfThreadState *state = &vprofThreadState;
+    if (vprofSpeedupIndex >= 0) {
+        VPROF_SPEEDUP_PAY();
+    }
+    if (VPROF_IS_ACTIVE_TARGET(targetID)) {
+        call->startProbes = state->numProbes;
+        call->startSyncProbes = state->numSyncProbes;
+        call->startAlloc = vprofAllocCounters;
+        if (vprofNumPerfEvents > 0) {
+            VPROF_PERF_READ(call->startPerf);
+        }
+        clock_gettime(CLOCK_REALTIME, &call->start);
+        if (VPROF_MEASURE_CPU_TIME()) {
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &call->startCpu);
+        }
+    }
+    return 0;
+}
+
+static inline int TRACE_TARGET_END(int targetID, int index, const VProfTargetCall *call) {
+    VProfThreadState *state = &vprofThreadState;
+    if (VPROF_IS_ACTIVE_TARGET(targetID) && VPROF_PROBE_ENABLED(index)) {
+        VProfRecord *record = &state->records[state->numRecords];
+        record->cpuTime = VPROF_MEASURE_CPU_TIME() ? VPROF_CPU_TIME_SINCE(&call->startCpu) : -1;
+        clock_gettime(CLOCK_REALTIME, &record->end);
+        if (vprofNumPerfEvents > 0) {
+            VPROF_PERF_SINCE(record->perfCounts, call->startPerf);
+        }
+        VPROF_ALLOC_SINCE(&record->alloc, &call->startAlloc);
+        record->start = call->start;
+        record->index = index;
+        if (vprofSpeedupIndex >= 0) {
+            VPROF_SPEEDUP_END(index, &record->start, &record->end);
+        }
+        record->nestedProbes = state->numProbes - call->startProbes;
+        record->nestedSyncProbes = state->numSyncProbes - call->startSyncProbes;
+        state->numProbes++;
+        if (++state->numRecords == VPROF_RECORD_BUFFER_SIZE) {
+            VPROF_RECORD_SLOW();
+        }
+    }
+    return 0;
+}
 
 /********************************************************************//**
 These functions are called by the generated wrappers. */
 void SYNCHRONIZATION_CALL_START(Operation op, void* obj);
 void SYNCHRONIZATION_CALL_END();
 
+/* Names the synchronization object at obj in the lock contention report, which
+adds up the objects with the same label instead of reporting every address.
+VPROF_LABEL_OBJECT_HERE labels it with the file and line it is called from,
+such as where the object is allocated or initialized. The wrappers which the
+EventAnnotator generates for pthread_mutex_init and pthread_cond_init label
+their objects with the file and line of the call already. */
+void VPROF_LABEL_OBJECT(const void *obj, const char *label);
+
+/* Gives the item the current QUEUE_ENQUEUE or QUEUE_DEQUEUE call of the
+thread enqueues or dequeues, called between its SYNCHRONIZATION_CALL_START and
+SYNCHRONIZATION_CALL_END. The analysis matches every dequeue with the enqueue
+of the item with the same key, so queues which are not FIFO, such as priority
+queues, must give the same key to both. Items of other queues are numbered in
+the order the calls end, which is the order they were enqueued or dequeued in
+only if no two enqueues, or no two dequeues, run concurrently. */
+void VPROF_QUEUE_ITEM(unsigned long long key);
+
+/* Numbers the item of the current QUEUE_ENQUEUE or QUEUE_DEQUEUE call of the
+thread in the order this is called, instead of the order the calls end. FIFO
+queues with concurrent producers or consumers call it inside the critical
+section in which the item is enqueued or dequeued. */
+void VPROF_QUEUE_ITEM_IN_ORDER(void);
+
 void ON_MKNOD(const char *path, mode_t mode);
 void ON_OPEN(const char *path, int fd);
 size_t ON_READ(int fd, void *buf, size_t nbytes);
@@ -68,4 +371,103 @@ ssize_t ON_MSGRCV(int fd, void *msgp, size_t msgsz, long msgtyp, int msgflg);
 }
 #endif
 
+#else
+
+static inline void TARGET_PATH_SET(int pathCount) { (void) pathCount; }
+static inline void NUM_FUNCS_SET(int numFuncs) { (void) numFuncs; }
+static inline void SESSION_START(const char *SIID) { (void) SIID; }
+static inline void SWITCH_SI(const char *SIID) { (void) SIID; }
+static inline void SESSION_END(int successful) { (void) successful; }
+static inline int PATH_GET() { return 0; }
+static inline void PATH_INC(int expectedCount) { (void) expectedCount; }
+static inline void PATH_DEC(int expectedCount) { (void) expectedCount; }
+static inline void TRACE_FUNCTION_START(int numFuncs) { (void) numFuncs; }
+static inline void TRACE_FUNCTION_END() {}
+static inline int TRACE_START() { return 0; }
+static inline int TRACE_INDEX_START(int index) { (void) index; return 0; }
+static inline int TRACE_END(int index) { (void) index; return 0; }
+
+static inline int ACTIVE_TARGET_GET() { return -1; }
+static inline int TRACE_TARGET_FUNCTION_START(int targetID, int numFuncs) { (void) numFuncs; return targetID; }
+static inline void TRACE_TARGET_FUNCTION_END(int targetID) { (void) targetID; }
+static inline void TRACE_TARGET_FUNCTION_CLEANUP(int *targetID) { (void) targetID; }
+typedef struct VProfTargetCall { int unused; } VProfTargetCall;
+static inline int TRACE_TARGET_START(int targetID, VProfTargetCall *call) { (void) targetID; (void) call; return 0; }
+static inline int TRACE_TARGET_END(int targetID, int index, const VProfTargetCall *call) {
+    (void) targetID; (void) index; (void) call; return 0;
+}
+
+static inline void SYNCHRONIZATION_CALL_START(Operation op, void* obj) { (void) op; (void) obj; }
+static inline void SYNCHRONIZATION_CALL_END() {}
+static inline void VPROF_LABEL_OBJECT(const void *obj, const char *label) { (void) obj; (void) label; }
+static inline void VPROF_QUEUE_ITEM(unsigned long long key) { (void) key; }
+static inline void VPROF_QUEUE_ITEM_IN_ORDER(void) {}
+
+static inline void ON_MKNOD(const char *path, mode_t mode) { (void) path; (void) mode; }
+static inline void ON_OPEN(const char *path, int fd) { (void) path; (void) fd; }
+static inline size_t ON_READ(int fd, void *buf, size_t nbytes) { return read(fd, buf, nbytes); }
+static inline size_t ON_WRITE(int fd, const void *buf, size_t nbytes) { return write(fd, buf, nbytes); }
+static inline void ON_CLOSE(int fd) { (void) fd; }
+static inline void ON_PIPE(int pipefd[2]) { (void) pipefd; }
+static inline void ON_MSGGET(int msqid) { (void) msqid; }
+static inline int ON_MSGSND(int fd, const void *msgp, size_t msgsz, int msgflg) {
+    return msgsnd(fd, msgp, msgsz, msgflg);
+}
+static inline ssize_t ON_MSGRCV(int fd, void *msgp, size_t msgsz, long msgtyp, int msgflg) {
+    return msgrcv(fd, msgp, msgsz, msgtyp, msgflg);
+}
+
+#endif
+
+#define VPROF_STRINGIFY_(x) #x
+#define VPROF_STRINGIFY(x) VPROF_STRINGIFY_(x)
+#define VPROF_LABEL_OBJECT_HERE(obj) VPROF_LABEL_OBJECT((obj), __FILE__ ":" VPROF_STRINGIFY(__LINE__))
+
+#ifdef __cplusplus
+#include <utility>
+
+/* Probes of the generated C++ wrappers. The wrapped call is returned directly
+and the guard ends its trace once the result has been built in place. */
+class VProfTraceGuard {
+    public:
+        explicit VProfTraceGuard(int _index): index(_index) {
+            TRACE_INDEX_START(index);
+        }
+
+        ~VProfTraceGuard() {
+            TRACE_END(index);
+        }
+
+    private:
+        int index;
+};
+
+class VProfTargetTraceGuard {
+    public:
+        VProfTargetTraceGuard(int _targetID, int _index): targetID(_targetID), index(_index) {
+            TRACE_TARGET_START(targetID, &call);
+        }
+
+        ~VProfTargetTraceGuard() {
+            TRACE_TARGET_END(targetID, index, &call);
+        }
+
+    private:
+        int targetID;
+        int index;
+        VProfTargetCall call;
+};
+
+class VProfSynchronizationGuard {
+    public:
+        VProfSynchronizationGuard(Operation op, void *obj) {
+            SYNCHRONIZATION_CALL_START(op, obj);
+        }
+
+        ~VProfSynchronizationGuard() {
+            SYNCHRONIZATION_CALL_END();
+        }
+};
+#endif
+
 #endif
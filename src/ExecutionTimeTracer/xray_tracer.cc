@@ -0,0 +1,259 @@
+// VProf headers
+#include "trace_tool.h"
+
+#if VPROF_ENABLED
+
+// Tracer backend for binaries built with clang -fxray-instrument, to be linked
+// together with trace_tool.cc. Instead of rewriting the sources, it patches the
+// XRay sleds of the target function and of the callees listed with it only,
+// and turns their entry and exit events into the same records
+// TRACE_FUNCTION_START, TRACE_START and their ends produce. Every other
+// function keeps its sleds unpatched, which cost a few nops.
+//
+// The functions to patch are read from the file named by VPROF_XRAY_TARGET, or
+// vprof_xray_target in the working directory, written in the format of the
+// function names file: the target on the first line and its callees, in log
+// index order, after it. The file is polled, so writing a new target to it
+// repatches the running process.
+
+// C headers
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+// C++ headers
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#include <xray/xray_interface.h>
+
+using std::string;
+using std::vector;
+using std::unordered_map;
+
+// Role of a patched function, the index it is logged with.
+static const int NOT_TRACED = -2;
+static const int TARGET_FUNCTION = -1;
+
+class XRayTracer {
+    public:
+        static XRayTracer *GetInstance();
+
+        void Start();
+
+        // Patches the functions named in the target file.
+        void LoadTarget();
+
+        static void HandleEvent(int32_t funcID, XRayEntryType type);
+
+    private:
+        XRayTracer();
+
+        string targetFilename;
+        time_t lastModified;
+
+        // Function ID -> log index, read by the handler without locking, so it
+        // is only swapped while every sled is unpatched.
+        std::atomic<vector<int>*> roles;
+        // Every table roles ever pointed to. A handler may load a table and run
+        // for as long as its thread is preempted, and the target changes only a
+        // few times in a run, so tables are never freed.
+        vector<std::unique_ptr<vector<int>>> allRoles;
+        std::atomic<int> numFuncs;
+        std::mutex patchMutex;
+
+        // Bumped by every LoadTarget. A thread may be inside a function while
+        // its sleds are unpatched and miss its exit event, so each thread
+        // resets its depths the first time it sees a new generation.
+        std::atomic<unsigned int> generation;
+
+        std::thread watcherThread;
+
+        static thread_local int targetDepth;
+        static thread_local int calleeDepth;
+        static thread_local unsigned int threadGeneration;
+
+        static string functionName(int32_t funcID);
+        static string qualifiedName(const string &functionNameAndArgs);
+
+        void watchTarget();
+};
+
+thread_local int XRayTracer::targetDepth = 0;
+thread_local int XRayTracer::calleeDepth = 0;
+thread_local unsigned int XRayTracer::threadGeneration = 0;
+
+XRayTracer *XRayTracer::GetInstance() {
+    static XRayTracer instance;
+    return &instance;
+}
+
+XRayTracer::XRayTracer(): lastModified(0), roles(nullptr), numFuncs(0), generation(0) {
+    const char *filename = getenv("VPROF_XRAY_TARGET");
+    targetFilename = filename != nullptr ? filename : "vprof_xray_target";
+}
+
+// Demangled name of the function without its parameters or template
+// arguments, as getQualifiedNameAsString gives it to the function names file.
+string XRayTracer::functionName(int32_t funcID) {
+    Dl_info info;
+    if (dladdr(reinterpret_cast<void*>(__xray_function_address(funcID)), &info) == 0 ||
+        info.dli_sname == nullptr) {
+        return "";
+    }
+
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    if (status != 0 || demangled == nullptr) {
+        return info.dli_sname;
+    }
+    string name(demangled);
+    free(demangled);
+
+    // Strip the parameter list, then the template arguments.
+    for (char open : {'(', '<'}) {
+        char close = open == '(' ? ')' : '>';
+        size_t end = name.rfind(close);
+        if (end == string::npos || (open == '<' && end != name.length() - 1)) {
+            continue;
+        }
+        int depth = 0;
+        for (size_t i = end + 1; i-- > 0;) {
+            if (name[i] == close) {
+                depth++;
+            } else if (name[i] == open && --depth == 0) {
+                name = name.substr(0, i);
+                break;
+            }
+        }
+    }
+    return name;
+}
+
+string XRayTracer::qualifiedName(const string &functionNameAndArgs) {
+    string name = functionNameAndArgs.substr(0, functionNameAndArgs.find('|'));
+    size_t indexStart = name.rfind('-');
+    return indexStart == string::npos ? name : name.substr(0, indexStart);
+}
+
+void XRayTracer::LoadTarget() {
+    std::lock_guard<std::mutex> lock(patchMutex);
+
+    std::ifstream targetFile(targetFilename);
+    unordered_map<string, int> indices;
+    string line;
+    int index = TARGET_FUNCTION;
+    while (getline(targetFile, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        string name = qualifiedName(line);
+        if (indices.find(name) == indices.end()) {
+            indices[name] = index;
+        }
+        index = index == TARGET_FUNCTION ? 1 : index + 1;
+    }
+
+    __xray_unpatch();
+
+    vector<int> *newRoles = new vector<int>(__xray_max_function_id() + 1, NOT_TRACED);
+    for (size_t funcID = 1; funcID < newRoles->size(); funcID++) {
+        auto it = indices.find(functionName(funcID));
+        if (it != indices.end()) {
+            (*newRoles)[funcID] = it->second;
+        }
+    }
+
+    allRoles.emplace_back(newRoles);
+    generation.fetch_add(1, std::memory_order_relaxed);
+    roles.store(newRoles, std::memory_order_release);
+    numFuncs = index == TARGET_FUNCTION ? 1 : index;
+
+    for (size_t funcID = 1; funcID < newRoles->size(); funcID++) {
+        if ((*newRoles)[funcID] != NOT_TRACED) {
+            __xray_patch_function(funcID);
+        }
+    }
+}
+
+void XRayTracer::HandleEvent(int32_t funcID, XRayEntryType type) {
+    XRayTracer *tracer = GetInstance();
+    vector<int> *currentRoles = tracer->roles.load(std::memory_order_acquire);
+    if (currentRoles == nullptr || funcID < 0 || static_cast<size_t>(funcID) >= currentRoles->size()) {
+        return;
+    }
+
+    unsigned int currentGeneration = tracer->generation.load(std::memory_order_relaxed);
+    if (threadGeneration != currentGeneration) {
+        threadGeneration = currentGeneration;
+        targetDepth = 0;
+        calleeDepth = 0;
+    }
+
+    int role = (*currentRoles)[funcID];
+    bool isEntry = type == XRayEntryType::ENTRY || type == XRayEntryType::LOG_ARGS_ENTRY;
+
+    if (role == TARGET_FUNCTION) {
+        // Only the outermost call of a recursive target is traced.
+        if (isEntry) {
+            if (targetDepth++ == 0) {
+                TRACE_FUNCTION_START(tracer->numFuncs);
+            }
+        } else if (targetDepth > 0 && --targetDepth == 0) {
+            TRACE_FUNCTION_END();
+        }
+    } else if (role != NOT_TRACED && targetDepth == 1) {
+        // Callees called from within another callee, or from a recursive call
+        // of the target, are left out. Those reached from the traced call
+        // through functions which are not patched are not told apart from
+        // its direct callees, and are traced too. The target depth is the
+        // same at the entry and at the exit of a callee.
+        if (isEntry) {
+            if (calleeDepth++ == 0) {
+                TRACE_START();
+            }
+        } else if (calleeDepth > 0 && --calleeDepth == 0) {
+            TRACE_END(role);
+        }
+    }
+}
+
+void XRayTracer::watchTarget() {
+    while (true) {
+        struct stat targetStat;
+        if (stat(targetFilename.c_str(), &targetStat) == 0 &&
+            targetStat.st_mtime != lastModified) {
+            lastModified = targetStat.st_mtime;
+            LoadTarget();
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}
+
+void XRayTracer::Start() {
+    __xray_set_handler(HandleEvent);
+    struct stat targetStat;
+    if (stat(targetFilename.c_str(), &targetStat) == 0) {
+        lastModified = targetStat.st_mtime;
+    }
+    LoadTarget();
+
+    watcherThread = std::thread(&XRayTracer::watchTarget, this);
+    watcherThread.detach();
+}
+
+__attribute__((constructor)) static void startXRayTracer() {
+    XRayTracer::GetInstance()->Start();
+}
+
+#endif
@@ -0,0 +1,86 @@
+#! /usr/bin/env python
+# coding=utf-8
+
+import multiprocessing
+import numpy as np
+
+# Factors x semantic intervals matrix being resampled. It is set before the
+# worker pool is created so that forked workers share it copy-on-write instead
+# of having it pickled to each of them.
+_samples = None
+# Probability of drawing each semantic interval, None for uniform.
+_drawProbabilities = None
+
+
+def covarianceMatrix(samples, weights=None):
+    """ Population covariance matrix of the rows of samples, weighting the
+        semantic intervals if weights is given """
+    return np.cov(samples, bias=True, aweights=weights)
+
+
+def contributionMatrix(covMatrix):
+    """ Contribution of every factor and factor pair to the variance of row 0.
+        Diagonal entries are variances, off-diagonal entries are 2 * covariance,
+        so that summing the lower triangle gives back the latency variance """
+    contributions = 2 * covMatrix
+    np.fill_diagonal(contributions, np.diag(covMatrix))
+    return contributions
+
+
+def _resampleWorker(job):
+    numResamples, seed = job
+    randomState = np.random.RandomState(seed)
+    numIntervals = _samples.shape[1]
+    resamples = np.empty((numResamples, _samples.shape[0], _samples.shape[0]))
+    for resample in range(numResamples):
+        if _drawProbabilities is None:
+            indices = randomState.randint(0, numIntervals, numIntervals)
+        else:
+            indices = randomState.choice(numIntervals, numIntervals, p=_drawProbabilities)
+        resamples[resample] = covarianceMatrix(np.take(_samples, indices, axis=1))
+    return resamples
+
+
+def resampleCovariances(funcExecTime, numResamples, numProcesses=None, seed=0, weights=None):
+    """ Resample semantic intervals with replacement numResamples times and
+        return the covariance matrix of every resample, stacked along axis 0.
+        Weighted intervals are drawn in proportion to their weights.
+        Resamples are split across numProcesses worker processes (one per core
+        by default) """
+    global _samples, _drawProbabilities
+    _samples = np.asarray(funcExecTime, dtype=float)
+    _drawProbabilities = None
+    if weights is not None:
+        _drawProbabilities = np.asarray(weights, dtype=float) / np.sum(weights)
+
+    if numProcesses is None:
+        numProcesses = multiprocessing.cpu_count()
+    numProcesses = max(1, min(numProcesses, numResamples))
+
+    jobs = []
+    for worker in range(numProcesses):
+        count = numResamples // numProcesses
+        if worker < numResamples % numProcesses:
+            count += 1
+        jobs.append((count, seed + worker))
+
+    if numProcesses == 1:
+        results = [_resampleWorker(jobs[0])]
+    else:
+        pool = multiprocessing.Pool(numProcesses)
+        try:
+            results = pool.map(_resampleWorker, jobs)
+        finally:
+            pool.close()
+            pool.join()
+
+    _samples = None
+    _drawProbabilities = None
+    return np.concatenate(results)
+
+
+def confidenceInterval(estimates, confidence=0.95):
+    """ Percentile confidence interval over axis 0 of estimates """
+    tail = 100 * (1 - confidence) / 2
+    return np.percentile(estimates, tail, axis=0), \
+           np.percentile(estimates, 100 - tail, axis=0)
@@ -0,0 +1,50 @@
+#! /usr/bin/env python
+# coding=utf-8
+
+import csv
+import os
+import numpy as np
+
+from TraceFormat import ParseFunctionLogRow
+from VarBreaker import weightedPercentile
+
+
+def readExperiments(dataDir):
+    """ Latency in virtual time and weight of every semantic interval which
+        ran within one virtual speedup experiment, grouped by the speedup of
+        the experiment """
+    experiments = {}
+    for filename in os.listdir(dataDir):
+        if 'FunctionLog' not in filename:
+            continue
+        with open(os.path.join(dataDir, filename), 'rb') as logFile:
+            for row in csv.reader(logFile):
+                record = ParseFunctionLogRow(row)
+                if record is None or record.index != 0 or 'speedup' not in record.extras:
+                    continue
+                latency = record.endTime - record.startTime - record.GetExtra('vdelay')
+                experiments.setdefault(record.GetExtra('speedup'), []).append(
+                    (latency, record.GetExtra('weight', 1)))
+    return experiments
+
+
+def speedupCurve(dataDir, quantile=0.99):
+    """ Return (speedup, intervals, mean, quantile latency, mean impact,
+        quantile impact) tuples by increasing speedup of the sped up
+        function, where the impacts are the percentages by which the mean
+        and the quantile latency drop from the experiments without speedup,
+        None if there were none """
+    curve = []
+    for speedup, intervals in sorted(readExperiments(dataDir).items()):
+        latencies = np.array([latency for latency, _ in intervals], dtype=float)
+        weights = np.array([weight for _, weight in intervals], dtype=float)
+        curve.append([speedup, len(intervals), np.average(latencies, weights=weights),
+                      weightedPercentile(latencies, weights, 100 * quantile), None, None])
+
+    baselines = [point for point in curve if point[0] == 0]
+    if len(baselines) > 0:
+        baseMean, baseQuantile = baselines[0][2], baselines[0][3]
+        for point in curve:
+            point[4] = 100 * (baseMean - point[2]) / baseMean if baseMean > 0 else None
+            point[5] = 100 * (baseQuantile - point[3]) / baseQuantile if baseQuantile > 0 else None
+    return [tuple(point) for point in curve]
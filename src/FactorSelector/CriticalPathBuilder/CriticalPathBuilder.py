@@ -4,6 +4,7 @@ from collections import deque
 from intervaltree import IntervalTree
 from RequestTracker import RequestTracker
 from SynchronizationObjectAggregator import SynchronizationObjectAggregator
+from SynchronizationObject import QueueObject
 from progressbar import ProgressBar
 
 # TODO need to add support for try_locks
@@ -14,6 +15,8 @@ class CriticalPathBuilder:
         self.synchObjAgg = SynchronizationObjectAggregator()
         self.requestTracker = RequestTracker()
         self.blockedEdgeStack = deque()
+        # objID -> label given to the object with VPROF_LABEL_OBJECT
+        self.labels = {}
 
         pathPrefix += '/' if pathPrefix[-1] != '/' else ''
 
@@ -31,7 +34,9 @@ class CriticalPathBuilder:
                 for i, log in enumerate(synchroLogReader):
                     if log[0] == '0':
                         self.requestTracker.AddOperation(log[1:])
-                    else:
+                    elif log[0] == 'L':
+                        self.labels[log[1]] = log[2]
+                    elif log[0] == '1':
                         self.requestTracker.AddFunctionTime(log[1:])
 
                         threadID = log[1]
@@ -96,6 +101,12 @@ class CriticalPathBuilder:
         return self.__BuildHelper(leftTimeBound, nextThreadID, timeSeries)
 
 
+    # (label, QueueObject) of every queue items went through, the label being
+    # the objID of the queue unless it was given one.
+    def GetQueues(self):
+        return [(self.labels.get(objID, objID), obj) for objID, obj in self.synchObjAgg.objectMap.items()
+                if isinstance(obj, QueueObject) and (obj.items or obj.pendingEnqueues or obj.eventQueue)]
+
     # Returns a list of tuples, (threadID, startTime, endTime) where each tuple
     # represents a single segment of the critical path.  Note that if a tuple
     # represents an event creation wait-for relationship (the time between when
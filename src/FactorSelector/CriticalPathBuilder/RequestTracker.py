@@ -1,7 +1,13 @@
+import os
+import sys
 from nanotime import nanotime
 from bisect import bisect_left
 from OperationEnum import Operation
 
+# TraceFormat is in the FactorSelector directory, above this one.
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+from TraceFormat import ParseExtras
+
 class Request:
     def __init__(self, objID, opID, timeStart = None, timeEnd = None):
         self.objID = objID
@@ -10,9 +16,16 @@ class Request:
         self.timeStart = timeStart
         self.timeEnd = timeEnd
 
-    def AddFunctionTimes(self, timeStart, timeEnd):
+        self.semIntervalID = None
+        # Sequence number of the item of a queue operation, None for other
+        # operations and in logs from before the runtime numbered items.
+        self.seq = None
+
+    def AddFunctionTimes(self, timeStart, timeEnd, semIntervalID = None, seq = None):
         self.timeStart = timeStart
         self.timeEnd = timeEnd
+        self.semIntervalID = semIntervalID
+        self.seq = seq
 
 # Building of a ThreadRequests works as follows.
 # 1) Iterate through operation log.  Add each row in the OperationLog file as a
@@ -36,9 +49,9 @@ class ThreadRequests:
 
         return self.keys
 
-    def AddFunctionTime(self, funcStart, funcEnd):
+    def AddFunctionTime(self, funcStart, funcEnd, semIntervalID = None, seq = None):
         if self.timeTrackIdx < len(self.requests): # and \
-            self.requests[self.timeTrackIdx].AddFunctionTimes(funcStart, funcEnd)
+            self.requests[self.timeTrackIdx].AddFunctionTimes(funcStart, funcEnd, semIntervalID, seq)
 
             self.timeTrackIdx += 1
 
@@ -65,13 +78,18 @@ class RequestTracker:
     def AddFunctionTime(self, funcTime):
         threadID = funcTime[0]
 
-        # Index 1 is the semantic interval ID.  Don't actually think this is
-        # necessary for RequestTracker.
+        # Index 1 is the semantic interval ID, which queues attribute the
+        # time their items wait to.
 
         startTime = nanotime(int(funcTime[2]))
         endTime = nanotime(int(funcTime[3]))
 
-        self.threadRequests[threadID].AddFunctionTime(startTime, endTime)
+        # Optional key=value pairs, such as seq=N for queue operations.
+        seq = None
+        if len(funcTime) > 4:
+            seq = ParseExtras(funcTime[4]).get('seq')
+
+        self.threadRequests[threadID].AddFunctionTime(startTime, endTime, funcTime[1], seq)
 
     def InitSynchObjAgg(self, objAggregator):
         for threadID, threadRequests in self.threadRequests.items():
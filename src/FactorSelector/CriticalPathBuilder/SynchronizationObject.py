@@ -1,4 +1,5 @@
 from abc import ABCMeta, abstractmethod
+from collections import deque
 from OperationEnum import Operation
 
 # Abstract base class for synchronization objects
@@ -62,27 +63,67 @@ class OwnableObject(SynchronizationObject):
             return self.ownershipTimeSeries[resultIdx].endTime, \
                    self.ownershipTimeSeries[resultIdx].threadID
 
-# Maybe have something where it's a map from event -> event that created it.
-# While parsing, maintain queue modeling the actual queue in user's code.
-# When we have an operation which pops from the queue, create an entry in the
-# event -> event creator map.  Then, for GetDependenceEdge, just return the
-# event stored at dependenceEdges[recipientEvent] where recipientEvent is the
-# event whose creator we are trying to find.
+# Pairs every dequeue with the enqueue of the item it took, by the sequence
+# number the runtime gave the item, so that queues which are not FIFO are
+# matched right, and keeps both to rebuild the depth of the queue over time
+# and the time each item spent in it.  The records of different threads are
+# not in time order in the logs, so a dequeue may come before the enqueue of
+# its item.  Operations without sequence numbers, from older logs, are
+# matched in FIFO order.  Without keepItems, matched operations are only
+# returned by AddOperation, so that the memory used stays that of the items
+# still in the queue.
 class QueueObject(SynchronizationObject):
-    def __init__(self):
-        # Map from eventID to the threadID of the thread which created event eventID
+    def __init__(self, keepItems=True):
+        self.keepItems = keepItems
+
+        # Map from a dequeue operation to the enqueue operation of its item
         self.eventCreationRelationships = {}
-        self.eventQueue = []
+        # Enqueues without sequence numbers, oldest first
+        self.eventQueue = deque()
 
-    def AddOperation(self, operation):
-        if operation.opID == Operation.MESSAGE_SEND or \
-           operation.opID == Operation.QUEUE_ENQUEUE:
-            self.eventQueue.append(operation)
+        # Sequence number -> enqueue whose item was not dequeued yet, or
+        # dequeue whose enqueue was not seen yet
+        self.pendingEnqueues = {}
+        self.pendingDequeues = {}
+
+        # (enqueue, dequeue) of every item taken out of the queue
+        self.items = []
 
-        # If the operation is MESSAGE_RECEIVE or QUEUE_DEQUEUE
+        # Dequeues without sequence numbers which found the queue empty
+        self.unmatchedDequeues = 0
+
+    # Returns (enqueue, dequeue) if the operation completes an item, None
+    # otherwise.
+    def AddOperation(self, operation):
+        isEnqueue = operation.opID == Operation.MESSAGE_SEND or \
+                    operation.opID == Operation.QUEUE_ENQUEUE
+
+        if operation.seq is None:
+            if isEnqueue:
+                self.eventQueue.append(operation)
+            elif len(self.eventQueue) > 0:
+                return self.__Match(self.eventQueue.popleft(), operation)
+            else:
+                self.unmatchedDequeues += 1
+        elif isEnqueue:
+            dequeue = self.pendingDequeues.pop(operation.seq, None)
+            if dequeue is None:
+                self.pendingEnqueues[operation.seq] = operation
+            else:
+                return self.__Match(operation, dequeue)
         else:
-            creatingEvent = self.eventQueue.pop(0)
-            self.eventCreationRelationships[operation] = creatingEvent
+            enqueue = self.pendingEnqueues.pop(operation.seq, None)
+            if enqueue is None:
+                self.pendingDequeues[operation.seq] = operation
+            else:
+                return self.__Match(enqueue, operation)
+        return None
+
+    def __Match(self, enqueue, dequeue):
+        if self.keepItems:
+            self.eventCreationRelationships[dequeue] = enqueue
+            self.items.append((enqueue, dequeue))
+        return enqueue, dequeue
 
     # Returns the threadID of the thread which created event eventID.  Returns None
     # if no event with eventID was found.
@@ -93,3 +134,35 @@ class QueueObject(SynchronizationObject):
             return None, None
 
         return result.endTime, result.threadID
+
+    # (semantic interval of the enqueuer, nanoseconds from the end of the
+    # enqueue to the end of the dequeue) of every item taken out of the queue.
+    # Items dequeued before they were enqueued were paired wrongly, as happens
+    # when concurrent enqueues or dequeues are numbered in the order they end,
+    # and are left out.
+    def GetSojournTimes(self):
+        return [(enqueue.semIntervalID, int(dequeue.timeEnd) - int(enqueue.timeEnd))
+                for enqueue, dequeue in self.items if int(dequeue.timeEnd) >= int(enqueue.timeEnd)]
+
+    # Number of dequeues which were paired wrongly or not paired with any
+    # enqueue, once every operation was added.
+    def GetMismatches(self):
+        return sum(1 for enqueue, dequeue in self.items if int(dequeue.timeEnd) < int(enqueue.timeEnd)) + \
+               len(self.pendingDequeues) + self.unmatchedDequeues
+
+    # (time, number of items in the queue from then on) at every enqueue and
+    # dequeue, by time.  Items never dequeued stay in the queue.
+    def GetDepthSeries(self):
+        changes = [(int(enqueue.timeEnd), 1) for enqueue, _ in self.items] + \
+                  [(int(dequeue.timeEnd), -1) for _, dequeue in self.items] + \
+                  [(int(enqueue.timeEnd), 1) for enqueue in self.pendingEnqueues.values()] + \
+                  [(int(enqueue.timeEnd), 1) for enqueue in self.eventQueue]
+        # Enqueues first at equal times, so that the depth never drops below 0.
+        changes.sort(key=lambda change: (change[0], -change[1]))
+
+        series = []
+        depth = 0
+        for time, change in changes:
+            depth += change
+            series.append((time, depth))
+        return series
@@ -0,0 +1,58 @@
+#! /bin/sh
+
+# Breaks down a parent with many cheap callees, each with probes of its own,
+# whose calibrated probe pair costs more than the gap it leaves between them,
+# and checks that the parent is left with no negative self time and that its
+# callees do not add up to more than it.
+
+set -e
+
+work=$(mktemp -d)
+mkdir "$work/latency"
+callees=50
+
+{
+    echo Parent
+    i=1
+    while [ $i -le $callees ]; do
+        echo "Callee$i"
+        i=$((i + 1))
+    done
+} > "$work/functionNames"
+
+# Every 1600 ns, a gap of 60 ns then a callee whose 5 probe pairs took 500 ns.
+{
+    echo "C,1,realtime,0,100,0"
+    echo "0,1,1,0,82000,probes=301;sync=0"
+    echo "$((callees + 2)),1,1,1000,81000,probes=$((callees * 6));sync=0"
+    i=1
+    while [ $i -le $callees ]; do
+        start=$((1000 + (i - 1) * 1600 + 60))
+        echo "$i,1,1,$start,$((start + 1540)),probes=5;sync=0"
+        i=$((i + 1))
+    done
+} > "$work/latency/FunctionLog_1"
+
+cd "$(dirname "$0")/.."
+if python - "$work" "$callees" <<'PYTHON'
+import sys
+import VarBreaker
+import VarTree
+
+work, callees = sys.argv[1], int(sys.argv[2])
+funcExecTime = VarBreaker.collectExecTime(work + '/functionNames', work + '/latency')[1]
+parent = funcExecTime[-1][0]
+calleeTotal = sum(funcExecTime[i][0] for i in range(1, callees + 1))
+
+node = VarTree.VarNode('Parent', None, 0, 100)
+parentSelf = VarBreaker.collectBreakdownData(work + '/functionNames', work + '/latency', node)[2][-1][0]
+print 'parent ' + str(parent) + ' ns, callees ' + str(calleeTotal) + ' ns, parent self ' + str(parentSelf) + ' ns'
+sys.exit(0 if calleeTotal == callees * 1040 and parent >= calleeTotal and parentSelf >= 0 else 1)
+PYTHON
+then
+    echo "PASS"
+    rm -rf "$work"
+else
+    echo "FAIL, see $work"
+    exit 1
+fi
@@ -1,18 +1,35 @@
 import csv
 import sys
+from bisect import bisect_left
 from nanotime import nanotime
 from intervaltree import IntervalTree
 from os import listdir
 from NonTargetCriticalPathBreaker import NonTargetCriticalPathBreak
+from TraceFormat import ParseFunctionLogRow, ParseDisabledProbeRow, ParseOverflowRow, ProbeCalibration, \
+                        OS_COUNTERS
 
 sys.path.append('CriticalPathBuilder/')
 from CriticalPathBuilder import CriticalPathBuilder
 
 class FunctionRecord:
-    def __init__(self, startTime, endTime, threadID):
+    def __init__(self, startTime, endTime, threadID, overhead=0, weight=1, cpuTime=None,
+                 osCounters=None, perfCounts=None, allocTime=0):
         self.startTime = startTime
         self.endTime = endTime
         self.threadID = threadID
+        # Nanoseconds of the record spent in the probes nested in it.
+        self.overhead = overhead
+        # Weight of the semantic interval, for its record only.
+        self.weight = weight
+        # Nanoseconds on CPU, None if not sampled.
+        self.cpuTime = cpuTime
+        # OS counter key -> change over the semantic interval, for its record
+        # only.
+        self.osCounters = osCounters if osCounters is not None else {}
+        # Perf event name -> count during the instance.
+        self.perfCounts = perfCounts if perfCounts is not None else {}
+        # Nanoseconds spent in the allocator.
+        self.allocTime = allocTime
 
 class LatencyAggregator:
     def __init__(self, pathPrefix):
@@ -22,6 +39,39 @@ class LatencyAggregator:
         # FunctionID -> list of (SemanticIntervalID -> FunctionLatency)
         self.functionLatencies = []
 
+        # Part of each latency spent on CPU, in the same layout.
+        self.functionCpuTimes = []
+
+        # Part of each latency spent in the allocator, in the same layout.
+        self.functionAllocTimes = []
+
+        # Perf event name -> counts of the event, in the same layout.
+        self.perfEvents = set()
+        self.functionPerfCounts = {}
+
+        # Whether the CPU time of every function was sampled, per semantic
+        # interval.
+        self.intervalCpuSampled = []
+
+        # Start time of each semantic interval, in the same order as the
+        # second dimension of functionLatencies.
+        self.intervalStartTimes = []
+
+        # Weight of each semantic interval, in the same order.  All 1 unless
+        # the run only kept some of them.
+        self.intervalWeights = []
+
+        # OS counter key -> change of the counter over each semantic interval,
+        # in the same order, None where it was not read.
+        self.intervalOsCounters = dict((key, []) for key, _ in OS_COUNTERS)
+
+        # Queue label -> nanoseconds the items enqueued by each semantic
+        # interval waited in the queue, in the same order.
+        self.intervalQueueWaits = {}
+
+        # Queue label -> semantic interval ID -> nanoseconds its items waited
+        self.queueWaits = {}
+
         # Map from semantic interval ID to SemanticInterval object
         self.semanticIntervals = {}
 
@@ -30,6 +80,9 @@ class LatencyAggregator:
         # semantic interval.
         self.semanticIntervalFunctionInstances = {}
 
+        # Function indices whose probes the runtime disabled during the run.
+        self.disabledFunctions = set()
+
         # Driver for building critical paths
         self.criticalPathBuilder = CriticalPathBuilder.CriticalPathBuilder(pathPrefix, "SynchronizationLog_")
 
@@ -37,27 +90,45 @@ class LatencyAggregator:
         pathPrefix += '/' if pathPrefix[-1] != '/' else ''
         functionLogFiles = [pathPrefix + f for f in listdir(pathPrefix) if 'FunctionLog' in f]
 
+        # Calibration lines may come after the records they apply to, so they
+        # are read in a first pass which skips the records, instead of keeping
+        # every record until the end.
+        calibration = ProbeCalibration()
+        overflowedIntervals = set()
         for filename in functionLogFiles:
             with open(filename, 'rb') as latencyLogFile:
-                latencyReader = csv.reader(latencyLogFile)
+                for row in csv.reader(latencyLogFile):
+                    if len(row) == 0 or row[0].isdigit() or calibration.AddRow(row):
+                        continue
+                    disabledIndex = ParseDisabledProbeRow(row)
+                    if disabledIndex is not None:
+                        self.disabledFunctions.add(disabledIndex)
+                        continue
+                    overflowedInterval = ParseOverflowRow(row)
+                    if overflowedInterval is not None:
+                        overflowedIntervals.add(overflowedInterval)
 
-                for row in latencyReader:
-                    if len(row) == 5:
-                        functionIndex = int(row[0])
-                        threadID = row[1]
-                        semIntervalID = row[2]
-                        startTime = nanotime(int(row[3]))
-                        endTime = nanotime(int(row[4]))
-
-                        if semIntervalID not in self.semanticIntervals:
-                            self.semanticIntervals[semIntervalID] = \
-                                [[] for x in range(numFunctions)]
-
-                        (
-                            self
-                            .semanticIntervals[semIntervalID][functionIndex]
-                            .append(FunctionRecord(startTime, endTime, threadID))
-                        )
+        for filename in functionLogFiles:
+            with open(filename, 'rb') as latencyLogFile:
+                for row in csv.reader(latencyLogFile):
+                    record = ParseFunctionLogRow(row)
+                    if record is None or record.semIntervalID in overflowedIntervals:
+                        continue
+                    if record.semIntervalID not in self.semanticIntervals:
+                        self.semanticIntervals[record.semIntervalID] = \
+                            [[] for x in range(numFunctions)]
+
+                    (
+                        self
+                        .semanticIntervals[record.semIntervalID][record.index]
+                        .append(FunctionRecord(nanotime(record.startTime), nanotime(record.endTime),
+                                               record.entity, calibration.GetOverhead(record),
+                                               record.GetExtra('weight', 1), record.GetExtra('cpu', None),
+                                               dict((key, record.extras[key]) for key, _ in OS_COUNTERS
+                                                    if key in record.extras),
+                                               record.GetPerfCounts(), record.GetExtra('allocns')))
+                    )
+                    self.perfEvents.update(record.GetPerfCounts().keys())
 
     def __GetCriticalPaths(self, pathPrefix):
         criticalPaths = {}
@@ -69,29 +140,94 @@ class LatencyAggregator:
                 latencyReader = csv.reader(latencyLogFile)
 
                 for row in latencyReader:
-                    if len(row) == 5:
-                        functionIndex = int(row[0])
+                    record = ParseFunctionLogRow(row)
+                    if record is not None:
                         # Done with all semantic interval latencies
-                        if functionIndex > 0:
+                        if record.index > 0:
                             break
 
-                        threadID = row[1]
-                        semIntervalID = row[2]
-                        startTime = nanotime(int(row[3]))
-                        endTime = nanotime(int(row[4]))
-                        criticalPath = self.criticalPathBuilder.Build(startTime, endTime, threadID)
-                        criticalPaths[semIntervalID] = criticalPath
+                        startTime = nanotime(record.startTime)
+                        endTime = nanotime(record.endTime)
+                        criticalPath = self.criticalPathBuilder.Build(startTime, endTime, record.entity)
+                        criticalPaths[record.semIntervalID] = criticalPath
         return criticalPaths
 
+    # Maps each function instance of a semantic interval to the outermost
+    # instances of other functions nested in it on its thread, by start.
+    def __NestedInstances(self, functionInstances):
+        threadInstances = {}
+        for functionID in range(1, len(functionInstances)):
+            for instance in functionInstances[functionID]:
+                threadInstances.setdefault(instance.threadID, []).append(
+                    (int(instance.startTime), -int(instance.endTime), functionID, instance))
+        threadStarts = {}
+        for threadID, instances in threadInstances.items():
+            instances.sort(key=lambda entry: entry[:3])
+            threadStarts[threadID] = [entry[0] for entry in instances]
+
+        nestedInstances = {}
+        for functionID in range(len(functionInstances)):
+            for instance in functionInstances[functionID]:
+                if instance in nestedInstances:
+                    continue
+                nested = []
+                instances = threadInstances.get(instance.threadID, [])
+                starts = threadStarts.get(instance.threadID, [])
+                end = int(instance.endTime)
+                nestedEnd = None
+                for start, negativeEnd, otherID, other in \
+                        instances[bisect_left(starts, int(instance.startTime)):bisect_left(starts, end)]:
+                    if other is instance or otherID == functionID or -negativeEnd > end or \
+                       (nestedEnd is not None and start < nestedEnd):
+                        continue
+                    nested.append(other)
+                    nestedEnd = -negativeEnd
+                nestedInstances[instance] = nested
+        return nestedInstances
+
+    # Probe cost to remove from the part of the instance between start and
+    # end.  The probes nested in the instances nested in it are removed in
+    # the same proportion as from them, so that a parent less its children
+    # does not lose their cost twice.  The rest, mostly the probes of those
+    # instances, is assumed spread evenly over the time outside of them, and
+    # bounded by it since part of each probe falls inside the instance it
+    # times.
+    def __OverheadBetween(self, instance, nested, start, end):
+        overlap = lambda first, last: max(0, min(end, last) - max(start, first))
+        ownOverhead = instance.overhead
+        ownDuration = int(instance.endTime - instance.startTime)
+        ownLatency = end - start
+        overhead = 0
+        for other in nested:
+            otherDuration = int(other.endTime - other.startTime)
+            otherLatency = overlap(int(other.startTime), int(other.endTime))
+            ownOverhead -= other.overhead
+            ownDuration -= otherDuration
+            ownLatency -= otherLatency
+            if otherDuration > 0:
+                overhead += other.overhead * otherLatency / otherDuration
+        if ownOverhead > 0 and ownDuration > 0:
+            overhead += min(ownOverhead, ownDuration) * ownLatency / ownDuration
+        return overhead
+
     def __AggregateForSemanticInterval(self, semanticIntervalID, functionInstances):
         if len(functionInstances[0]) == 0:
             functionInstances[0] = list(functionInstances[-1])
         semIntervalInfo = functionInstances[0][0]
+        self.intervalStartTimes.append(int(semIntervalInfo.startTime))
+        self.intervalWeights.append(semIntervalInfo.weight)
+        for key, counters in self.intervalOsCounters.items():
+            counters.append(semIntervalInfo.osCounters.get(key))
+        for label, waits in self.intervalQueueWaits.items():
+            waits.append(self.queueWaits[label].get(semanticIntervalID, 0))
         criticalPath = self.criticalPathBuilder.Build(semIntervalInfo.startTime, \
                                                       semIntervalInfo.endTime,   \
                                                       semIntervalInfo.threadID)
 
+        nestedInstances = self.__NestedInstances(functionInstances)
+
         timeSeriesTuples = []
+        cpuSampled = True
 
         # I think in this for loop we should make a time series for the semantic interval.  Then
         # after this loop is done w/ execution, go through each interval and add the value of
@@ -109,30 +245,117 @@ class LatencyAggregator:
 
                     timeSeriesTuples.append((execIntervalStartTime, execIntervalEndTime))
 
-                    latency = execIntervalEndTime - execIntervalStartTime
+                    latency = int(execIntervalEndTime - execIntervalStartTime)
+                    duration = int(functionInstance.endTime - functionInstance.startTime)
+                    if functionInstance.overhead > 0 and duration > 0:
+                        overhead = self.__OverheadBetween(functionInstance, nestedInstances[functionInstance],
+                                                          int(execIntervalStartTime), int(execIntervalEndTime))
+                        latency = max(0, latency - overhead)
+
+                    # Prorated the same way, the latency bounding it.
+                    cpuTime = 0
+                    if functionInstance.cpuTime is None:
+                        cpuSampled = cpuSampled and functionID == 0
+                    elif duration > 0:
+                        cpuTime = min(latency, functionInstance.cpuTime * latency / duration)
+                    allocTime = 0
+                    if duration > 0:
+                        allocTime = min(latency, functionInstance.allocTime * latency / duration)
+
+                    perfCounts = {}
+                    for event in self.perfEvents:
+                        count = functionInstance.perfCounts.get(event, 0)
+                        perfCounts[event] = count * latency / duration if duration > 0 else 0
 
                     if not haveAppended:
                         self.functionLatencies[functionID].append(latency)
+                        self.functionCpuTimes[functionID].append(cpuTime)
+                        self.functionAllocTimes[functionID].append(allocTime)
+                        for event, count in perfCounts.items():
+                            self.functionPerfCounts[event][functionID].append(count)
                         haveAppended = True
                     # What was this supposed to do?
                     else:
                         # I think this is wrong! Shouldn't it be:
                         # self.functionLatencies[len(self.functionLatencies) - 1][-1] += latency
                         self.functionLatencies[functionID][-1] += latency
+                        self.functionCpuTimes[functionID][-1] += cpuTime
+                        self.functionAllocTimes[functionID][-1] += allocTime
+                        for event, count in perfCounts.items():
+                            self.functionPerfCounts[event][functionID][-1] += count
             if len(self.functionLatencies[functionID]) < len(self.functionLatencies[0]):
                 self.functionLatencies[functionID].append(0)
+                self.functionCpuTimes[functionID].append(0)
+                self.functionAllocTimes[functionID].append(0)
+                for counts in self.functionPerfCounts.values():
+                    counts[functionID].append(0)
+        self.intervalCpuSampled.append(cpuSampled)
 
         # semIntTimeSeries = IntervalTree.from_tuples(timeSeriesTuples)
 
     def GetLatencies(self, pathPrefix, numFunctions):
         self.__Parse(pathPrefix, numFunctions)
         self.functionLatencies = [[] for _ in range(numFunctions)]
+        self.functionCpuTimes = [[] for _ in range(numFunctions)]
+        self.functionAllocTimes = [[] for _ in range(numFunctions)]
+        self.functionPerfCounts = dict((event, [[] for _ in range(numFunctions)])
+                                       for event in self.perfEvents)
+
+        # Items are matched to their semantic interval when they are enqueued.
+        for label, queue in self.criticalPathBuilder.GetQueues():
+            waits = self.queueWaits.setdefault(label, {})
+            for semanticIntervalID, sojourn in queue.GetSojournTimes():
+                waits[semanticIntervalID] = waits.get(semanticIntervalID, 0) + sojourn
+        self.intervalQueueWaits = dict((label, []) for label in self.queueWaits)
 
         for semanticIntervalID, functionInstances in self.semanticIntervals.items():
             self.__AggregateForSemanticInterval(semanticIntervalID, functionInstances)
 
         return [[int(latency) for latency in latencies] for latencies in self.functionLatencies]
 
+    # Only valid after GetLatencies has been called.
+    def GetIntervalStartTimes(self):
+        return self.intervalStartTimes
+
+    # Only valid after GetLatencies has been called.
+    def GetCpuTimes(self):
+        return [[int(cpuTime) for cpuTime in cpuTimes] for cpuTimes in self.functionCpuTimes]
+
+    # Only valid after GetLatencies has been called.  All 0 unless the run
+    # interposed the allocator.
+    def GetAllocTimes(self):
+        return [[int(allocTime) for allocTime in allocTimes] for allocTimes in self.functionAllocTimes]
+
+    # Only valid after GetLatencies has been called.  Maps each perf event
+    # counted during the run to its counts, in the layout of the latencies.
+    def GetPerfCounts(self):
+        return dict((event, [[int(count) for count in row] for row in counts])
+                    for event, counts in self.functionPerfCounts.items())
+
+    # Only valid after GetLatencies has been called.
+    def GetIntervalCpuSampled(self):
+        return self.intervalCpuSampled
+
+    # Only valid after GetLatencies has been called.
+    def GetIntervalWeights(self):
+        return self.intervalWeights
+
+    # Only valid after GetLatencies has been called.
+    def GetIntervalOsCounters(self):
+        return self.intervalOsCounters
+
+    # Only valid after GetLatencies has been called.
+    def GetIntervalQueueWaits(self):
+        return self.intervalQueueWaits
+
+    # (label, QueueObject) of every traced queue.
+    def GetQueues(self):
+        return self.criticalPathBuilder.GetQueues()
+
+    # Only valid after GetLatencies has been called.
+    def GetDisabledFunctions(self):
+        return self.disabledFunctions
+
     def GetLatenciesNonTarget(self, pathPrefix, funcNamesFile):
         criticalPaths = self.__GetCriticalPaths(pathPrefix)
         return NonTargetCriticalPathBreak(criticalPaths, pathPrefix, funcNamesFile)
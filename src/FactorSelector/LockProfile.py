@@ -0,0 +1,48 @@
+#! /usr/bin/env python
+# coding=utf-8
+
+# Reads the report LockProfiler writes from the synchronization logs of a run.
+# Each O line starts the statistics of a group of synchronization objects,
+# those with the same VPROF_LABEL_OBJECT label or a single unlabeled object,
+# and is followed by the W and H lines of its wait and hold time histograms
+# and by the T, S and F lines of the holder threads, semantic intervals and
+# functions blamed for its contended waits.
+
+class LockGroup:
+    def __init__(self, row):
+        self.label = row[1]
+        self.kind = row[2]
+        self.objects, self.acquisitions, self.contended, self.waiterThreads, self.maxWaiters, \
+            self.waitNs, self.contendedWaitNs, self.holdNs, self.p50Wait, self.p99Wait, self.maxWait, \
+            self.p50Hold, self.p99Hold, self.maxHold = [int(value) for value in row[3:17]]
+
+        # (bucket upper bound ns, count) by increasing bound
+        self.waitHistogram = []
+        self.holdHistogram = []
+
+        # (name, blamed ns) by decreasing blame
+        self.blamedThreads = []
+        self.blamedIntervals = []
+        self.blamedFunctions = []
+
+def readLockProfile(reportFile):
+    """ Groups in the order of the report, by decreasing contended wait """
+    groups = []
+    with open(reportFile, 'r') as report:
+        for line in report:
+            row = line.rstrip('\n').split('\t')
+            if row[0] == 'O' and len(row) >= 17:
+                groups.append(LockGroup(row))
+            elif len(groups) == 0 or len(row) < 4:
+                continue
+            elif row[0] == 'W':
+                groups[-1].waitHistogram.append((int(row[2]), int(row[3])))
+            elif row[0] == 'H':
+                groups[-1].holdHistogram.append((int(row[2]), int(row[3])))
+            elif row[0] == 'T':
+                groups[-1].blamedThreads.append((row[2], int(row[3])))
+            elif row[0] == 'S':
+                groups[-1].blamedIntervals.append((row[2], int(row[3])))
+            elif row[0] == 'F':
+                groups[-1].blamedFunctions.append((row[2], int(row[3])))
+    return groups
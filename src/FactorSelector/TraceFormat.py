@@ -0,0 +1,148 @@
+# Lines of the FunctionLog_* files written by trace_tool.cc:
+#
+#   index,entity,SIID,start,end[,key=value;key=value...]
+#   C,entity,clock,time,probe ns,sync probe ns[,CPU time probe ns,CPU time sync probe ns]
+#   D,index,time,samples,mean,variance
+#   O,SIID
+#
+# The optional sixth column of a record holds extra per-instance values, such
+# as the number of probe pairs which fired while the function ran, or for a
+# semantic interval kept by tail-based retention its weight, the inverse of
+# the probability it had of being kept, or the nanoseconds the thread spent
+# on CPU when that was sampled.  Semantic interval records also hold the
+# changes of the OS counters of their thread over the interval, named in
+# OS_COUNTERS, and with VPROF_PERF_EVENTS records hold the count of each perf
+# event during the call under the event name prefixed by PERF_EVENT_PREFIX.
+# With the allocator interposed, records also hold the allocator calls, bytes
+# and nanoseconds during the call as allocs, allocbytes and allocns.  In
+# virtual speedup runs, semantic interval records hold the speedup of the
+# experiment they ran in and the delay inserted meanwhile as speedup and
+# vdelay.
+#
+# C lines hold the cost of a probe pair measured by the entity at the given
+# time, and with VPROF_CPU_TIME its cost in the calls and semantic intervals
+# which sample CPU time, whose records hold cpu.
+#
+# D lines mark the function index whose probes the runtime disabled at the
+# given time, its calls having been too steady to matter, with the statistics
+# they were disabled on.
+#
+# O lines mark semantic intervals already written when a thread dropped some
+# of their records, its buffer having overflowed, so that they are incomplete.
+
+from bisect import bisect_right
+
+# Extra key of each OS counter -> name of its factor in the variance tree.
+OS_COUNTERS = [('csw', 'VoluntaryContextSwitches'),
+               ('icsw', 'InvoluntaryContextSwitches'),
+               ('minflt', 'MinorPageFaults'),
+               ('majflt', 'MajorPageFaults'),
+               ('runq', 'RunQueueWait'),
+               ('migrated', 'CpuMigration')]
+
+PERF_EVENT_PREFIX = 'pe.'
+
+class FunctionLogRow:
+    def __init__(self, index, entity, semIntervalID, startTime, endTime, extras):
+        self.index = index
+        self.entity = entity
+        self.semIntervalID = semIntervalID
+        self.startTime = startTime
+        self.endTime = endTime
+        self.extras = extras
+
+    def GetExtra(self, key, default=0):
+        return self.extras.get(key, default)
+
+    # Perf event name -> count during the call.
+    def GetPerfCounts(self):
+        return dict((key[len(PERF_EVENT_PREFIX):], value) for key, value in self.extras.items()
+                    if key.startswith(PERF_EVENT_PREFIX))
+
+def ParseExtras(field):
+    extras = {}
+    for pair in field.split(';'):
+        if '=' in pair:
+            key, value = pair.split('=', 1)
+            for convert in [int, float, str]:
+                try:
+                    extras[key] = convert(value)
+                    break
+                except ValueError:
+                    pass
+    return extras
+
+# Returns None for lines which are not function records.
+def ParseFunctionLogRow(row):
+    if len(row) < 5 or not row[0].isdigit():
+        return None
+    extras = ParseExtras(row[5]) if len(row) > 5 else {}
+    return FunctionLogRow(int(row[0]), row[1], row[2], int(row[3]), int(row[4]), extras)
+
+# Returns the function index of a D line, None for other lines.
+def ParseDisabledProbeRow(row):
+    if len(row) < 6 or row[0] != 'D':
+        return None
+    return int(row[1])
+
+# Returns the semantic interval ID of an O line, None for other lines.
+def ParseOverflowRow(row):
+    if len(row) < 2 or row[0] != 'O':
+        return None
+    return row[1]
+
+class ProbeCalibration:
+    def __init__(self):
+        # entity -> list of (time, probe ns, sync probe ns, CPU time probe ns,
+        # CPU time sync probe ns), oldest first once prepared
+        self.calibrations = {}
+        # Costs of the entities which never calibrated, None until prepared.
+        self.meanCosts = None
+
+    # Returns whether the row was a calibration line.
+    def AddRow(self, row):
+        if len(row) < 6 or row[0] != 'C':
+            return False
+        # Without CPU time, every probe costs the same.
+        costs = [float(cost) for cost in row[4:8]]
+        if len(costs) < 4:
+            costs = costs[:2] * 2
+        self.calibrations.setdefault(row[1], []).append(tuple([int(row[3])] + costs))
+        self.meanCosts = None
+        return True
+
+    # Sorts the calibrations, after the rows are all added.
+    def __Prepare(self):
+        if self.meanCosts is not None:
+            return
+        for entityCalibrations in self.calibrations.values():
+            entityCalibrations.sort()
+        allCalibrations = [c for cs in self.calibrations.values() for c in cs]
+        if len(allCalibrations) == 0:
+            self.meanCosts = (0, 0.0, 0.0, 0.0, 0.0)
+        else:
+            self.meanCosts = tuple([0] + [sum(c[i] for c in allCalibrations) / len(allCalibrations)
+                                          for i in range(1, 5)])
+
+    # Probe costs of the entity at the given time, i.e. its last calibration
+    # before then, or its first one.  Entities which never calibrated, such
+    # as threads which only run callees, get the mean over the others.
+    def GetCosts(self, entity, time, cpuSampled=False):
+        self.__Prepare()
+        entityCalibrations = self.calibrations.get(entity)
+        if not entityCalibrations:
+            costs = self.meanCosts
+        else:
+            index = bisect_right(entityCalibrations, (time, float('inf'))) - 1
+            costs = entityCalibrations[max(index, 0)]
+        return (costs[3], costs[4]) if cpuSampled else (costs[1], costs[2])
+
+    # Time the probes nested in the record added to it, in nanoseconds.
+    def GetOverhead(self, record):
+        probes = record.GetExtra('probes')
+        syncProbes = record.GetExtra('sync')
+        if probes == 0 and syncProbes == 0:
+            return 0
+        probeCost, syncProbeCost = self.GetCosts(record.entity, record.startTime,
+                                                 record.GetExtra('cpu', None) is not None)
+        return int(probes * probeCost + syncProbes * syncProbeCost)
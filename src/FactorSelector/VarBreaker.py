@@ -7,7 +7,9 @@ import sys
 import numpy as np
 
 import VarTree
+import Bootstrap
 from LatencyAggregator import LatencyAggregator
+from TraceFormat import OS_COUNTERS
 
 # Note for TODO. Filter by semantic interval ID AFTER we get critical path.
 # Thus, when checking whether a factor should be in the variance tree, first
@@ -19,11 +21,54 @@ from CriticalPathBuilder import CriticalPathBuilder
 
 
 def cov(var1, var2):
-    """ Return the covariance of two lists """
-    covMatrix = np.cov(np.vstack((var1, var2)))
+    """ Return the population covariance of two lists """
+    covMatrix = np.cov(np.vstack((var1, var2)), bias=True)
     return covMatrix[0, 1]
 
 
+def weightedVariance(data, weights=None):
+    """ Population variance of a list, weighting its values if weights is
+        given """
+    if weights is None:
+        return np.var(data)
+    data = np.asarray(data, dtype=float)
+    return np.average((data - np.average(data, weights=weights)) ** 2, weights=weights)
+
+
+def weightedCovariance(data1, data2, weights=None):
+    """ Population covariance of two lists, weighting their values if weights
+        is given """
+    data1 = np.asarray(data1, dtype=float)
+    data2 = np.asarray(data2, dtype=float)
+    return np.average((data1 - np.average(data1, weights=weights)) *
+                      (data2 - np.average(data2, weights=weights)), weights=weights)
+
+
+def explainedVariance(latencies, counters, weights=None):
+    """ Part of the variance of the latencies explained by a linear fit on the
+        counters, over the values where the counter was read """
+    present = [index for index, counter in enumerate(counters) if counter is not None]
+    if len(present) < 2:
+        return 0
+    x = np.array([counters[index] for index in present], dtype=float)
+    y = np.array([latencies[index] for index in present], dtype=float)
+    w = None if weights is None else np.array([weights[index] for index in present], dtype=float)
+    varCounter = weightedVariance(x, w)
+    if varCounter == 0:
+        return 0
+    covariance = np.average((x - np.average(x, weights=w)) * (y - np.average(y, weights=w)), weights=w)
+    return covariance ** 2 / varCounter
+
+
+def weightedPercentile(values, weights, percentile):
+    """ Smallest value at or above the given percentile of the distribution
+        in which each value counts as much as its weight """
+    order = np.argsort(values)
+    cumulative = np.cumsum(np.asarray(weights, dtype=float)[order])
+    rank = np.searchsorted(cumulative, cumulative[-1] * percentile / 100.0)
+    return np.asarray(values)[order][min(rank, len(values) - 1)]
+
+
 def collectExecTime(functionFile, dataDir):
     """ Read function execution time data from file """
     functions = open(functionFile, 'r')
@@ -38,28 +83,82 @@ def collectExecTime(functionFile, dataDir):
     # 1 to n - 1: child functions
     # n: parent function
     funcExecTime = latencyAggregator.GetLatencies(dataDir, len(funcNames) + 2)
+    funcCpuTime = latencyAggregator.GetCpuTimes()
+    funcPerfCounts = latencyAggregator.GetPerfCounts()
+    funcAllocTime = latencyAggregator.GetAllocTimes()
+
+    # Functions whose probes were disabled during the run only have the
+    # records from before then, so they are dropped and their time is left
+    # in the parent's self time.
+    for index in sorted(latencyAggregator.GetDisabledFunctions(), reverse=True):
+        if 0 < index < len(funcNames):
+            print 'Folding ' + funcNames[index] + ' into its caller, its probes were disabled'
+            del funcNames[index]
+            del funcExecTime[index]
+            del funcCpuTime[index]
+            del funcAllocTime[index]
+            for counts in funcPerfCounts.values():
+                del counts[index]
+
+    # Semantic intervals are weighted when the run only kept some of them.
+    weights = latencyAggregator.GetIntervalWeights()
+    startTimes = latencyAggregator.GetIntervalStartTimes()
+    osCounters = latencyAggregator.GetIntervalOsCounters()
+    queueWaits = latencyAggregator.GetIntervalQueueWaits()
+    printQueueSummary(latencyAggregator.GetQueues())
+
+    # CPU time is only sampled in some semantic intervals, and only those are
+    # used if there are any.
+    cpuSampled = latencyAggregator.GetIntervalCpuSampled()
+    if not any(cpuSampled):
+        funcCpuTime = None
+    elif not all(cpuSampled):
+        keep = [index for index, sampled in enumerate(cpuSampled) if sampled]
+        funcExecTime = [[row[index] for index in keep] for row in funcExecTime]
+        funcCpuTime = [[row[index] for index in keep] for row in funcCpuTime]
+        startTimes = [startTimes[index] for index in keep]
+        weights = [weights[index] for index in keep]
+        osCounters = dict((key, [counters[index] for index in keep])
+                          for key, counters in osCounters.items())
+        funcPerfCounts = dict((event, [[row[index] for index in keep] for row in counts])
+                              for event, counts in funcPerfCounts.items())
+        funcAllocTime = [[row[index] for index in keep] for row in funcAllocTime]
+        queueWaits = dict((label, [waits[index] for index in keep])
+                          for label, waits in queueWaits.items())
+
+    if not any(any(row) for row in funcAllocTime):
+        funcAllocTime = None
+
+    queueWaits = dict((label, waits) for label, waits in queueWaits.items() if any(waits))
+
+    if all(weight == 1 for weight in weights):
+        weights = None
 
     # Reorder function names
     funcNames.append('SyncWaitTime')
     funcNames.append(funcNames[0])
     funcNames[0] = 'latency'
-    return funcNames, funcExecTime
+    return funcNames, funcExecTime, startTimes, weights, funcCpuTime, osCounters, funcPerfCounts, \
+           funcAllocTime, queueWaits
 
 def collectExecTimeNontarget(functionFile, dataDir):
     latencyAggregator = LatencyAggregator(dataDir)
     funcExecTime, funcNames = latencyAggregator.GetLatenciesNonTarget(dataDir, functionFile)
-    return funcNames, funcExecTime
+    return funcNames, funcExecTime, None, None, None, None, {}, None, None
 
 
-def breakDown(functionFile, dataDir, nodeToBreak):
-    """ Break down variance into variances and covariances """
+def collectBreakdownData(functionFile, dataDir, nodeToBreak):
+    """ Collect exec times and replace the parent's time with its imaginary
+        (self) time, which is the parent's time minus that of its children """
     if nodeToBreak.func is None:
-        funcNames, funcExecTime = collectExecTimeNontarget(functionFile, dataDir)
+        funcNames, funcExecTime, startTimes, weights, funcCpuTime, osCounters, funcPerfCounts, \
+            funcAllocTime, queueWaits = collectExecTimeNontarget(functionFile, dataDir)
         names = funcNames[-1].split('_')
         nodeToBreak.func = names[1]
         nodeToBreak.parent = VarTree.VarNode(names[0], None, 0, 100)
     else:
-        funcNames, funcExecTime = collectExecTime(functionFile, dataDir)
+        funcNames, funcExecTime, startTimes, weights, funcCpuTime, osCounters, funcPerfCounts, \
+            funcAllocTime, queueWaits = collectExecTime(functionFile, dataDir)
 
     # print len(funcNames)
     # print len(funcExecTime)
@@ -71,43 +170,320 @@ def breakDown(functionFile, dataDir, nodeToBreak):
     caller = funcNames[-1]
     funcNames[-1] = 'img_' + funcNames[-1]
 
-    latencyData = funcExecTime[0]
+    # With the probe costs removed, the children may add up to a few
+    # nanoseconds more than the parent, in which case it has no time of its
+    # own.
     imaginaryRecords = funcExecTime[-1]
-    varLatency = np.var(latencyData)
     size = len(imaginaryRecords)
     for index in range(size):
         imaginary = imaginaryRecords[index]
         for i in range(1, len(funcNames) - 1):
             records = funcExecTime[i]
             imaginary -= records[index]
-            if imaginary < 0:
-                for execTime in funcExecTime:
-                    print execTime[index]
-                print imaginary
-            assert imaginary >= 0
-        imaginaryRecords[index] = imaginary
+        imaginaryRecords[index] = max(imaginary, 0)
 
-    if nodeToBreak.func == '':
+    # Sampled separately, the CPU and allocator times of the children may add
+    # up to a bit more than those of the parent.
+    for partTime in [funcCpuTime, funcAllocTime]:
+        if partTime is None:
+            continue
+        for index in range(size):
+            imaginary = partTime[-1][index]
+            for i in range(1, len(funcNames) - 1):
+                imaginary -= partTime[i][index]
+            partTime[-1][index] = min(max(imaginary, 0), imaginaryRecords[index])
+
+    # Perf event counts are prorated to the critical path separately too.
+    for counts in funcPerfCounts.values():
+        for index in range(size):
+            imaginary = counts[-1][index]
+            for i in range(1, len(funcNames) - 1):
+                imaginary -= counts[i][index]
+            counts[-1][index] = max(imaginary, 0)
+
+    return caller, funcNames, funcExecTime, startTimes, weights, funcCpuTime, osCounters, funcPerfCounts, \
+           funcAllocTime, queueWaits
+
+
+def printPerfBreakDown(funcNames, funcPerfCounts, weights=None):
+    """ Print the share of the variance of each perf event count that every
+        factor accounts for, where the total count is that of the parent """
+    for event in sorted(funcPerfCounts.keys()):
+        counts = funcPerfCounts[event]
+        totals = np.sum(np.array(counts[1:], dtype=float), axis=0)
+        varTotal = weightedVariance(totals, weights)
+        if varTotal == 0:
+            continue
+        print 'Variance of ' + event + ' (' + str(varTotal) + '):'
+        for index in range(1, len(funcNames)):
+            factorVariance = weightedVariance(counts[index], weights)
+            if factorVariance / varTotal > 2e-3:
+                print '    ' + funcNames[index] + ':' + str(100 * factorVariance / varTotal)
+
+
+def printQueueSummary(queues):
+    """ Print the items, sojourn times and depth over time of every traced
+        queue, and the dequeues which could not be paired with their enqueue """
+    for label, queue in sorted(queues, key=lambda x: x[0]):
+        sojourns = np.array([sojourn for _, sojourn in queue.GetSojournTimes()], dtype=float)
+        depths = queue.GetDepthSeries()
+        if len(depths) == 0:
+            continue
+        # Mean depth over time, each depth lasting until the next change.
+        duration = depths[-1][0] - depths[0][0]
+        meanDepth = sum(depth * (following[0] - time) for (time, depth), following in zip(depths, depths[1:])) / \
+                    float(duration) if duration > 0 else depths[-1][1]
+        summary = 'Queue ' + label + ': ' + str(len(sojourns)) + ' items, depth mean ' + \
+                  str(meanDepth) + ', max ' + str(max(depth for _, depth in depths))
+        if len(sojourns) > 0:
+            summary += ', sojourn mean ' + str(np.mean(sojourns)) + ' ns, p99 ' + \
+                       str(np.percentile(sojourns, 99)) + ' ns'
+        mismatches = queue.GetMismatches()
+        if mismatches > 0:
+            summary += ', ' + str(mismatches) + ' mismatched dequeues left out, ' + \
+                       'number the items with VPROF_QUEUE_ITEM_IN_ORDER or VPROF_QUEUE_ITEM'
+        print summary
+
+
+def breakDown(functionFile, dataDir, nodeToBreak, windowSize=None, numFactors=5, numResamples=0):
+    """ Break down variance into variances and covariances. If windowSize is
+        given, also return the top contributors per time window. If
+        numResamples is positive, also bound every contribution with a
+        bootstrap confidence interval """
+    caller, funcNames, funcExecTime, startTimes, weights, funcCpuTime, osCounters, funcPerfCounts, \
+        funcAllocTime, queueWaits = collectBreakdownData(functionFile, dataDir, nodeToBreak)
+
+    # The population estimator the bootstrap resamples use too, so that the
+    # confidence intervals are centred on these point estimates.
+    covMatrix = Bootstrap.covarianceMatrix(funcExecTime, weights)
+    variance = lambda index: covMatrix[index, index]
+    covariance = lambda index1, index2: covMatrix[index1, index2]
+
+    varLatency = variance(0)
+
+    # The OS counters and queue waits cover whole semantic intervals, so they
+    # are only factors of the root.
+    isRoot = nodeToBreak.func == ''
+    if isRoot:
         nodeToBreak.func = caller
         nodeToBreak.contribution = varLatency
         nodeToBreak.perct = 100
 
+    perctLow = perctHigh = None
+    if numResamples > 0:
+        # A resample may draw intervals of the same latency only, whose
+        # contributions are undefined.
+        resamples = Bootstrap.resampleCovariances(funcExecTime, numResamples, weights=weights)
+        resamples = resamples[resamples[:, 0, 0] > 0]
+        if len(resamples) < numResamples:
+            print str(numResamples - len(resamples)) + ' of ' + str(numResamples) + \
+                  ' bootstrap resamples skipped for having no latency variance'
+        if len(resamples) > 0:
+            perctResamples = np.array([100 * Bootstrap.contributionMatrix(resample) / resample[0, 0]
+                                       for resample in resamples])
+            perctLow, perctHigh = Bootstrap.confidenceInterval(perctResamples)
+
     length = len(funcNames)
     for index1 in range(1, length):
         for index2 in range(1, index1 + 1):
             funcName1 = funcNames[index1]
             funcName2 = funcNames[index2]
+            # With confidence intervals, keep a factor as long as it may pass
+            # the threshold, so that noise does not decide whether it is kept.
+            upper = None if perctHigh is None else perctHigh[index1, index2] / 100
             if index1 == index2:
-                variance = np.var(funcExecTime[index1])
-                if variance / varLatency > 2e-3:
-                    perct = 100 * variance / varLatency
-                    varNode = VarTree.VarNode(funcName1, nodeToBreak, variance, perct)
+                factorVariance = variance(index1)
+                if (factorVariance / varLatency if upper is None else upper) > 2e-3:
+                    perct = 100 * factorVariance / varLatency
+                    varNode = VarTree.VarNode(funcName1, nodeToBreak, factorVariance, perct)
+                    if perctLow is not None:
+                        varNode.setInterval(perctLow[index1, index2], perctHigh[index1, index2])
                     nodeToBreak.addChild(varNode)
             else:
-                covariance = cov(funcExecTime[index1],
-                                 funcExecTime[index2])
-                if 2 * covariance / varLatency > 1e-3:
-                    perct = 200 * covariance / varLatency
+                factorCovariance = covariance(index1, index2)
+                if (2 * factorCovariance / varLatency if upper is None else upper) > 1e-3:
+                    perct = 200 * factorCovariance / varLatency
                     covNode = VarTree.CovNode(funcName1, funcName2,
-                                              nodeToBreak, variance, perct)
+                                              nodeToBreak, factorCovariance, perct)
+                    if perctLow is not None:
+                        covNode.setInterval(perctLow[index1, index2], perctHigh[index1, index2])
                     nodeToBreak.addChild(covNode)
+
+    # On-CPU, off-CPU and allocator variance of every factor, next to its
+    # total.
+    for index in range(1, length):
+        parts = []
+        if funcCpuTime is not None:
+            onCpu = np.asarray(funcCpuTime[index], dtype=float)
+            parts += [('on-CPU', onCpu), ('off-CPU', np.asarray(funcExecTime[index], dtype=float) - onCpu)]
+        if funcAllocTime is not None:
+            parts.append(('allocator', funcAllocTime[index]))
+        for kind, data in parts:
+            kindVariance = weightedVariance(data, weights)
+            if kindVariance / varLatency > 2e-3:
+                nodeToBreak.addChild(VarTree.PartNode(funcNames[index], kind, nodeToBreak,
+                                                      kindVariance, 100 * kindVariance / varLatency))
+
+    if isRoot and osCounters is not None:
+        for key, name in OS_COUNTERS:
+            explained = explainedVariance(funcExecTime[0], osCounters[key], weights)
+            if explained / varLatency > 2e-3:
+                nodeToBreak.addChild(VarTree.OsNode(name, nodeToBreak, explained, 100 * explained / varLatency))
+
+    # The share of a queue wait is its covariance with the latency, the part
+    # of the variance of a sum that each of its terms accounts for.
+    if isRoot and queueWaits is not None:
+        for label, waits in sorted(queueWaits.items()):
+            contribution = weightedCovariance(waits, funcExecTime[0], weights)
+            if contribution / varLatency > 2e-3:
+                nodeToBreak.addChild(VarTree.QueueNode(label, nodeToBreak, contribution,
+                                                       100 * contribution / varLatency))
+
+    # Counts are not times, so they are reported next to the tree.
+    printPerfBreakDown(funcNames, funcPerfCounts, weights)
+
+    if windowSize is not None and startTimes is not None:
+        return windowedBreakDown(funcNames, funcExecTime, startTimes,
+                                 windowSize, numFactors, weights)
+
+
+class WindowMoments:
+    """ Running weighted mean and co-moments of the factors in one time
+        window """
+    def __init__(self, numFactors):
+        self.count = 0
+        self.totalWeight = 0.0
+        self.mean = np.zeros(numFactors)
+        self.coMoments = np.zeros((numFactors, numFactors))
+
+    def add(self, sample, weight=1):
+        self.count += 1
+        self.totalWeight += weight
+        delta = sample - self.mean
+        self.mean += weight * delta / self.totalWeight
+        self.coMoments += weight * np.outer(delta, sample - self.mean)
+
+    def covariance(self):
+        return self.coMoments / self.totalWeight
+
+
+def windowedBreakDown(funcNames, funcExecTime, startTimes, windowSize, numFactors, weights=None):
+    """ Bucket semantic intervals by start time into windows of windowSize
+        nanoseconds and decompose each window's latency variance. Returns a
+        list of (windowStart, numIntervals, varLatency, topFactors) tuples,
+        where topFactors is a list of (factorName, perct) pairs """
+    samples = np.array(funcExecTime, dtype=float).T
+    if weights is None:
+        weights = [1] * len(startTimes)
+    firstStart = min(startTimes)
+    windows = {}
+    for sample, startTime, weight in zip(samples, startTimes, weights):
+        window = (startTime - firstStart) // windowSize
+        if window not in windows:
+            windows[window] = WindowMoments(len(funcNames))
+        windows[window].add(sample, weight)
+
+    timeSeries = []
+    for window in sorted(windows):
+        covMatrix = windows[window].covariance()
+        varLatency = covMatrix[0, 0]
+        factors = []
+        if varLatency > 0:
+            for index1 in range(1, len(funcNames)):
+                factors.append((funcNames[index1],
+                                100 * covMatrix[index1, index1] / varLatency))
+                for index2 in range(1, index1):
+                    factors.append((funcNames[index1] + ',' + funcNames[index2],
+                                    200 * covMatrix[index1, index2] / varLatency))
+        factors.sort(key=lambda x: x[1], reverse=True)
+        timeSeries.append((firstStart + window * windowSize, windows[window].count,
+                           varLatency, factors[:numFactors]))
+    return timeSeries
+
+
+def diffBreakDown(functionFile, baseDataDir, newDataDir, numResamples, confidence=0.95):
+    """ Compare the variance contributions of two runs instrumented with the
+        same function file. Returns (factorName, baseContribution,
+        newContribution, delta, deltaLow, deltaHigh) tuples, where the bounds
+        come from bootstrapping both runs, ranked by deltaLow so that the
+        regressions we are most confident about come first """
+    runs = []
+    for dataDir in [baseDataDir, newDataDir]:
+        _, funcNames, funcExecTime, _, weights, _, _, _, _, _ = collectBreakdownData(functionFile, dataDir,
+                                                                                     VarTree.VarNode('', None, 0, 100))
+        contributions = Bootstrap.contributionMatrix(Bootstrap.covarianceMatrix(funcExecTime, weights))
+        resamples = Bootstrap.resampleCovariances(funcExecTime, numResamples, weights=weights)
+        resamples = np.array([Bootstrap.contributionMatrix(resample) for resample in resamples])
+        runs.append((dict((name, index) for index, name in enumerate(funcNames)),
+                     contributions, resamples))
+
+    (baseIndices, baseContributions, baseResamples), \
+        (newIndices, newContributions, newResamples) = runs
+
+    # Align factors by function name, in case the two runs list them in a
+    # different order.
+    names = [name for name in sorted(baseIndices, key=baseIndices.get)
+             if name in newIndices and name != 'latency']
+    pairs = []
+    for index1 in range(len(names)):
+        for index2 in range(index1 + 1):
+            pairs.append((names[index1], names[index2]))
+
+    diffs = []
+    for name1, name2 in pairs:
+        base = (baseIndices[name1], baseIndices[name2])
+        new = (newIndices[name1], newIndices[name2])
+        deltas = newResamples[:, new[0], new[1]] - baseResamples[:, base[0], base[1]]
+        deltaLow, deltaHigh = Bootstrap.confidenceInterval(deltas, confidence)
+        factorName = name1 if name1 == name2 else name1 + ',' + name2
+        diffs.append((factorName, baseContributions[base], newContributions[new],
+                      newContributions[new] - baseContributions[base], deltaLow, deltaHigh))
+
+    diffs.sort(key=lambda x: x[4], reverse=True)
+    return diffs
+
+
+def tailBreakDown(functionFile, dataDir, nodeToBreak, quantile):
+    """ Break down the excess latency of the slowest semantic intervals, i.e.
+        those at or above the given latency quantile, over the mean of the
+        others.  Means are additive, so the excess of the children sums to
+        the excess of the parent """
+    caller, funcNames, funcExecTime, _, weights, _, _, _, _, _ = collectBreakdownData(functionFile, dataDir,
+                                                                                      nodeToBreak)
+
+    # Rows are factors, columns are semantic intervals. The percentile selects
+    # by partitioning, so this stays linear in the trace size.
+    execTime = np.array(funcExecTime, dtype=float)
+    if weights is None:
+        threshold = np.percentile(execTime[0], 100 * quantile)
+        tail = execTime[0] >= threshold
+        if tail.all():
+            print 'No semantic interval below the latency quantile ' + str(quantile)
+            return
+        excess = execTime[:, tail].mean(axis=1) - execTime[:, ~tail].mean(axis=1)
+    else:
+        # Weighted intervals need sorting instead.
+        weights = np.asarray(weights, dtype=float)
+        threshold = weightedPercentile(execTime[0], weights, 100 * quantile)
+        tail = execTime[0] >= threshold
+        if tail.all():
+            print 'No semantic interval below the latency quantile ' + str(quantile)
+            return
+        excess = np.average(execTime[:, tail], axis=1, weights=weights[tail]) - \
+                 np.average(execTime[:, ~tail], axis=1, weights=weights[~tail])
+    tailLatency = excess[0]
+    if tailLatency <= 0:
+        print 'No tail latency above the other semantic intervals at quantile ' + str(quantile)
+        return
+
+    if nodeToBreak.func == '':
+        nodeToBreak.func = caller
+        nodeToBreak.contribution = tailLatency
+        nodeToBreak.perct = 100
+
+    for index in range(1, len(funcNames)):
+        perct = 100 * excess[index] / tailLatency
+        if perct > 0.2:
+            tailNode = VarTree.TailNode(funcNames[index], nodeToBreak,
+                                        excess[index], perct)
+            nodeToBreak.addChild(tailNode)
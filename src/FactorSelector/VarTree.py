@@ -4,6 +4,8 @@ class Node(object):
         self._parent = parent
         self._contribution = contribution
         self._perct = perct
+        self._ciLow = None
+        self._ciHigh = None
 
     @property
     def children(self):
@@ -30,6 +32,42 @@ class Node(object):
     def perct(self, perct):
         self._perct = perct
 
+    # Bootstrap confidence interval of perct, None if not computed.
+    @property
+    def ciLow(self):
+        return self._ciLow
+
+    @property
+    def ciHigh(self):
+        return self._ciHigh
+
+    def setInterval(self, ciLow, ciHigh):
+        self._ciLow = ciLow
+        self._ciHigh = ciHigh
+
+    # Lower confidence bound if known, point estimate otherwise.
+    @property
+    def conservativePerct(self):
+        return self._perct if self._ciLow is None else self._ciLow
+
+    # Upper confidence bound if known, point estimate otherwise.
+    @property
+    def optimisticPerct(self):
+        return self._perct if self._ciHigh is None else self._ciHigh
+
+    # Share of the variance of the root, since perct is relative to the
+    # variance of the parent.
+    @property
+    def absolutePerct(self):
+        if self._parent is None:
+            return self._perct
+        return self._perct * self._parent.absolutePerct / 100
+
+    # Name the factor is shown with.
+    @property
+    def label(self):
+        return self.func
+
     @property
     def depth(self):
         depth = 0
@@ -54,6 +92,46 @@ class VarNode(Node):
     def func(self, func):
         self._func = func
 
+# Contribution of a function to the excess latency of the slowest semantic
+# intervals over the mean of the others, rather than to the latency variance.
+class TailNode(VarNode):
+    def __init__(self, function, parent, contribution, perct):
+        super(TailNode, self).__init__(function, parent, contribution, perct)
+
+# Variance of a part of the time of a function, such as its on-CPU, off-CPU
+# or allocator time, shown next to the VarNode of the function. Breaking it
+# down breaks down the function.
+class PartNode(VarNode):
+    def __init__(self, function, kind, parent, contribution, perct):
+        super(PartNode, self).__init__(function, parent, contribution, perct)
+        self._kind = kind
+
+    @property
+    def kind(self):
+        return self._kind
+
+    @property
+    def label(self):
+        return self.func + ' [' + self._kind + ']'
+
+# Part of the latency variance explained by an OS counter read over each
+# semantic interval, such as its context switches or run queue wait. It names
+# interference rather than code, so it cannot be broken down.
+class OsNode(VarNode):
+    def __init__(self, counter, parent, contribution, perct):
+        super(OsNode, self).__init__(counter, parent, contribution, perct)
+
+# Part of the latency variance due to the time the items enqueued by each
+# semantic interval waited in a traced queue. The wait is not in any function,
+# so it cannot be broken down.
+class QueueNode(VarNode):
+    def __init__(self, queue, parent, contribution, perct):
+        super(QueueNode, self).__init__(queue, parent, contribution, perct)
+
+    @property
+    def label(self):
+        return 'QueueWait[' + self.func + ']'
+
 class CovNode(Node):
     def __init__(self, func1, func2, parent, contribution, perct):
         super(CovNode, self).__init__(parent, contribution, perct)
@@ -86,14 +164,29 @@ class Tree(object):
         while len(nodesToLookAt) > 0:
             node = nodesToLookAt.pop(0)
             if len(node.children) == 0:
-                if node.perct > 5:
+                # Keep a leaf as long as it may pass the threshold, as
+                # breakDown keeps factors, so that noise does not hide it.
+                if node.optimisticPerct > 5:
                     leaves.append(node)
             else:
                 nodesToLookAt += node.children
         return leaves
 
+    # Leaves that can be broken down further, largest share of the total
+    # variance first. Covariances, self times, OS counters and queue waits
+    # cannot be instrumented, and parts repeat the function they are part of.
+    def getExplorableLeaves(self, explored):
+        leaves = [leaf for leaf in self.getLeaves()
+                  if not isinstance(leaf, (CovNode, PartNode, OsNode, QueueNode))
+                  and not leaf.func.startswith('img_') and leaf.func not in explored]
+        leaves.sort(key=lambda x: x.absolutePerct, reverse=True)
+        return leaves
+
     def selectFactors(self, k):
+        # Rank by the lower confidence bound where one is available, so that a
+        # factor whose contribution is large but noisy does not win over one
+        # that is reliably large.
         leaves = self.getLeaves()
-        leaves.sort(key=lambda x: x.perct, reverse=True)
+        leaves.sort(key=lambda x: x.conservativePerct, reverse=True)
         num_selected = min(k, len(leaves))
         return leaves[:num_selected]
@@ -0,0 +1,440 @@
+#include "LockProfile.h"
+
+// STL libs
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <sstream>
+
+// Same values as the Operation enum of trace_tool.h.
+enum Operation { MUTEX_LOCK,
+                 MUTEX_UNLOCK,
+                 CV_WAIT,
+                 CV_BROADCAST,
+                 CV_SIGNAL };
+
+Histogram::Histogram() {
+    std::fill(counts, counts + NUM_BUCKETS, 0);
+}
+
+void Histogram::Add(uint64_t ns) {
+    int bucket = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+    counts[std::min(bucket, NUM_BUCKETS - 1)]++;
+}
+
+void Histogram::Merge(const Histogram &other) {
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        counts[i] += other.counts[i];
+    }
+}
+
+uint64_t Histogram::UpperBound(int bucket) {
+    return bucket == 0 ? 0 : bucket >= 64 ? UINT64_MAX : 1ULL << bucket;
+}
+
+uint64_t Histogram::Quantile(double quantile) const {
+    uint64_t total = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        total += counts[i];
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen > 0 && seen >= quantile * total) {
+            return UpperBound(i);
+        }
+    }
+    return 0;
+}
+
+// Waits sorted by start, so that those overlapping [start, end) are the ones
+// starting from start - maxWaitDuration until end.
+static std::vector<ContendedWait>::iterator firstOverlap(std::vector<ContendedWait> &waits,
+                                                         uint64_t maxWaitDuration, uint64_t start) {
+    uint64_t from = start > maxWaitDuration ? start - maxWaitDuration : 0;
+    return std::lower_bound(waits.begin(), waits.end(), from,
+                            [](const ContendedWait &wait, uint64_t time) { return wait.start < time; });
+}
+
+LockProfile::LockProfile(uint64_t _contendedNs): contendedNs(_contendedNs), windowsSorted(false) {}
+
+bool LockProfile::AddSynchronizationLog(const std::string &filename, const std::string &pid) {
+    objects.clear();
+    labels.clear();
+    threads.clear();
+    if (!readSynchronizationLog(filename, false)) {
+        return false;
+    }
+
+    for (auto &object : objects) {
+        std::sort(object.second.waits.begin(), object.second.waits.end(),
+                  [](const ContendedWait &a, const ContendedWait &b) { return a.start < b.start; });
+        object.second.group = groupOf(object.first, pid);
+    }
+
+    threads.clear();
+    readSynchronizationLog(filename, true);
+
+    for (auto &object : objects) {
+        for (ContendedWait &wait : object.second.waits) {
+            if (wait.notifier >= 0 && wait.notifyTime > wait.start) {
+                blame(object.second.group, wait.notifier, wait.notifierSIID, wait.start, wait.notifyTime);
+            }
+        }
+    }
+
+    mergeObjects();
+    objects.clear();
+    labels.clear();
+    threads.clear();
+    return true;
+}
+
+bool LockProfile::readSynchronizationLog(const std::string &filename, bool isSecondPass) {
+    LogReader reader(filename);
+    if (!reader.IsOpen()) {
+        return false;
+    }
+
+    std::vector<Field> fields;
+    while (reader.Next(fields)) {
+        if (fields.size() >= 3 && fields[0].Equals("L")) {
+            if (!isSecondPass) {
+                std::string label = fields[2].ToString();
+                std::replace(label.begin(), label.end(), '\t', ' ');
+                labels[fields[1].ToAddress()] = label;
+            }
+            continue;
+        }
+        if (fields.size() < 5) {
+            continue;
+        }
+
+        int entity = entities.Intern(fields[1]);
+        if (threads.size() <= static_cast<size_t>(entity)) {
+            threads.resize(entity + 1);
+        }
+        ThreadState &thread = threads[entity];
+
+        // Operations and function times pair up in order per thread, as in
+        // RequestTracker.
+        if (fields[0].Equals("0")) {
+            thread.pending.push_back({ fields[3].ToAddress(), static_cast<int>(fields[4].ToInt()) });
+        } else if (fields[0].Equals("1") && !thread.pending.empty()) {
+            PendingOperation operation = thread.pending.front();
+            thread.pending.pop_front();
+            if (operation.obj == 0 || operation.op > CV_SIGNAL) {
+                continue;
+            }
+
+            uint64_t start = fields[3].ToInt();
+            uint64_t end = std::max(start, fields[4].ToInt());
+            if (isSecondPass) {
+                blameOperation(entity, fields[2], operation.obj, operation.op, start, end);
+            } else {
+                countOperation(entity, operation.obj, operation.op, start, end);
+            }
+        }
+    }
+    return true;
+}
+
+template <typename Blame>
+bool LockProfile::updateHeld(int entity, uint64_t obj, int op, uint64_t start, uint64_t end,
+                             Blame blame, uint64_t &heldNs) {
+    std::vector<HeldObject> &held = threads[entity].held;
+    if (op == MUTEX_LOCK) {
+        held.push_back({ obj, end, 0 });
+    } else if (op == CV_WAIT && !held.empty()) {
+        HeldObject &last = held.back();
+        if (start > last.since) {
+            blame(last.obj, last.since, start);
+            last.heldNs += start - last.since;
+        }
+        last.since = end;
+    } else if (op == MUTEX_UNLOCK) {
+        for (auto object = held.rbegin(); object != held.rend(); ++object) {
+            if (object->obj == obj) {
+                uint64_t since = std::min(object->since, end);
+                blame(obj, since, end);
+                heldNs = object->heldNs + end - since;
+                held.erase(std::next(object).base());
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void LockProfile::countOperation(int entity, uint64_t obj, int op, uint64_t start, uint64_t end) {
+    ObjectStats &stats = objects[obj];
+    if (op == MUTEX_LOCK || op == MUTEX_UNLOCK) {
+        stats.isMutex = true;
+    } else {
+        stats.isCV = true;
+    }
+
+    if (op == MUTEX_LOCK || op == CV_WAIT) {
+        uint64_t wait = end - start;
+        stats.acquisitions++;
+        stats.waitNs += wait;
+        stats.maxWait = std::max(stats.maxWait, wait);
+        stats.wait.Add(wait);
+        if (wait >= contendedNs) {
+            stats.contended++;
+            stats.contendedWaitNs += wait;
+            stats.waits.push_back({ start, end, entity, -1, -1, 0 });
+            stats.maxWaitDuration = std::max(stats.maxWaitDuration, wait);
+        }
+    }
+
+    uint64_t heldNs;
+    if (updateHeld(entity, obj, op, start, end, [](uint64_t, uint64_t, uint64_t) {}, heldNs)) {
+        stats.holdNs += heldNs;
+        stats.maxHold = std::max(stats.maxHold, heldNs);
+        stats.hold.Add(heldNs);
+    }
+}
+
+void LockProfile::blameOperation(int entity, const Field &siid, uint64_t obj, int op,
+                                 uint64_t start, uint64_t end) {
+    if (op == CV_SIGNAL || op == CV_BROADCAST) {
+        blameNotification(entity, siid, obj, start);
+        return;
+    }
+
+    uint64_t heldNs;
+    updateHeld(entity, obj, op, start, end,
+               [&](uint64_t heldObj, uint64_t holdStart, uint64_t holdEnd) {
+                   blameHold(entity, siid, heldObj, holdStart, holdEnd);
+               }, heldNs);
+}
+
+void LockProfile::blameHold(int entity, const Field &siid, uint64_t obj, uint64_t start, uint64_t end) {
+    auto object = objects.find(obj);
+    if (object == objects.end() || object->second.waits.empty()) {
+        return;
+    }
+
+    ObjectStats &stats = object->second;
+    int siidID = -1;
+    for (auto wait = firstOverlap(stats.waits, stats.maxWaitDuration, start);
+         wait != stats.waits.end() && wait->start < end; ++wait) {
+        uint64_t overlapStart = std::max(start, wait->start);
+        uint64_t overlapEnd = std::min(end, wait->end);
+        if (wait->entity == entity || overlapEnd <= overlapStart) {
+            continue;
+        }
+        if (siidID < 0) {
+            siidID = siids.Intern(siid);
+        }
+        blame(stats.group, entity, siidID, overlapStart, overlapEnd);
+    }
+}
+
+void LockProfile::blameNotification(int entity, const Field &siid, uint64_t obj, uint64_t time) {
+    auto object = objects.find(obj);
+    if (object == objects.end() || object->second.waits.empty()) {
+        return;
+    }
+
+    ObjectStats &stats = object->second;
+    for (auto wait = firstOverlap(stats.waits, stats.maxWaitDuration, time);
+         wait != stats.waits.end() && wait->start <= time; ++wait) {
+        if (wait->entity != entity && time <= wait->end &&
+            (wait->notifier < 0 || time > wait->notifyTime)) {
+            wait->notifier = entity;
+            wait->notifierSIID = siids.Intern(siid);
+            wait->notifyTime = time;
+        }
+    }
+}
+
+void LockProfile::blame(int group, int entity, int siid, uint64_t start, uint64_t end) {
+    LockGroup &lockGroup = groups[group];
+    lockGroup.threadBlame[entity] += end - start;
+    lockGroup.siidBlame[siid] += end - start;
+
+    if (windows.size() <= static_cast<size_t>(entity)) {
+        windows.resize(entity + 1);
+        maxWindow.resize(entity + 1, 0);
+    }
+    windows[entity].push_back({ start, end, group });
+    maxWindow[entity] = std::max(maxWindow[entity], end - start);
+}
+
+int LockProfile::groupOf(uint64_t obj, const std::string &pid) {
+    std::string label;
+    auto objLabel = labels.find(obj);
+    if (objLabel != labels.end()) {
+        label = objLabel->second;
+    } else {
+        std::stringstream ss;
+        ss << pid << ":0x" << std::hex << obj;
+        label = ss.str();
+    }
+
+    auto group = groupIndices.find(label);
+    if (group != groupIndices.end()) {
+        return group->second;
+    }
+    groupIndices[label] = groups.size();
+    groups.emplace_back();
+    groups.back().label = label;
+    return groups.size() - 1;
+}
+
+void LockProfile::mergeObjects() {
+    for (auto &object : objects) {
+        ObjectStats &stats = object.second;
+        LockGroup &group = groups[stats.group];
+        group.isMutex = group.isMutex || stats.isMutex;
+        group.isCV = group.isCV || stats.isCV;
+        group.objects++;
+        group.acquisitions += stats.acquisitions;
+        group.contended += stats.contended;
+        group.waitNs += stats.waitNs;
+        group.contendedWaitNs += stats.contendedWaitNs;
+        group.holdNs += stats.holdNs;
+        group.maxWait = std::max(group.maxWait, stats.maxWait);
+        group.maxHold = std::max(group.maxHold, stats.maxHold);
+        group.wait.Merge(stats.wait);
+        group.hold.Merge(stats.hold);
+
+        // Ends of the waits still going on at the start of each wait.
+        std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> waitEnds;
+        for (ContendedWait &wait : stats.waits) {
+            group.waiters.insert(wait.entity);
+            while (!waitEnds.empty() && waitEnds.top() <= wait.start) {
+                waitEnds.pop();
+            }
+            waitEnds.push(wait.end);
+            group.maxWaiters = std::max(group.maxWaiters, static_cast<int>(waitEnds.size()));
+        }
+    }
+}
+
+bool LockProfile::AddFunctionLog(const std::string &filename) {
+    if (!windowsSorted) {
+        for (auto &entityWindows : windows) {
+            std::sort(entityWindows.begin(), entityWindows.end());
+        }
+        windowsSorted = true;
+    }
+
+    LogReader reader(filename);
+    if (!reader.IsOpen()) {
+        return false;
+    }
+
+    std::vector<Field> fields;
+    while (reader.Next(fields)) {
+        // Semantic interval records, and C and D lines, have no callee index.
+        int index = fields.size() >= 5 ? fields[0].ToInt() : 0;
+        if (index == 0) {
+            continue;
+        }
+        int entity = entities.Intern(fields[1]);
+        if (static_cast<size_t>(entity) >= windows.size() || windows[entity].empty()) {
+            continue;
+        }
+
+        std::vector<BlamedWindow> &entityWindows = windows[entity];
+        uint64_t start = fields[3].ToInt();
+        uint64_t end = fields[4].ToInt();
+        uint64_t from = start > maxWindow[entity] ? start - maxWindow[entity] : 0;
+        for (auto window = std::lower_bound(entityWindows.begin(), entityWindows.end(), BlamedWindow{ from, from, 0 });
+             window != entityWindows.end() && window->start < end; ++window) {
+            uint64_t overlapStart = std::max(start, window->start);
+            uint64_t overlapEnd = std::min(end, window->end);
+            if (overlapEnd > overlapStart) {
+                groups[window->group].functionBlame[index] += overlapEnd - overlapStart;
+            }
+        }
+    }
+    return true;
+}
+
+// The topN entries with the most blamed nanoseconds, most first.
+static std::vector<std::pair<int, uint64_t>> topBlamed(const std::unordered_map<int, uint64_t> &blamed,
+                                                       size_t topN) {
+    std::vector<std::pair<int, uint64_t>> result(blamed.begin(), blamed.end());
+    auto byBlame = [](const std::pair<int, uint64_t> &a, const std::pair<int, uint64_t> &b) {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    };
+    size_t count = std::min(topN, result.size());
+    std::partial_sort(result.begin(), result.begin() + count, result.end(), byBlame);
+    result.resize(count);
+    return result;
+}
+
+bool LockProfile::Save(const std::string &filename, const std::vector<std::string> &funcNames, size_t topN) {
+    std::ofstream reportFile(filename, std::ios::trunc);
+    if (!reportFile) {
+        return false;
+    }
+
+    std::vector<int> order;
+    for (size_t i = 0; i < groups.size(); i++) {
+        order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [this](int a, int b) {
+        return groups[a].contendedWaitNs > groups[b].contendedWaitNs ||
+               (groups[a].contendedWaitNs == groups[b].contendedWaitNs && groups[a].waitNs > groups[b].waitNs);
+    });
+
+    reportFile << "# O\tlabel\tkind\tobjects\tacquisitions\tcontended\twaiter threads\tmax waiters\t"
+               << "wait ns\tcontended wait ns\thold ns\tp50 wait\tp99 wait\tmax wait\t"
+               << "p50 hold\tp99 hold\tmax hold" << std::endl;
+    reportFile << "# W|H\tlabel\tbucket upper bound ns\tcount" << std::endl;
+    reportFile << "# T|S|F\tlabel\tholder thread|semantic interval|function\tblamed ns" << std::endl;
+    for (int index : order) {
+        const LockGroup &group = groups[index];
+        const std::string kind = group.isMutex && group.isCV ? "mutex+cv" : group.isMutex ? "mutex" : "cv";
+        reportFile << "O\t" << group.label << '\t' << kind << '\t' << group.objects << '\t'
+                   << group.acquisitions << '\t' << group.contended << '\t' << group.waiters.size() << '\t'
+                   << group.maxWaiters << '\t' << group.waitNs << '\t' << group.contendedWaitNs << '\t'
+                   << group.holdNs << '\t' << group.wait.Quantile(0.5) << '\t' << group.wait.Quantile(0.99) << '\t'
+                   << group.maxWait << '\t' << group.hold.Quantile(0.5) << '\t' << group.hold.Quantile(0.99) << '\t'
+                   << group.maxHold << std::endl;
+
+        for (int bucket = 0; bucket < Histogram::NUM_BUCKETS; bucket++) {
+            if (group.wait.counts[bucket] > 0) {
+                reportFile << "W\t" << group.label << '\t' << Histogram::UpperBound(bucket) << '\t'
+                           << group.wait.counts[bucket] << std::endl;
+            }
+        }
+        for (int bucket = 0; bucket < Histogram::NUM_BUCKETS; bucket++) {
+            if (group.hold.counts[bucket] > 0) {
+                reportFile << "H\t" << group.label << '\t' << Histogram::UpperBound(bucket) << '\t'
+                           << group.hold.counts[bucket] << std::endl;
+            }
+        }
+
+        for (auto &thread : topBlamed(group.threadBlame, topN)) {
+            reportFile << "T\t" << group.label << '\t' << entities.Get(thread.first) << '\t'
+                       << thread.second << std::endl;
+        }
+        for (auto &siid : topBlamed(group.siidBlame, topN)) {
+            reportFile << "S\t" << group.label << '\t' << siids.Get(siid.first) << '\t'
+                       << siid.second << std::endl;
+        }
+
+        // Without the function names file every callee index is reported,
+        // with it only the callees, not the target function.
+        std::unordered_map<int, uint64_t> calleeBlame;
+        for (auto &function : group.functionBlame) {
+            if (funcNames.empty() || static_cast<size_t>(function.first) < funcNames.size()) {
+                calleeBlame.insert(function);
+            }
+        }
+        for (auto &function : topBlamed(calleeBlame, topN)) {
+            reportFile << "F\t" << group.label << '\t'
+                       << (funcNames.empty() ? "function " + std::to_string(function.first) : funcNames[function.first])
+                       << '\t' << function.second << std::endl;
+        }
+    }
+    return reportFile.good();
+}
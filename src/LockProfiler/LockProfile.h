@@ -0,0 +1,250 @@
+#ifndef LOCK_PROFILE_H
+#define LOCK_PROFILE_H
+
+#include "LogReader.h"
+
+// STL libs
+#include <cstdint>
+#include <deque>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Durations in power of two buckets, bucket b counting those of less than 2^b
+// nanoseconds and at least half as many, bucket 0 those of 0.
+struct Histogram {
+    static const int NUM_BUCKETS = 64;
+
+    Histogram();
+
+    uint64_t counts[NUM_BUCKETS];
+
+    void Add(uint64_t ns);
+
+    void Merge(const Histogram &other);
+
+    // Upper bound of the bucket holding the given quantile.
+    uint64_t Quantile(double quantile) const;
+
+    static uint64_t UpperBound(int bucket);
+};
+
+// An acquisition of a mutex or a wait on a condition variable which took at
+// least the contention threshold.
+struct ContendedWait {
+    uint64_t start;
+
+    uint64_t end;
+
+    int entity;
+
+    // For condition variables, the notification of another thread which
+    // started last during the wait, which is the one that woke it up.  The
+    // waiter often returns before the notifier does, so the start is used.
+    int notifier;
+
+    int notifierSIID;
+
+    uint64_t notifyTime;
+};
+
+// Window of time in which a thread made others wait on the objects of a group.
+struct BlamedWindow {
+    uint64_t start;
+
+    uint64_t end;
+
+    int group;
+
+    bool operator<(const BlamedWindow &other) const {
+        return start < other.start;
+    }
+};
+
+// Statistics of the objects with the same label, or of a single object of a
+// single process if it has none.
+struct LockGroup {
+    LockGroup(): isMutex(false), isCV(false), objects(0), acquisitions(0), contended(0),
+                 waitNs(0), contendedWaitNs(0), holdNs(0), maxWait(0), maxHold(0), maxWaiters(0) {}
+
+    std::string label;
+
+    bool isMutex;
+
+    bool isCV;
+
+    int objects;
+
+    uint64_t acquisitions;
+
+    uint64_t contended;
+
+    uint64_t waitNs;
+
+    uint64_t contendedWaitNs;
+
+    uint64_t holdNs;
+
+    uint64_t maxWait;
+
+    uint64_t maxHold;
+
+    Histogram wait;
+
+    Histogram hold;
+
+    // Threads which had contended waits, and the most which ever waited on
+    // one of the objects at the same time.
+    std::set<int> waiters;
+
+    int maxWaiters;
+
+    // Nanoseconds other threads waited because of each holder thread,
+    // semantic interval of the holder and function the holder was in.
+    std::unordered_map<int, uint64_t> threadBlame;
+
+    std::unordered_map<int, uint64_t> siidBlame;
+
+    std::unordered_map<int, uint64_t> functionBlame;
+};
+
+// Builds the lock contention profile of a run from its SynchronizationLog_*
+// files, and attributes the contended waits to the callees the holders were
+// in from its FunctionLog_* files.
+//
+// Each synchronization log is read twice.  The first pass pairs every
+// operation with its function time, as in RequestTracker, fills the wait and
+// hold histograms and keeps the contended waits of each object, sorted by
+// start.  The second pass rebuilds the hold intervals of every thread and
+// looks up the contended waits of other threads they overlap, so that only
+// the contended waits are ever held in memory and each hold interval costs a
+// binary search.  A mutex is held from the end of its lock to the end of its
+// unlock, less the condition variable waits of the holder, which release the
+// mutex it acquired last.  Waits on condition variables are blamed on the
+// thread whose notification woke them up.
+class LockProfile {
+    public:
+        explicit LockProfile(uint64_t contendedNs);
+
+        bool AddSynchronizationLog(const std::string &filename, const std::string &pid);
+
+        // Call after every synchronization log was added.
+        bool AddFunctionLog(const std::string &filename);
+
+        // Lines of "O	label	kind	objects	acquisitions	contended	waiter threads
+        // max waiters	wait ns	contended wait ns	hold ns	p50 wait	p99 wait
+        // max wait	p50 hold	p99 hold	max hold" for each group by decreasing
+        // contended wait, each followed by the "W	label	bucket	count" and
+        // "H	label	bucket	count" lines of its wait and hold histograms and by
+        // the "T", "S" and "F	label	name	blamed ns" lines of its topN most
+        // blamed holder threads, semantic intervals and functions.
+        bool Save(const std::string &filename, const std::vector<std::string> &funcNames, size_t topN);
+
+    private:
+        struct ObjectStats {
+            ObjectStats(): group(-1), isMutex(false), isCV(false), acquisitions(0), contended(0),
+                           waitNs(0), contendedWaitNs(0), holdNs(0), maxWait(0), maxHold(0),
+                           maxWaitDuration(0) {}
+
+            int group;
+
+            bool isMutex;
+
+            bool isCV;
+
+            uint64_t acquisitions;
+
+            uint64_t contended;
+
+            uint64_t waitNs;
+
+            uint64_t contendedWaitNs;
+
+            uint64_t holdNs;
+
+            uint64_t maxWait;
+
+            uint64_t maxHold;
+
+            Histogram wait;
+
+            Histogram hold;
+
+            std::vector<ContendedWait> waits;
+
+            uint64_t maxWaitDuration;
+        };
+
+        struct HeldObject {
+            uint64_t obj;
+
+            // Start of the current hold interval.
+            uint64_t since;
+
+            // Held time of the earlier intervals, before condition variable waits.
+            uint64_t heldNs;
+        };
+
+        struct PendingOperation {
+            uint64_t obj;
+
+            int op;
+        };
+
+        struct ThreadState {
+            std::deque<PendingOperation> pending;
+
+            std::vector<HeldObject> held;
+        };
+
+        uint64_t contendedNs;
+
+        StringTable entities;
+
+        StringTable siids;
+
+        std::vector<LockGroup> groups;
+
+        std::unordered_map<std::string, int> groupIndices;
+
+        // Per entity, sorted once the synchronization logs are all added.
+        std::vector<std::vector<BlamedWindow>> windows;
+
+        std::vector<uint64_t> maxWindow;
+
+        bool windowsSorted;
+
+        // State of the log being added.
+        std::unordered_map<uint64_t, ObjectStats> objects;
+
+        std::unordered_map<uint64_t, std::string> labels;
+
+        std::vector<ThreadState> threads;
+
+        bool readSynchronizationLog(const std::string &filename, bool isSecondPass);
+
+        void countOperation(int entity, uint64_t obj, int op, uint64_t start, uint64_t end);
+
+        void blameOperation(int entity, const Field &siid, uint64_t obj, int op, uint64_t start, uint64_t end);
+
+        // Calls blame for the hold interval of each held object whose hold
+        // ends, or pauses for a condition variable wait, with the operation.
+        // Returns true if the operation released an object the thread held,
+        // for heldNs in total.
+        template <typename Blame>
+        bool updateHeld(int entity, uint64_t obj, int op, uint64_t start, uint64_t end,
+                        Blame blame, uint64_t &heldNs);
+
+        void blameHold(int entity, const Field &siid, uint64_t obj, uint64_t start, uint64_t end);
+
+        void blameNotification(int entity, const Field &siid, uint64_t obj, uint64_t time);
+
+        void blame(int group, int entity, int siid, uint64_t start, uint64_t end);
+
+        int groupOf(uint64_t obj, const std::string &pid);
+
+        void mergeObjects();
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "LockProfile.h"
+
+// C libs
+#include <dirent.h>
+#include <unistd.h>
+
+// STL libs
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void usage() {
+    std::cerr << "Usage: LockProfiler [-f function_names_file] [-c contended_ns] [-k top_n] "
+              << "-o report_file latency_dir" << std::endl;
+}
+
+static std::vector<std::string> listLogs(const std::string &dir, const std::string &prefix) {
+    std::vector<std::string> filenames;
+    DIR *dirp = opendir(dir.c_str());
+    if (dirp == nullptr) {
+        return filenames;
+    }
+    while (dirent *entry = readdir(dirp)) {
+        std::string name = entry->d_name;
+        if (name.compare(0, prefix.size(), prefix) == 0) {
+            filenames.push_back(name);
+        }
+    }
+    closedir(dirp);
+    std::sort(filenames.begin(), filenames.end());
+    return filenames;
+}
+
+int main(int argc, char **argv) {
+    std::string funcNamesFile;
+    std::string reportFile;
+    // Acquisitions which take less than this went through the fast path.
+    uint64_t contendedNs = 1000;
+    size_t topN = 10;
+
+    int option;
+    while ((option = getopt(argc, argv, "f:c:k:o:")) != -1) {
+        switch (option) {
+            case 'f':
+                funcNamesFile = optarg;
+                break;
+            case 'c':
+                contendedNs = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 'k':
+                topN = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'o':
+                reportFile = optarg;
+                break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+    if (reportFile.empty() || optind != argc - 1) {
+        usage();
+        return 1;
+    }
+
+    std::string dir = argv[optind];
+    if (dir.back() != '/') {
+        dir += '/';
+    }
+
+    std::vector<std::string> funcNames;
+    if (!funcNamesFile.empty()) {
+        std::ifstream funcNamesStream(funcNamesFile);
+        std::string name;
+        while (getline(funcNamesStream, name)) {
+            funcNames.push_back(name);
+        }
+    }
+
+    LockProfile profile(contendedNs);
+
+    const std::string syncLogPrefix = "SynchronizationLog_";
+    std::vector<std::string> syncLogs = listLogs(dir, syncLogPrefix);
+    if (syncLogs.empty()) {
+        std::cerr << "No synchronization logs in " << dir << std::endl;
+        return 1;
+    }
+    for (const std::string &syncLog : syncLogs) {
+        std::cout << "Reading " << syncLog << std::endl;
+        if (!profile.AddSynchronizationLog(dir + syncLog, syncLog.substr(syncLogPrefix.size()))) {
+            std::cerr << "Could not read " << syncLog << std::endl;
+        }
+    }
+    for (const std::string &functionLog : listLogs(dir, "FunctionLog_")) {
+        std::cout << "Reading " << functionLog << std::endl;
+        if (!profile.AddFunctionLog(dir + functionLog)) {
+            std::cerr << "Could not read " << functionLog << std::endl;
+        }
+    }
+
+    if (!profile.Save(reportFile, funcNames, topN)) {
+        std::cerr << "Could not write " << reportFile << std::endl;
+        return 1;
+    }
+    return 0;
+}
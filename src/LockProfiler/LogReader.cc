@@ -0,0 +1,164 @@
+#include "LogReader.h"
+
+// STL libs
+#include <cstring>
+
+bool Field::Equals(const char *str) const {
+    return strlen(str) == size && memcmp(data, str, size) == 0;
+}
+
+std::string Field::ToString() const {
+    return std::string(data, size);
+}
+
+uint64_t Field::ToInt() const {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] < '0' || data[i] > '9') {
+            return 0;
+        }
+        value = value * 10 + (data[i] - '0');
+    }
+    return value;
+}
+
+uint64_t Field::ToAddress() const {
+    if (size < 3 || data[0] != '0' || data[1] != 'x') {
+        return 0;
+    }
+    uint64_t value = 0;
+    for (size_t i = 2; i < size; i++) {
+        char c = data[i];
+        if (c >= '0' && c <= '9') {
+            value = value * 16 + (c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            value = value * 16 + (c - 'a' + 10);
+        } else {
+            return 0;
+        }
+    }
+    return value;
+}
+
+LogReader::LogReader(const std::string &filename):
+    file(fopen(filename.c_str(), "rb")), buffer(CHUNK_SIZE), begin(0), end(0), isEOF(false) {}
+
+LogReader::~LogReader() {
+    if (file != nullptr) {
+        fclose(file);
+    }
+}
+
+bool LogReader::IsOpen() const {
+    return file != nullptr;
+}
+
+// Moves the unread part of the buffer to its front and reads after it,
+// growing the buffer if a single line does not fit.
+bool LogReader::fill() {
+    if (isEOF) {
+        return false;
+    }
+    memmove(buffer.data(), buffer.data() + begin, end - begin);
+    end -= begin;
+    begin = 0;
+    if (end == buffer.size()) {
+        buffer.resize(buffer.size() * 2);
+    }
+
+    size_t read = fread(buffer.data() + end, 1, buffer.size() - end, file);
+    end += read;
+    if (read == 0) {
+        isEOF = true;
+    }
+    return read > 0;
+}
+
+bool LogReader::Next(std::vector<Field> &fields) {
+    if (file == nullptr) {
+        return false;
+    }
+
+    char *newline;
+    while ((newline = static_cast<char *>(memchr(buffer.data() + begin, '\n', end - begin))) == nullptr) {
+        if (!fill()) {
+            // Last line without a newline.
+            if (begin == end) {
+                return false;
+            }
+            if (end == buffer.size()) {
+                buffer.push_back('\n');
+            } else {
+                buffer[end] = '\n';
+            }
+            end++;
+        }
+    }
+
+    fields.clear();
+    const char *fieldStart = buffer.data() + begin;
+    for (const char *c = fieldStart; c < newline; c++) {
+        if (*c == ',' && fields.size() + 1 < MAX_FIELDS) {
+            fields.emplace_back();
+            fields.back().data = fieldStart;
+            fields.back().size = c - fieldStart;
+            fieldStart = c + 1;
+        }
+    }
+    fields.emplace_back();
+    fields.back().data = fieldStart;
+    fields.back().size = newline - fieldStart;
+
+    begin = newline - buffer.data() + 1;
+    return true;
+}
+
+StringTable::StringTable(): slots(1024, -1) {}
+
+// FNV-1a
+uint64_t StringTable::hash(const char *data, size_t size) {
+    uint64_t value = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        value = (value ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+    }
+    return value;
+}
+
+void StringTable::grow() {
+    std::vector<int> newSlots(slots.size() * 2, -1);
+    for (size_t id = 0; id < strings.size(); id++) {
+        size_t slot = hash(strings[id].data(), strings[id].size()) & (newSlots.size() - 1);
+        while (newSlots[slot] != -1) {
+            slot = (slot + 1) & (newSlots.size() - 1);
+        }
+        newSlots[slot] = id;
+    }
+    slots.swap(newSlots);
+}
+
+int StringTable::Intern(const Field &field) {
+    size_t slot = hash(field.data, field.size) & (slots.size() - 1);
+    while (slots[slot] != -1) {
+        const std::string &str = strings[slots[slot]];
+        if (str.size() == field.size && memcmp(str.data(), field.data, field.size) == 0) {
+            return slots[slot];
+        }
+        slot = (slot + 1) & (slots.size() - 1);
+    }
+
+    int id = strings.size();
+    strings.push_back(field.ToString());
+    slots[slot] = id;
+    if (strings.size() * 2 > slots.size()) {
+        grow();
+    }
+    return id;
+}
+
+const std::string &StringTable::Get(int id) const {
+    return strings[id];
+}
+
+size_t StringTable::Size() const {
+    return strings.size();
+}
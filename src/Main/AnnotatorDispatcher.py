@@ -1,13 +1,16 @@
 import shutil
 import subprocess
 import os
+import filecmp
 from DispatcherBase import Dispatcher
 
 class Annotator(Dispatcher):
     def __init__(self):
         self.disallowedOptions = { 'breakdown': True,
                                    'restore':   True  }
-        self.optionalOptions = { 'root_funcs': None }
+        self.optionalOptions = { 'root_funcs': None,
+                                 'pch':        None,
+                                 'call_graph': None }
         self.requiredOptions = { 'source_dir': None,
                                  'parallelism_functions': None,
                                  'compilation_db': None }
@@ -16,21 +19,58 @@ class Annotator(Dispatcher):
         self.callerbackup = '/tmp/vprof/callerbackup'
         self.backup = '/tmp/vprof/backup'
         self.errorLogName = '/tmp/vprof/annotator.log'
+        # Kept across runs, files instrumented the same way before are replayed.
+        self.instrumentationCache = '/tmp/vprof/cache'
         self.createIfNotExists(self.syncbackup)
         self.createIfNotExists(self.callerbackup)
         self.createIfNotExists(self.backup)
         self.errorLog = open(self.errorLogName, 'a')
+        # Backup list of the previous round, whose files the next instrumentation
+        # parses from their backups.
+        self.previousBackupList = None
 
     def createIfNotExists(self, dirname):
         if not os.path.exists(dirname):
             os.makedirs(dirname)
 
+    # Keep the destination, and so its timestamp, if it is already identical.
+    def copyIfChanged(self, src, dst):
+        if not os.path.exists(dst) or not filecmp.cmp(src, dst, shallow=False):
+            shutil.copyfile(src, dst)
+
+    def moveIfChanged(self, src, dst):
+        self.copyIfChanged(src, dst)
+        os.remove(src)
+
     def getSourceDir(self):
         sourceDir = self.requiredOptions['source_dir']
         if not sourceDir.endswith('/'):
             sourceDir += '/'
         return sourceDir
 
+    # Options TracerInstrumentor is given in every mode which instruments.
+    def getInstrumentorOptions(self):
+        options = '-k ' + self.instrumentationCache
+        if self.optionalOptions['pch']:
+            options += ' -pch ' + self.optionalOptions['pch']
+        if self.optionalOptions['call_graph']:
+            options += ' -g ' + self.optionalOptions['call_graph']
+        if self.previousBackupList:
+            options += ' -P ' + self.previousBackupList
+        return options
+
+    # Builds the static call graph of the whole source tree once, later runs
+    # only load it.
+    def BuildCallGraph(self, funcNamesFile, backup):
+        if not self.optionalOptions['call_graph'] or os.path.exists(self.optionalOptions['call_graph']):
+            return
+        print 'Building the static call graph...'
+        subprocess.call(['TracerInstrumentor -s %s -G -g %s -b %s -n %s %s' %
+                         (self.getSourceDir(), self.optionalOptions['call_graph'], backup, funcNamesFile,
+                          self.requiredOptions['compilation_db'])],
+                        stderr=self.errorLog, shell=True)
+        print 'Call graph written to ' + self.optionalOptions['call_graph'] + '.'
+
     def getFuncNameAndTypes(self, nodeString):
         nodeString = nodeString.split(' [')[0]
         nodeString = nodeString.replace('"', '')
@@ -46,36 +86,71 @@ class Annotator(Dispatcher):
         funcFile = open(funcNamesFile, 'w')
         funcFile.close()
         print 'Instrumenting thread entry functions...'
-        subprocess.call(['TracerInstrumentor -s %s -b %s -n %s -r %s %s' %
-                         (self.getSourceDir(), backup, funcNamesFile,
-                          self.optionalOptions['root_funcs'], self.requiredOptions['compilation_db'])],
+        subprocess.call(['TracerInstrumentor -s %s -b %s -n %s -r %s %s %s' %
+                         (self.getSourceDir(), backup, funcNamesFile, self.optionalOptions['root_funcs'],
+                          self.getInstrumentorOptions(), self.requiredOptions['compilation_db'])],
                         stderr=self.errorLog, shell=True)
         print 'Instrumentation done.'
 
     def AnnotateTargetFunc(self, selectedNode, funcNamesFile, backup, callerbackup):
         print 'Instrumenting target function ' + selectedNode.func + '...'
         if selectedNode.parent:
-            subprocess.call(['TracerInstrumentor -s %s -f %s -c %s -t %d -b %s -e %s -n %s %s' %
+            subprocess.call(['TracerInstrumentor -s %s -f %s -c %s -t %d -b %s -e %s -n %s %s %s' %
                              (self.getSourceDir(), selectedNode.func, selectedNode.parent.func,
                               selectedNode.depth, backup, callerbackup, funcNamesFile,
-                              self.requiredOptions['compilation_db'])],
+                              self.getInstrumentorOptions(), self.requiredOptions['compilation_db'])],
                             stderr=self.errorLog, shell=True)
         else:
-            subprocess.call(['TracerInstrumentor -s %s -f %s -b %s -n %s %s' %
+            subprocess.call(['TracerInstrumentor -s %s -f %s -b %s -n %s %s %s' %
                              (self.getSourceDir(), selectedNode.func, backup, funcNamesFile,
-                              self.requiredOptions['compilation_db'])],
+                              self.getInstrumentorOptions(), self.requiredOptions['compilation_db'])],
                             stderr=self.errorLog, shell=True)
 
         print 'Instrumentation done.'
 
+    # Instruments targetFunc and every function down to depth levels below it
+    # in one pass, at most limit functions if it is set. Returns the target ID
+    # of each instrumented function.
+    def AnnotateMultiTarget(self, targetFunc, depth, funcNamesFile, backup, limit=None):
+        print 'Instrumenting ' + targetFunc + ' and its callees down to depth ' + str(depth) + '...'
+        limitOption = '' if limit is None else '-l %d ' % limit
+        subprocess.call(['TracerInstrumentor -s %s -m %s -d %d %s-b %s -n %s %s %s' %
+                         (self.getSourceDir(), targetFunc, depth, limitOption, backup, funcNamesFile,
+                          self.getInstrumentorOptions(), self.requiredOptions['compilation_db'])],
+                        stderr=self.errorLog, shell=True)
+
+        targetIDs = {}
+        if os.path.exists(funcNamesFile + '.targets'):
+            with open(funcNamesFile + '.targets', 'r') as targetsFile:
+                for line in targetsFile:
+                    targetID, name = line.strip().split('\t')
+                    targetIDs[name] = int(targetID)
+        print 'Instrumentation done.'
+        return targetIDs
+
+    # Only lists the callees of the selected function for the XRay tracer,
+    # which patches them in the running binary, so nothing is rebuilt.
+    def AnnotateXRayTarget(self, selectedNode, funcNamesFile, backup):
+        print 'Listing the callees of ' + selectedNode.func + ' for the XRay tracer...'
+        subprocess.call(['TracerInstrumentor -s %s -x -f %s -b %s -n %s %s %s' %
+                         (self.getSourceDir(), selectedNode.func, backup, funcNamesFile,
+                          self.getInstrumentorOptions(), self.requiredOptions['compilation_db'])],
+                        stderr=self.errorLog, shell=True)
+        print 'Listing done.'
+
     def Dispatch(self, instrumentSynchro=True, targetFunc=''):
         print 'Instrumenting synchronization APIs...'
         subprocess.call(['EventAnnotator -s %s -f %s -b %s %s' % (self.getSourceDir(), self.requiredOptions['parallelism_functions'],
                         self.syncbackup, self.requiredOptions['compilation_db'])], stderr=self.errorLog, shell=True)
         cwd = os.path.dirname(os.path.realpath(__file__))
         self.createIfNotExists('./vprof_files')
-        shutil.copyfile(cwd + '/../ExecutionTimeTracer/trace_tool.cc', './vprof_files/trace_tool.cc')
-        shutil.copyfile(cwd + '/../ExecutionTimeTracer/trace_tool.h', './vprof_files/trace_tool.h')
-        shutil.move('./VProfEventWrappers.cc', './vprof_files/VProfEventWrappers.cc')
-        shutil.move('./VProfEventWrappers.h', './vprof_files/VProfEventWrappers.h')
+        self.copyIfChanged(cwd + '/../ExecutionTimeTracer/trace_tool.cc', './vprof_files/trace_tool.cc')
+        self.copyIfChanged(cwd + '/../ExecutionTimeTracer/trace_tool.h', './vprof_files/trace_tool.h')
+        self.copyIfChanged(cwd + '/../ExecutionTimeTracer/xray_tracer.cc', './vprof_files/xray_tracer.cc')
+        self.copyIfChanged(cwd + '/../ExecutionTimeTracer/alloc_tracer.cc', './vprof_files/alloc_tracer.cc')
+        self.moveIfChanged('./VProfEventWrappers.cc', './vprof_files/VProfEventWrappers.cc')
+        self.moveIfChanged('./VProfEventWrappers.h', './vprof_files/VProfEventWrappers.h')
         print 'Instrumentation done, please integrate the files in vprof_files to your application.'
+        print 'Build with -DVPROF_ENABLED=0 to compile the instrumentation out without restoring the sources.'
+        print 'To use --xray, build with clang -fxray-instrument and link xray_tracer.cc as well.'
+        print 'Link alloc_tracer.cc as well to break the time spent in the allocator out of every function.'
@@ -8,14 +8,52 @@ class Breakdown(Dispatcher):
     def __init__(self):
         self.disallowedOptions = { 'annotate': True,
                                    'restore':  True  }
-        self.optionalOptions = {}
+        self.optionalOptions = { 'tail_quantile': None,
+                                 'window_ms':     None,
+                                 'bootstrap':     None }
         self.requiredOptions = { 'num_factors':   None }
 
+    def ParseOptions(self, options):
+        if not super(Breakdown, self).ParseOptions(options):
+            return False
+        # The tail breakdown replaces the variance breakdown, which is the one
+        # windowed and bootstrapped.
+        if self.optionalOptions['tail_quantile']:
+            for option in ['window_ms', 'bootstrap']:
+                if self.optionalOptions[option]:
+                    print '--tail_quantile cannot be used with --' + option
+                    return False
+        return True
+
     def Dispatch(self, funcNamesFile, dataDir, varTree, selectedNode):
-        VarBreaker.breakDown(funcNamesFile, dataDir, selectedNode)
+        if self.optionalOptions['tail_quantile']:
+            VarBreaker.tailBreakDown(funcNamesFile, dataDir, selectedNode,
+                                     float(self.optionalOptions['tail_quantile']))
+        else:
+            windowSize = None
+            if self.optionalOptions['window_ms']:
+                windowSize = int(float(self.optionalOptions['window_ms']) * 1000000)
+            numResamples = int(self.optionalOptions['bootstrap'] or 0)
+            timeSeries = VarBreaker.breakDown(funcNamesFile, dataDir, selectedNode, windowSize,
+                                              int(self.requiredOptions['num_factors']),
+                                              numResamples)
+            self.PrintTimeSeries(timeSeries)
         selectedFuncs = varTree.selectFactors(self.requiredOptions['num_factors'])
         index = 0
         for node in selectedFuncs:
-            print '[' + str(index) + '] ' + node.func + ':' + str(node.perct)
+            if node.ciLow is None:
+                print '[' + str(index) + '] ' + node.label + ':' + str(node.perct)
+            else:
+                print '[' + str(index) + '] ' + node.label + ':' + str(node.perct) + \
+                      ' [' + str(node.ciLow) + ', ' + str(node.ciHigh) + ']'
             index += 1
         return selectedFuncs
+
+    def PrintTimeSeries(self, timeSeries):
+        if timeSeries is None:
+            return
+        print 'Top factors per window (start ns, intervals, latency variance):'
+        for windowStart, count, varLatency, factors in timeSeries:
+            print str(windowStart) + ', ' + str(count) + ', ' + str(varLatency)
+            for factor, perct in factors:
+                print '    ' + factor + ':' + str(perct)
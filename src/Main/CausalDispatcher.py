@@ -0,0 +1,89 @@
+import os
+import shutil
+import subprocess
+
+from FactorSelector import CausalProfile
+from FactorSelector import VarBreaker
+from FactorSelector import VarTree
+from DispatcherBase import Dispatcher
+
+class Causal(Dispatcher):
+    def __init__(self):
+        self.disallowedOptions = { 'annotate':  True,
+                                   'breakdown': True,
+                                   'restore':   True  }
+        self.optionalOptions = { 'func_names_file': '/tmp/vprof/funcNames',
+                                 'speedup_funcs':   None,
+                                 'speedups':        None,
+                                 'experiment_ms':   None,
+                                 'num_factors':     5,
+                                 'report':          None }
+        self.requiredOptions = { 'run_script': None }
+
+        super(Causal, self).__init__(self.disallowedOptions, self.optionalOptions, self.requiredOptions)
+
+    def ParseOptions(self, options):
+        defaults = dict(self.optionalOptions)
+        success = super(Causal, self).ParseOptions(options)
+        for option, value in self.optionalOptions.iteritems():
+            if value is None:
+                self.optionalOptions[option] = defaults[option]
+        return success
+
+    # Indices of the functions to speed up in the function names file. Unless
+    # given, they are the callees contributing the most variance in the last
+    # run, or all callees if it left no data.
+    def __Candidates(self, funcNames, dataDir):
+        if self.optionalOptions['speedup_funcs']:
+            return [int(index) for index in self.optionalOptions['speedup_funcs'].split(',')]
+
+        candidates = []
+        if os.path.exists(dataDir + 'latency'):
+            root = VarTree.VarNode('', None, 0, 100)
+            VarBreaker.breakDown(self.optionalOptions['func_names_file'], dataDir + 'latency/', root)
+            factors = [child for child in root.children
+                       if type(child) is VarTree.VarNode and child.func in funcNames[1:]]
+            factors.sort(key=lambda x: x.perct, reverse=True)
+            candidates = [funcNames.index(factor.func) for factor in factors]
+        if len(candidates) == 0:
+            candidates = range(1, len(funcNames))
+        return candidates[:int(self.optionalOptions['num_factors'])]
+
+    def Dispatch(self):
+        dataDir = '/tmp/vprof/'
+        with open(self.optionalOptions['func_names_file'], 'r') as funcNamesFile:
+            funcNames = [function.strip() for function in funcNamesFile]
+
+        curves = []
+        for index in self.__Candidates(funcNames, dataDir):
+            print 'Virtually speeding up ' + funcNames[index] + '...'
+            runEnv = os.environ.copy()
+            runEnv['VPROF_SPEEDUP_INDEX'] = str(index)
+            if self.optionalOptions['speedups'] is not None:
+                runEnv['VPROF_SPEEDUPS'] = self.optionalOptions['speedups']
+            if self.optionalOptions['experiment_ms'] is not None:
+                runEnv['VPROF_EXPERIMENT_MS'] = self.optionalOptions['experiment_ms']
+
+            if os.path.exists(dataDir + 'latency'):
+                shutil.rmtree(dataDir + 'latency')
+            subprocess.call([self.requiredOptions['run_script'], dataDir], env=runEnv)
+
+            curve = CausalProfile.speedupCurve(dataDir + 'latency/')
+            curves.append((funcNames[index], curve))
+            self.PrintCurve(funcNames[index], curve)
+
+        if self.optionalOptions['report'] is not None:
+            with open(self.optionalOptions['report'], 'w') as report:
+                report.write('factor, speedup %, intervals, mean latency, p99 latency, ' \
+                             'mean impact %, p99 impact %\n')
+                for factor, curve in curves:
+                    for point in curve:
+                        report.write(factor + ', ' + ', '.join(str(value) for value in point) + '\n')
+            print 'Speedup curves written to ' + self.optionalOptions['report']
+        return curves
+
+    def PrintCurve(self, factor, curve):
+        print factor + ': speedup -> mean impact, p99 impact (intervals)'
+        for speedup, count, _, _, meanImpact, tailImpact in curve:
+            print '    ' + str(speedup) + '% -> ' + str(meanImpact) + '%, ' + str(tailImpact) + \
+                  '% (' + str(count) + ')'
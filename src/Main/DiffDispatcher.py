@@ -0,0 +1,40 @@
+import os
+
+from FactorSelector import VarBreaker
+from DispatcherBase import Dispatcher
+
+class Diff(Dispatcher):
+    def __init__(self):
+        self.disallowedOptions = { 'annotate':  True,
+                                   'breakdown': True,
+                                   'restore':   True  }
+        self.optionalOptions = { 'func_names_file': '/tmp/vprof/funcNames',
+                                 'num_resamples':   200,
+                                 'num_factors':     10 }
+        self.requiredOptions = { 'baseline_dir': None,
+                                 'compare_dir':  None  }
+
+        super(Diff, self).__init__(self.disallowedOptions, self.optionalOptions, self.requiredOptions)
+
+    def ParseOptions(self, options):
+        defaults = dict(self.optionalOptions)
+        success = super(Diff, self).ParseOptions(options)
+        for option, value in self.optionalOptions.iteritems():
+            if value is None:
+                self.optionalOptions[option] = defaults[option]
+        return success
+
+    def Dispatch(self):
+        baseDataDir = os.path.join(self.requiredOptions['baseline_dir'], '')
+        newDataDir = os.path.join(self.requiredOptions['compare_dir'], '')
+        diffs = VarBreaker.diffBreakDown(self.optionalOptions['func_names_file'],
+                                         baseDataDir, newDataDir,
+                                         int(self.optionalOptions['num_resamples']))
+
+        print 'Factor: baseline -> compared, delta [95% interval]'
+        index = 0
+        for factor, base, new, delta, deltaLow, deltaHigh in diffs[:int(self.optionalOptions['num_factors'])]:
+            print '[' + str(index) + '] ' + factor + ': ' + str(base) + ' -> ' + str(new) + \
+                  ', ' + str(delta) + ' [' + str(deltaLow) + ', ' + str(deltaHigh) + ']'
+            index += 1
+        return diffs
@@ -0,0 +1,29 @@
+from TraceExporter import ChromeTraceExporter
+from DispatcherBase import Dispatcher
+
+class Export(Dispatcher):
+    def __init__(self):
+        self.disallowedOptions = { 'annotate':  True,
+                                   'breakdown': True,
+                                   'restore':   True  }
+        self.optionalOptions = { 'func_names_file': '/tmp/vprof/funcNames',
+                                 'trace_dir':       '/tmp/vprof/latency',
+                                 'critical_path':   False }
+        self.requiredOptions = { 'export_trace': None }
+
+        super(Export, self).__init__(self.disallowedOptions, self.optionalOptions, self.requiredOptions)
+
+    def ParseOptions(self, options):
+        defaults = dict(self.optionalOptions)
+        success = super(Export, self).ParseOptions(options)
+        for option, value in self.optionalOptions.iteritems():
+            if value is None:
+                self.optionalOptions[option] = defaults[option]
+        return success
+
+    def Dispatch(self):
+        ChromeTraceExporter.Export(self.optionalOptions['trace_dir'],
+                                   self.optionalOptions['func_names_file'],
+                                   self.requiredOptions['export_trace'],
+                                   self.optionalOptions['critical_path'])
+        print 'Trace written to ' + self.requiredOptions['export_trace']
@@ -1,6 +1,7 @@
 import subprocess
 import os
 import shutil
+import time
 
 from FactorSelector import VarTree
 from DispatcherBase import Dispatcher
@@ -11,7 +12,19 @@ from RestoreDispatcher import Restore
 class Full(Dispatcher):
     def __init__(self):
         self.disallowedOptions = {}
-        self.optionalOptions = {'target_func': None}
+        self.optionalOptions = { 'target_func':  None,
+                                 'multi_depth':  None,
+                                 'multi_limit':  None,
+                                 'xray':         False,
+                                 'auto':         False,
+                                 'time_budget':  None,
+                                 'min_variance': None,
+                                 'report':       None,
+                                 'keep_quantile': None,
+                                 'baseline_rate': None,
+                                 'cpu_time': None,
+                                 'perf_events': None,
+                                 'disable_fraction': None }
         self.requiredOptions = { 'build_script': None,
                                  'run_script':   None  }
 
@@ -25,6 +38,19 @@ class Full(Dispatcher):
     def ParseOptions(self, options):
         success = super(Full, self).ParseOptions(options)
 
+        if success and self.optionalOptions['multi_depth'] is not None:
+            self.optionalOptions['multi_depth'] = int(self.optionalOptions['multi_depth'])
+
+        if success and self.optionalOptions['multi_limit'] is not None:
+            self.optionalOptions['multi_limit'] = int(self.optionalOptions['multi_limit'])
+
+        if success and self.optionalOptions['auto']:
+            # Budget in minutes, threshold in percent of the total variance.
+            budget = self.optionalOptions['time_budget']
+            self.optionalOptions['time_budget'] = None if budget is None else float(budget) * 60
+            self.optionalOptions['min_variance'] = float(self.optionalOptions['min_variance'] or 5)
+            self.optionalOptions['report'] = self.optionalOptions['report'] or 'vprof_report.txt'
+
         return success and self.annotator.ParseOptions(options) \
                and self.breakdown.ParseOptions(options)
 
@@ -77,6 +103,58 @@ class Full(Dispatcher):
 
         return selectedFunctions[nextTarg]
 
+    # Picks the explorable leaf of the whole tree with the largest share of the
+    # total variance, so that other subtrees are explored once the current one
+    # only has small factors left. Returns None when the search should stop.
+    def __AutoNextTarget(self, varTree, explored, targetIDs, startTime, iterationTime):
+        budget = self.optionalOptions['time_budget']
+        if budget is not None and time.time() - startTime + iterationTime > budget:
+            print 'Time budget reached.'
+            return None
+
+        candidates = [node for node in varTree.getExplorableLeaves(explored)
+                      if node.absolutePerct >= self.optionalOptions['min_variance']]
+        if len(candidates) == 0:
+            print 'No factor left above ' + str(self.optionalOptions['min_variance']) + \
+                  '% of the total variance.'
+            return None
+
+        # Every candidate is explored eventually, so the ones instrumented in
+        # the current build go first, since they only need a rerun.
+        for node in candidates:
+            if self.__TargetName(node.func) in targetIDs:
+                return node
+        return candidates[0]
+
+    def __WriteReport(self, varTree, explored):
+        leaves = [leaf for leaf in varTree.getLeaves() if leaf is not varTree.root]
+        leaves.sort(key=lambda x: x.absolutePerct, reverse=True)
+
+        with open(self.optionalOptions['report'], 'w') as report:
+            report.write('Rank, % of total variance, % of parent, factor, call path\n')
+            rank = 0
+            for leaf in leaves:
+                path = []
+                node = leaf.parent
+                while node is not None:
+                    path.insert(0, node.func)
+                    node = node.parent
+                perct = str(leaf.perct)
+                if leaf.ciLow is not None:
+                    perct += ' [' + str(leaf.ciLow) + ', ' + str(leaf.ciHigh) + ']'
+                note = ' (no breakdown)' if leaf.func in explored else ''
+                report.write(str(rank) + ', ' + str(leaf.absolutePerct) + ', ' + perct + ', ' +
+                             leaf.label + note + ', ' + ' > '.join(path) + '\n')
+                rank += 1
+        print 'Ranked factors written to ' + self.optionalOptions['report']
+
+    # Name of the function a node refers to without its index in the caller,
+    # as TracerInstrumentor writes it in the targets file.
+    def __TargetName(self, func):
+        nameAndArgs = func.split('|')
+        nameAndArgs[0] = nameAndArgs[0].split('-')[0]
+        return '|'.join(nameAndArgs)
+
     def Dispatch(self):
         instrumentSynchro = True
         syncbackup = '/tmp/vprof/syncbackup'
@@ -86,9 +164,36 @@ class Full(Dispatcher):
         dataDir = "/tmp/vprof/"
         varTree = VarTree.Tree(self.optionalOptions['target_func'])
         selectedNode = varTree.root
+        # Functions instrumented in the current build with multi_depth, mapped
+        # to their target IDs. Selecting one of them only needs a rerun.
+        targetIDs = {}
+        needsBuild = True
+        # Functions already broken down by the automatic search.
+        explored = set()
+        startTime = time.time()
+
+        self.annotator.BuildCallGraph(funcNamesFile, backup)
 
         while True:
-            if selectedNode.func is None:
+            iterationStart = time.time()
+            runEnv = os.environ.copy()
+            nodeFuncNamesFile = funcNamesFile
+            targetName = None if selectedNode.func is None else self.__TargetName(selectedNode.func)
+
+            if targetName is not None and self.optionalOptions['xray']:
+                self.annotator.AnnotateXRayTarget(selectedNode, funcNamesFile, backup)
+                runEnv['VPROF_XRAY_TARGET'] = funcNamesFile
+            elif targetName is not None and targetName in targetIDs:
+                print 'Selecting the already instrumented ' + targetName + ', no rebuild needed.'
+            elif selectedNode.func is not None and self.optionalOptions['multi_depth'] is not None:
+                targetIDs = self.annotator.AnnotateMultiTarget(
+                    targetName,
+                    self.optionalOptions['multi_depth'],
+                    funcNamesFile,
+                    backup,
+                    self.optionalOptions['multi_limit']
+                )
+            elif selectedNode.func is None:
                 self.annotator.AnnotateWithoutTarget(
                     selectedNode,
                     funcNamesFile,
@@ -102,22 +207,62 @@ class Full(Dispatcher):
                     callerbackup,
                 )
 
-            subprocess.call([self.requiredOptions['build_script']])
+            if self.annotator.previousBackupList is not None:
+                self.annotator.previousBackupList = None
+                self.restore.MergeSetAsideBackupList(backup)
+
+            if targetName is not None and targetName in targetIDs:
+                runEnv['VPROF_TARGET'] = str(targetIDs[targetName])
+                nodeFuncNamesFile = funcNamesFile + '.' + str(targetIDs[targetName])
+            if self.optionalOptions['keep_quantile'] is not None:
+                runEnv['VPROF_TAIL_QUANTILE'] = self.optionalOptions['keep_quantile']
+                if self.optionalOptions['baseline_rate'] is not None:
+                    runEnv['VPROF_BASELINE_RATE'] = self.optionalOptions['baseline_rate']
+            if self.optionalOptions['cpu_time'] is not None:
+                runEnv['VPROF_CPU_TIME'] = self.optionalOptions['cpu_time']
+            if self.optionalOptions['perf_events'] is not None:
+                runEnv['VPROF_PERF_EVENTS'] = self.optionalOptions['perf_events']
+            if self.optionalOptions['disable_fraction'] is not None:
+                runEnv['VPROF_DISABLE_FRACTION'] = self.optionalOptions['disable_fraction']
+
+            if needsBuild:
+                subprocess.call([self.requiredOptions['build_script']])
 
             if os.path.exists(dataDir + 'latency'):
                 shutil.rmtree(dataDir + 'latency')
-            subprocess.call([self.requiredOptions['run_script'], dataDir])
+            subprocess.call([self.requiredOptions['run_script'], dataDir], env=runEnv)
 
-            selectedFunctions = self.breakdown.Dispatch(funcNamesFile, dataDir + 'latency/',
+            selectedFunctions = self.breakdown.Dispatch(nodeFuncNamesFile, dataDir + 'latency/',
                                                         varTree, selectedNode)
 
-            if self.__AreDone():
+            explored.add(selectedNode.func)
+
+            previousNode = selectedNode
+            if self.optionalOptions['auto']:
+                selectedNode = self.__AutoNextTarget(varTree, explored, targetIDs, startTime,
+                                                     time.time() - iterationStart)
+                done = selectedNode is None
+            else:
+                done = self.__AreDone()
+                if not done:
+                    selectedNode = self.__GetNextTargetFunc(selectedFunctions)
+
+            if done:
                 break
             else:
                 # instrumentSynchro = False
                 # self.restore.Run(restoreTracer = True, restoreSynchro = False)
-                selectedNode = self.__GetNextTargetFunc(selectedFunctions)
-                self.restore.RestoreFromBackup(backup)
+                # With XRay only the sources of a run without target were changed.
+                if self.optionalOptions['xray']:
+                    needsBuild = previousNode.func is None
+                else:
+                    needsBuild = self.__TargetName(selectedNode.func) not in targetIDs
+                if needsBuild:
+                    targetIDs = {}
+                    self.annotator.previousBackupList = self.restore.SetAsideBackupList(backup)
+
+        if self.optionalOptions['auto']:
+            self.__WriteReport(varTree, explored)
 
         print 'Restoring annotated files...'
         self.restore.Dispatch(backup, callerbackup, syncbackup)
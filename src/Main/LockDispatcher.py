@@ -0,0 +1,62 @@
+import os
+import subprocess
+
+from FactorSelector import LockProfile
+from DispatcherBase import Dispatcher
+
+class Lock(Dispatcher):
+    def __init__(self):
+        self.disallowedOptions = { 'annotate':  True,
+                                   'breakdown': True,
+                                   'restore':   True  }
+        self.optionalOptions = { 'func_names_file': '/tmp/vprof/funcNames',
+                                 'trace_dir':       '/tmp/vprof/latency',
+                                 'contended_ns':    None,
+                                 'num_factors':     5,
+                                 'report':          '/tmp/vprof/lock_profile' }
+        self.requiredOptions = { 'lock_profile': None }
+
+        super(Lock, self).__init__(self.disallowedOptions, self.optionalOptions, self.requiredOptions)
+
+    def ParseOptions(self, options):
+        defaults = dict(self.optionalOptions)
+        success = super(Lock, self).ParseOptions(options)
+        for option, value in self.optionalOptions.iteritems():
+            if value is None:
+                self.optionalOptions[option] = defaults[option]
+        return success
+
+    def Dispatch(self):
+        command = ['LockProfiler', '-k', str(self.optionalOptions['num_factors']),
+                   '-o', self.optionalOptions['report']]
+        if os.path.exists(self.optionalOptions['func_names_file']):
+            command += ['-f', self.optionalOptions['func_names_file']]
+        if self.optionalOptions['contended_ns'] is not None:
+            command += ['-c', self.optionalOptions['contended_ns']]
+        if subprocess.call(command + [self.optionalOptions['trace_dir']]) != 0:
+            print 'Could not build the lock contention profile of ' + self.optionalOptions['trace_dir']
+            return None
+
+        groups = LockProfile.readLockProfile(self.optionalOptions['report'])
+        for group in groups[:int(self.optionalOptions['num_factors'])]:
+            self.PrintGroup(group)
+        print 'Lock contention profile written to ' + self.optionalOptions['report']
+        return groups
+
+    def PrintGroup(self, group):
+        ms = lambda ns: '%.3f ms' % (ns / 1e6)
+
+        print group.label + ' (' + group.kind + ', ' + str(group.objects) + ' objects): ' + \
+              str(group.contended) + ' of ' + str(group.acquisitions) + ' acquisitions contended, by ' + \
+              str(group.waiterThreads) + ' threads, at most ' + str(group.maxWaiters) + ' at once'
+        print '    wait p50 < ' + ms(group.p50Wait) + ', p99 < ' + ms(group.p99Wait) + \
+              ', max ' + ms(group.maxWait) + ', contended ' + ms(group.contendedWaitNs) + ' in total'
+        if group.kind != 'cv':
+            print '    hold p50 < ' + ms(group.p50Hold) + ', p99 < ' + ms(group.p99Hold) + \
+                  ', max ' + ms(group.maxHold) + ', ' + ms(group.holdNs) + ' in total'
+        for title, blamed in [('holder threads', group.blamedThreads),
+                              ('semantic intervals', group.blamedIntervals),
+                              ('functions', group.blamedFunctions)]:
+            if len(blamed) > 0:
+                print '    waits blamed on ' + title + ': ' + \
+                      ', '.join(name + ' ' + ms(ns) for name, ns in blamed)
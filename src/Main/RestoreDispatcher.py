@@ -8,9 +8,13 @@ class Restore(Dispatcher):
         self.optionalOptions = {}
         self.requiredOptions = {}
 
-    def RestoreFromBackup(self, backup):
-        restorer = Restorer.Restorer(backup)
-        restorer.Run('TracerFilenames')
+    # The instrumentor restores the files of the returned list it does not
+    # instrument again.
+    def SetAsideBackupList(self, backup):
+        return Restorer.Restorer(backup).SetAside('TracerFilenames')
+
+    def MergeSetAsideBackupList(self, backup):
+        Restorer.Restorer(backup).MergeSetAside('TracerFilenames')
 
     def Dispatch(self, backup, callerbackup, syncbackup):
         restorer = Restorer.Restorer(backup)
@@ -1,6 +1,7 @@
 import os
 import shutil
 import csv
+import filecmp
 
 class Restorer:
     def __init__(self, backupDir):
@@ -8,6 +9,12 @@ class Restorer:
         if not self.backupDir.endswith('/'):
             self.backupDir += '/'
 
+    def __ReadFilenames(self, filenamesListFname):
+        if not os.path.exists(self.backupDir + filenamesListFname):
+            return []
+        with open(self.backupDir + filenamesListFname, 'rb') as fnamesList:
+            return list(csv.reader(fnamesList, delimiter='\t'))
+
     def Run(self, filenamesListFname, doDelete=False):
         if not os.path.exists(self.backupDir + filenamesListFname):
             return
@@ -15,9 +22,41 @@ class Restorer:
             filenameReader = reversed(list(csv.reader(fnamesList, delimiter='\t')))
 
             for line in filenameReader:
-                shutil.copyfile(line[0], line[1])
+                # Leave files that already match their backup untouched so
+                # that the build does not see them as modified.
+                if not os.path.exists(line[1]) or not filecmp.cmp(line[0], line[1], shallow=False):
+                    shutil.copyfile(line[0], line[1])
                 if doDelete:
                     os.remove(line[0])
 
         if doDelete:
             os.remove(self.backupDir + filenamesListFname)
+
+    # Moves the backup list aside for the next round of instrumentation, which
+    # parses its files from their backups instead of having them restored
+    # first, so that files instrumented the same way again are not written and
+    # are not rebuilt. Returns the path of the moved list, None if there is
+    # none.
+    def SetAside(self, filenamesListFname):
+        if not os.path.exists(self.backupDir + filenamesListFname):
+            return None
+        previousList = self.backupDir + filenamesListFname + '.previous'
+        os.rename(self.backupDir + filenamesListFname, previousList)
+        return previousList
+
+    # Appends the lines of the list set aside for the files the new list does
+    # not have, so that their backups stay listed even if the instrumentor
+    # could not restore them.
+    def MergeSetAside(self, filenamesListFname):
+        previousList = self.backupDir + filenamesListFname + '.previous'
+        if not os.path.exists(previousList):
+            return
+        lines = self.__ReadFilenames(filenamesListFname)
+        listed = set(line[1] for line in lines if len(line) == 2)
+        with open(self.backupDir + filenamesListFname, 'ab') as fnamesList:
+            writer = csv.writer(fnamesList, delimiter='\t', lineterminator='\n')
+            for line in self.__ReadFilenames(filenamesListFname + '.previous'):
+                if len(line) == 2 and line[1] not in listed:
+                    writer.writerow(line)
+                    listed.add(line[1])
+        os.remove(previousList)
@@ -9,6 +9,10 @@ void VProfVisitor::fixFunction(const CallExpr *call, const std::string &function
     std::string newCall = (*functions)[functionName] + "(";
     std::vector<const Expr*> args;
 
+    if (labelsObject(functionName)) {
+        newCall += getCallSite(call) + ", ";
+    }
+
     if (isMemberCall) {
         const CXXMemberCallExpr *memCall = static_cast<const CXXMemberCallExpr*>(call);
         Expr *obj = memCall->getImplicitObjectArgument();
@@ -57,6 +61,30 @@ bool VProfVisitor::shouldCreateNewPrototype(const std::string &functionName) {
     return prototypeMap->find(functionName) == prototypeMap->end();
 }
 
+bool VProfVisitor::labelsObject(const std::string &functionName) {
+    auto operation = operations->find(functionName);
+    return operation != operations->end() &&
+           (operation->second == "MUTEX_INIT" || operation->second == "CV_INIT");
+}
+
+std::string VProfVisitor::getCallSite(const CallExpr *call) {
+    SourceManager &sourceMgr = rewriter->getSourceMgr();
+    PresumedLoc loc = sourceMgr.getPresumedLoc(sourceMgr.getExpansionLoc(call->getLocStart()));
+    std::string site;
+    if (loc.isValid()) {
+        site = std::string(loc.getFilename()) + ":" + std::to_string(loc.getLine());
+    }
+
+    std::string literal = "\"";
+    for (char c : site) {
+        if (c == '"' || c == '\\') {
+            literal += '\\';
+        }
+        literal += c;
+    }
+    return literal + "\"";
+}
+
 // TODO change name to getParamDeclAsString
 std::string VProfVisitor::getEntireParamDeclAsString(const ParmVarDecl *decl) {
     return decl->getType().getAsString() + " " + decl->getNameAsString();
@@ -72,6 +100,14 @@ void VProfVisitor::createNewPrototype(const FunctionDecl *decl,
     newPrototype.returnType = decl->getReturnType().getAsString();
     newPrototype.functionPrototype += newPrototype.returnType + " " + (*functions)[functionName] + "(";
 
+    if (labelsObject(functionName)) {
+        bool hasObj = isMemberFunc && !static_cast<const CXXMethodDecl*>(decl)->isStatic();
+        newPrototype.functionPrototype += "const char *vprofSite";
+        if (hasObj || decl->getNumParams() > 0) {
+            newPrototype.functionPrototype += ", ";
+        }
+    }
+
     bool isCXXMethodAndNotStatic = false;
     if (isMemberFunc) {
         const CXXMethodDecl *methodDecl = static_cast<const CXXMethodDecl*>(decl);
@@ -153,11 +189,13 @@ bool VProfVisitor::VisitCXXMemberCallExpr(const CXXMemberCallExpr *call) {
 VProfVisitor::VProfVisitor(clang::CompilerInstance &ci, 
                            std::shared_ptr<clang::Rewriter> _rewriter,
                            std::shared_ptr<std::unordered_map<std::string, std::string>> _functions,
+                           std::shared_ptr<std::unordered_map<std::string, std::string>> _operations,
                            std::shared_ptr<std::unordered_map<std::string, FunctionPrototype>> _protoMap,
                            std::shared_ptr<bool> _shouldFlush):
                            astContext(&ci.getASTContext()), 
                            rewriter(_rewriter), 
                            functions(_functions), 
+                           operations(_operations),
                            prototypeMap(_protoMap),
                            shouldFlush(_shouldFlush) {
 
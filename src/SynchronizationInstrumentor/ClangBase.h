@@ -38,6 +38,9 @@ class VProfVisitor : public clang::RecursiveASTVisitor<VProfVisitor> {
         // name to which the key functions should be converted to in the source.
         std::shared_ptr<std::unordered_map<std::string, std::string>> functions;
 
+        // Hash map of fully qualified function names to their operation.
+        std::shared_ptr<std::unordered_map<std::string, std::string>> operations;
+
         // Hash map of fully qualified function names to the new function prototypes
         // to be generated by the wrapper generator.  After ParseAST is called on
         // a source file, newPrototypes should have an entry for each function
@@ -63,11 +66,20 @@ class VProfVisitor : public clang::RecursiveASTVisitor<VProfVisitor> {
 
         bool shouldCreateNewPrototype(const std::string &functionName);
 
+        // Whether the wrapper of the function labels the object it initializes
+        // with the file and line of the call, which is then passed as its first
+        // argument.
+        bool labelsObject(const std::string &functionName);
+
+        // String literal of the file and line of the call.
+        std::string getCallSite(const clang::CallExpr *call);
+
     public:
         // Not sure how I should break the last line up style-wise
         explicit VProfVisitor(clang::CompilerInstance &ci, 
                               std::shared_ptr<clang::Rewriter> _rewriter,
                               std::shared_ptr<std::unordered_map<std::string, std::string>> _functions,
+                              std::shared_ptr<std::unordered_map<std::string, std::string>> _operations,
                               std::shared_ptr<std::unordered_map<std::string, FunctionPrototype>>
                               _prototypeMap,
                               std::shared_ptr<bool> _shouldFlush);
@@ -100,6 +112,7 @@ class VProfASTConsumer : public clang::ASTConsumer {
         explicit VProfASTConsumer(clang::CompilerInstance &ci, 
                                   std::shared_ptr<clang::Rewriter> _rewriter,
                                   std::shared_ptr<std::unordered_map<std::string, std::string>> _functions,
+                                  std::shared_ptr<std::unordered_map<std::string, std::string>> operations,
                                   std::shared_ptr<std::unordered_map<std::string, FunctionPrototype>> prototypeMap,
                                   std::string _filename,
                                   std::shared_ptr<bool> _shouldFlush): 
@@ -111,6 +124,7 @@ class VProfASTConsumer : public clang::ASTConsumer {
             visitor = std::unique_ptr<VProfVisitor>(new VProfVisitor(ci, 
                                                                      rewriter, 
                                                                      functions, 
+                                                                     operations,
                                                                      prototypeMap,
                                                                      shouldFlush));
         }
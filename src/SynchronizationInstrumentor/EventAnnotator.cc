@@ -65,6 +65,7 @@ int main(int argc, const char **argv) {
     shared_ptr<unordered_map<string, FunctionPrototype>> prototypeMap = make_shared<unordered_map<string, FunctionPrototype>>();
 
     EventAnnotatorTool.run(newVProfFrontendActionFactory(funcFileReader.GetFunctionMap(),
+                                                         funcFileReader.GetOperationMap(),
                                                          prototypeMap, BackupDir).get());
     
     WrapperGenerator wrapperGenerator(prototypeMap, funcFileReader.GetOperationMap());
@@ -1,5 +1,8 @@
 #include "Utils.h"
 
+#include <fstream>
+#include <iterator>
+
 // Credit to Evan Teran on stackoverflow for this solution. Find it at
 // https://www.stackoverflow.com/questions/236129/split-a-string-in-c.
 template<typename Out>
@@ -44,3 +47,19 @@ std::string execute(const std::string &command) {
 
     return result;
 }
+
+bool WriteFileIfChanged(const std::string &filename, const std::string &content) {
+    std::ifstream inputFile(filename, std::ios::binary);
+    if (inputFile) {
+        std::string oldContent((std::istreambuf_iterator<char>(inputFile)),
+                               std::istreambuf_iterator<char>());
+        if (oldContent == content) {
+            return true;
+        }
+    }
+    inputFile.close();
+
+    std::ofstream outputFile(filename, std::ios::binary | std::ios::trunc);
+    outputFile << content;
+    return outputFile.good();
+}
@@ -11,12 +11,16 @@
 
 // VProf libs
 #include "ClangBase.h"
+#include "Utils.h"
 
 class VProfFrontendAction : public clang::ASTFrontendAction {
     private:
         // Maps qualified function name to vprof wrapper name.
         std::shared_ptr<std::unordered_map<std::string, std::string>> functionNameMap;
 
+        // Maps qualified function name to its operation.
+        std::shared_ptr<std::unordered_map<std::string, std::string>> operationMap;
+
         // Maps qualified function name to FunctionPrototype object.
         std::shared_ptr<std::unordered_map<std::string, FunctionPrototype>> prototypeMap;
 
@@ -36,9 +40,12 @@ class VProfFrontendAction : public clang::ASTFrontendAction {
         VProfFrontendAction(std::shared_ptr<std::unordered_map<std::string, 
                                    std::string>> _functionNameMap,
                                    std::shared_ptr<std::unordered_map<std::string,
+                                   std::string>> _operationMap,
+                                   std::shared_ptr<std::unordered_map<std::string,
                                    FunctionPrototype>> _prototypeMap,
                                    std::string _backupPath):
                                    functionNameMap(_functionNameMap),
+                                   operationMap(_operationMap),
                                    prototypeMap(_prototypeMap),
                                    backupPath(_backupPath),
                                    shouldFlush(std::make_shared<bool>(false)) {}
@@ -93,20 +100,11 @@ class VProfFrontendAction : public clang::ASTFrontendAction {
 
         void EndSourceFileAction() override {
             if (*shouldFlush) {
-                std::error_code OutErrInfo;
-                std::error_code ok;
-
-                llvm::raw_fd_ostream outputFile(llvm::StringRef(filename),
-                                                OutErrInfo, llvm::sys::fs::F_None);
-
-                if (OutErrInfo == ok) {
-                    backupFile();
-
-                    const clang::RewriteBuffer *RewriteBuf = rewriter->getRewriteBufferFor(fileID);
-                    outputFile << "// VProfiler included header\n#include \"VProfEventWrappers.h\"\n\n";
-                    outputFile << std::string(RewriteBuf->begin(), RewriteBuf->end());
-                    outputFile.close();
-                }
+                backupFile();
+                const clang::RewriteBuffer *RewriteBuf = rewriter->getRewriteBufferFor(fileID);
+                std::string content = "// VProfiler included header\n#include \"VProfEventWrappers.h\"\n\n";
+                content += std::string(RewriteBuf->begin(), RewriteBuf->end());
+                WriteFileIfChanged(filename, content);
             }
         }
 
@@ -121,6 +119,7 @@ class VProfFrontendAction : public clang::ASTFrontendAction {
             return std::unique_ptr<VProfASTConsumer>(new VProfASTConsumer(ci,
                                                                           rewriter,
                                                                           functionNameMap,
+                                                                          operationMap,
                                                                           prototypeMap,
                                                                           filename,
                                                                           shouldFlush));
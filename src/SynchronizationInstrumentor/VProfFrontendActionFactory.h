@@ -18,6 +18,9 @@ class VProfFrontendActionFactory : public clang::tooling::FrontendActionFactory
         // Maps qualified function name to vprof wrapper name.
         std::shared_ptr<std::unordered_map<std::string, std::string>> functionNameMap;
 
+        // Maps qualified function name to its operation.
+        std::shared_ptr<std::unordered_map<std::string, std::string>> operationMap;
+
         // Maps qualified function name to FunctionPrototype object.
         std::shared_ptr<std::unordered_map<std::string, FunctionPrototype>> prototypeMap;
 
@@ -27,24 +30,29 @@ class VProfFrontendActionFactory : public clang::tooling::FrontendActionFactory
         VProfFrontendActionFactory(std::shared_ptr<std::unordered_map<std::string, 
                                    std::string>> _functionNameMap,
                                    std::shared_ptr<std::unordered_map<std::string,
+                                   std::string>> _operationMap,
+                                   std::shared_ptr<std::unordered_map<std::string,
                                    FunctionPrototype>> _prototypeMap,
                                    std::string _backupDir):
                                    functionNameMap(_functionNameMap),
+                                   operationMap(_operationMap),
                                    prototypeMap(_prototypeMap),
                                    backupDir(_backupDir) {}
 
         // Creates a VProfFrontendAction to be used by clang tool.
         virtual VProfFrontendAction *create() {
-            return new VProfFrontendAction(functionNameMap, prototypeMap, backupDir);
+            return new VProfFrontendAction(functionNameMap, operationMap, prototypeMap, backupDir);
         }
 };
 
 // This is absurdly long, but not sure how to break lines up to make more
 // readable
 std::unique_ptr<VProfFrontendActionFactory> newVProfFrontendActionFactory(std::shared_ptr<std::unordered_map<std::string, std::string>> functionNameMap,
+                                                                          std::shared_ptr<std::unordered_map<std::string, std::string>> operationMap,
                                                                           std::shared_ptr<std::unordered_map<std::string, FunctionPrototype>> prototypeMap,
                                                                           std::string backupDir) {
-    return std::unique_ptr<VProfFrontendActionFactory>(new VProfFrontendActionFactory(functionNameMap, prototypeMap, backupDir));
+    return std::unique_ptr<VProfFrontendActionFactory>(new VProfFrontendActionFactory(functionNameMap, operationMap,
+                                                                                      prototypeMap, backupDir));
 }
 
 #endif
@@ -14,7 +14,7 @@ void InnerWrapperGenerator::GenerateFunctionImplementation(const string &fname,
 void InnerWrapperGenerator::GenerateWrapperInterlude(const string &fname,
                                                      const FunctionPrototype &prototype) {
     if (prototype.returnType != "void") {
-        implementationFile << "result = ";
+        implementationFile << (DeclaresResult() ? "result = " : "return ");
     }
 
     implementationFile << prototype.innerCallPrefix + "(";
@@ -41,14 +41,28 @@ void TracingInnerWrapperGenerator::GenerateWrapperPrologue(const string &fname,
                                                            const FunctionPrototype &prototype) {
     string object = prototype.isMemberCall ? "obj" : prototype.paramVars[0];
 
-    implementationFile << "SYNCHRONIZATION_CALL_START(" + 
+    implementationFile << "VProfSynchronizationGuard vprofGuard(" +
                           (*operationMap)[fname] + 
                           ", static_cast<void*>(" + object + "));\n\t";
 }
 
+// Do nothing, the guard ends the call when the wrapper returns.
 void TracingInnerWrapperGenerator::GenerateWrapperEpilogue(const string &fname,
                                                            const FunctionPrototype &prototype) {
-    implementationFile << "SYNCHRONIZATION_CALL_END();\n\t";
+    noop;
+}
+
+void LabelingInnerWrapperGenerator::GenerateWrapperPrologue(const string &fname,
+                                                            const FunctionPrototype &prototype) {
+    string object = prototype.isMemberCall ? "obj" : prototype.paramVars[0];
+
+    implementationFile << "VPROF_LABEL_OBJECT(static_cast<void*>(" + object + "), vprofSite);\n\t";
+}
+
+// Do nothing, the call's result is returned directly.
+void LabelingInnerWrapperGenerator::GenerateWrapperEpilogue(const string &fname,
+                                                            const FunctionPrototype &prototype) {
+    noop;
 }
 
 string IPCInnerWrapperGenerator::BuildFunctionCallFromParams(const WrapperGenState &funcToInstrument,
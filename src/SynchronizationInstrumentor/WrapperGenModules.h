@@ -19,6 +19,11 @@ class InnerWrapperGenerator {
         void GenerateFunctionImplementation(const std::string &fname,
                                             const FunctionPrototype &prototype);
 
+        // Whether the wrapper stores the result in a local before returning it.
+        virtual bool DeclaresResult() const {
+            return true;
+        }
+
     protected:
         virtual void GenerateWrapperPrologue(const std::string &fname, 
                                              const FunctionPrototype &prototype) = 0;
@@ -39,6 +44,11 @@ class TracingInnerWrapperGenerator : public InnerWrapperGenerator {
         TracingInnerWrapperGenerator(std::ofstream &_implementationFile, 
                                      std::shared_ptr<std::unordered_map<std::string, std::string>> _operationMap);
 
+        // The call is traced by a guard, so its result is returned directly.
+        virtual bool DeclaresResult() const {
+            return false;
+        }
+
     protected:
         virtual void GenerateWrapperPrologue(const std::string &fname, 
                                              const FunctionPrototype &prototype);
@@ -52,6 +62,26 @@ class TracingInnerWrapperGenerator : public InnerWrapperGenerator {
         std::shared_ptr<std::unordered_map<std::string, std::string>> operationMap;
 };
 
+// Wrappers of the functions which initialize a synchronization object, which
+// label it with the file and line of the call, passed as vprofSite, so that
+// the lock contention profile adds up the objects initialized at the same
+// place.
+class LabelingInnerWrapperGenerator : public InnerWrapperGenerator {
+    public:
+        LabelingInnerWrapperGenerator(std::ofstream &_implementationFile):
+            InnerWrapperGenerator(_implementationFile) {}
+
+        virtual bool DeclaresResult() const {
+            return false;
+        }
+
+    protected:
+        virtual void GenerateWrapperPrologue(const std::string &fname,
+                                             const FunctionPrototype &prototype);
+        virtual void GenerateWrapperEpilogue(const std::string &fname,
+                                             const FunctionPrototype &prototype);
+};
+
 class IPCInnerWrapperGenerator : public InnerWrapperGenerator {
     protected:
         WrapperGenStateMap assignedFunctionState;
@@ -6,10 +6,12 @@ void WrapperGenerator::initOpToGenMap() {
     shared_ptr<TracingInnerWrapperGenerator> traceGen;
     shared_ptr<CachingIPCInnerWrapperGenerator> cachingIPCGen;
     shared_ptr<NonCachingIPCInnerWrapperGenerator> nonCachingIPCGen;
+    shared_ptr<LabelingInnerWrapperGenerator> labelGen;
 
     traceGen = make_shared<TracingInnerWrapperGenerator>(implementationFile, operationMap);
     cachingIPCGen = make_shared<CachingIPCInnerWrapperGenerator>(implementationFile);
     nonCachingIPCGen = make_shared<NonCachingIPCInnerWrapperGenerator>(implementationFile);
+    labelGen = make_shared<LabelingInnerWrapperGenerator>(implementationFile);
 
     operationToGenerator = WrapperGenMap({{"MUTEX_LOCK", traceGen}, 
                                           {"MUTEX_UNLOCK", traceGen},
@@ -28,7 +30,9 @@ void WrapperGenerator::initOpToGenMap() {
                                           {"READ", nonCachingIPCGen},
                                           {"WRITE", nonCachingIPCGen},
                                           {"MSGRCV", nonCachingIPCGen},
-                                          {"MSGSND", nonCachingIPCGen}});
+                                          {"MSGSND", nonCachingIPCGen},
+                                          {"MUTEX_INIT", labelGen},
+                                          {"CV_INIT", labelGen}});
 }
 
 WrapperGenerator::WrapperGenerator(shared_ptr<unordered_map<string, 
@@ -65,6 +69,17 @@ vector<string> WrapperGenerator::getFilenames() {
     return result;
 }
 
+vector<string> WrapperGenerator::getSortedFunctionNames() {
+    vector<string> result;
+
+    for (auto kv : *prototypeMap) {
+        result.push_back(kv.first);
+    }
+
+    sort(result.begin(), result.end());
+    return result;
+}
+
 void WrapperGenerator::GenerateHeader() {
     vector<string> includeNames = getFilenames();
     headerFile << "#ifndef VPROFEVENTWRAPPERS_H\n#define VPROFEVENTWRAPPERS_H\n";
@@ -74,8 +89,8 @@ void WrapperGenerator::GenerateHeader() {
     headerFile << "#include \"trace_tool.h\"\n\n"
                   "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n";
 
-    for (auto kv : *prototypeMap) {
-        headerFile << kv.second.functionPrototype + ";\n\n";
+    for (string &functionName : getSortedFunctionNames()) {
+        headerFile << (*prototypeMap)[functionName].functionPrototype + ";\n\n";
     }
 
     headerFile << "#ifdef __cplusplus\n}\n#endif\n\n#endif";
@@ -87,18 +102,21 @@ void WrapperGenerator::GenerateImplementations() {
     string operation;
     implementationFile << "#include \"VProfEventWrappers.h\"\n\n";
 
-    for (auto kv : *prototypeMap) {
-        operation = (*operationMap)[kv.first];
+    for (string &functionName : getSortedFunctionNames()) {
+        FunctionPrototype &prototype = (*prototypeMap)[functionName];
+        operation = (*operationMap)[functionName];
+        shared_ptr<InnerWrapperGenerator> generator = operationToGenerator[operation];
+        bool declaresResult = prototype.returnType != "void" && generator->DeclaresResult();
         
-        implementationFile << kv.second.functionPrototype + " {\n\t";
+        implementationFile << prototype.functionPrototype + " {\n\t";
 
-        if (kv.second.returnType != "void") {
-            implementationFile << kv.second.returnType + " result;\n\n\t";
+        if (declaresResult) {
+            implementationFile << prototype.returnType + " result;\n\n\t";
         }
 
-        operationToGenerator[operation]->GenerateFunctionImplementation(kv.first, kv.second);
+        generator->GenerateFunctionImplementation(functionName, prototype);
 
-        if (kv.second.returnType != "void") {
+        if (declaresResult) {
             implementationFile << "return result;\n";
         }
 
@@ -38,6 +38,10 @@ class WrapperGenerator {
 
         std::vector<std::string> getFilenames();
 
+        // Qualified names of the wrapped functions in sorted order, so that the
+        // generated files are identical from one run to the next.
+        std::vector<std::string> getSortedFunctionNames();
+
         // For initialization only
         void initOpToGenMap();
 
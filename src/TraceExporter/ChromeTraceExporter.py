@@ -0,0 +1,249 @@
+import csv
+import json
+from os import listdir
+from collections import deque
+from nanotime import nanotime
+
+from FactorSelector.CriticalPathBuilder.OperationEnum import Operation
+from FactorSelector.CriticalPathBuilder.SynchronizationObject import QueueObject
+from FactorSelector.TraceFormat import ParseExtras
+
+# Converts the FunctionLog_* and SynchronizationLog_* files of a run into the
+# Chrome trace event JSON format, which chrome://tracing and the Perfetto UI
+# both open. Events are written as the logs are read, so the memory used does
+# not grow with the size of the trace, except for the optional critical path
+# which needs the synchronization logs loaded the same way LatencyAggregator
+# loads them. Timestamps are relative to the earliest record of the run, since
+# floating point microseconds since the epoch lose the nanoseconds.
+
+releaseOps = [Operation.MUTEX_UNLOCK, Operation.CV_SIGNAL, Operation.CV_BROADCAST]
+acquireOps = [Operation.MUTEX_LOCK, Operation.CV_WAIT]
+produceOps = [Operation.QUEUE_ENQUEUE, Operation.MESSAGE_SEND]
+consumeOps = [Operation.QUEUE_DEQUEUE, Operation.MESSAGE_RECEIVE]
+
+
+def toMicroseconds(nanoseconds):
+    return nanoseconds / 1000.0
+
+
+class TraceWriter:
+    def __init__(self, outFilename, origin):
+        # Nanosecond timestamp written as 0
+        self.origin = origin
+
+        self.outFile = open(outFilename, 'w')
+        self.outFile.write('{"displayTimeUnit":"ns","traceEvents":[\n')
+        self.firstEvent = True
+
+        # (pid, thread entity string) -> tid shown in the trace
+        self.threadIDs = {}
+
+    def ThreadID(self, pid, entity):
+        key = (pid, entity)
+        if key not in self.threadIDs:
+            self.threadIDs[key] = len(self.threadIDs) + 1
+            self.Write({ 'ph': 'M', 'name': 'thread_name', 'pid': pid,
+                         'tid': self.threadIDs[key], 'args': { 'name': entity } })
+        return self.threadIDs[key]
+
+    def Write(self, event):
+        if not self.firstEvent:
+            self.outFile.write(',\n')
+        self.firstEvent = False
+        self.outFile.write(json.dumps(event, separators=(',', ':')))
+
+    def Slice(self, name, category, pid, entity, start, end, args=None, color=None):
+        event = { 'ph': 'X', 'name': name, 'cat': category, 'pid': pid,
+                  'tid': self.ThreadID(pid, entity),
+                  'ts': toMicroseconds(start - self.origin), 'dur': toMicroseconds(end - start) }
+        if args is not None:
+            event['args'] = args
+        if color is not None:
+            event['cname'] = color
+        self.Write(event)
+
+    def Flow(self, flowID, name, pid, fromEntity, fromTime, toEntity, toTime):
+        self.Write({ 'ph': 's', 'id': flowID, 'name': name, 'cat': 'dependence',
+                     'pid': pid, 'tid': self.ThreadID(pid, fromEntity),
+                     'ts': toMicroseconds(fromTime - self.origin) })
+        self.Write({ 'ph': 'f', 'bp': 'e', 'id': flowID, 'name': name, 'cat': 'dependence',
+                     'pid': pid, 'tid': self.ThreadID(pid, toEntity),
+                     'ts': toMicroseconds(toTime - self.origin) })
+
+    def Close(self):
+        self.outFile.write('\n]}\n')
+        self.outFile.close()
+
+
+class SynchronizationCall:
+    def __init__(self, entity, semIntervalID, objID, opID, start, end, seq):
+        self.entity = entity
+        self.semIntervalID = semIntervalID
+        self.objID = objID
+        self.opID = opID
+        self.start = start
+        self.end = end
+        # Sequence number of the item of a queue operation, which QueueObject
+        # matches enqueues and dequeues by.
+        self.seq = seq
+
+
+class SynchronizationLogExporter:
+    def __init__(self, writer):
+        self.writer = writer
+        self.flowID = 0
+
+    def Export(self, filename, pid):
+        # State is per file, since object IDs are addresses in one process.
+        # Operations waiting for their function times, per thread
+        self.pendingOps = {}
+        # objID -> last SynchronizationCall that released the object
+        self.lastRelease = {}
+        # objID -> QueueObject of the items still in the queue
+        self.queues = {}
+
+        batch = []
+        inFunctionTimes = False
+        with open(filename, 'rb') as logFile:
+            for row in csv.reader(logFile):
+                if len(row) < 5:
+                    continue
+
+                entity = row[1]
+                if row[0] == '0':
+                    # The writer thread dumps all operations of a batch before
+                    # their function times, so an operation line after function
+                    # times starts a new batch.
+                    if inFunctionTimes:
+                        self.__ExportBatch(batch, pid)
+                        batch = []
+                        inFunctionTimes = False
+                    self.pendingOps.setdefault(entity, deque()).append((row[3], int(row[4])))
+                else:
+                    inFunctionTimes = True
+                    # Operations and function times pair up in order per thread,
+                    # as in RequestTracker.
+                    if self.pendingOps.get(entity):
+                        objID, opID = self.pendingOps[entity].popleft()
+                        seq = ParseExtras(row[5]).get('seq') if len(row) > 5 else None
+                        batch.append(SynchronizationCall(entity, row[2], objID, Operation(opID),
+                                                         int(row[3]), int(row[4]), seq))
+
+        self.__ExportBatch(batch, pid)
+
+    def __ExportBatch(self, batch, pid):
+        batch.sort(key=lambda x: x.end)
+
+        for call in batch:
+            self.writer.Slice(call.opID.name, 'synchronization', pid, call.entity,
+                              call.start, call.end,
+                              { 'object': call.objID, 'semantic_interval': call.semIntervalID })
+
+            if call.opID in releaseOps:
+                self.lastRelease[call.objID] = call
+            elif call.opID in acquireOps:
+                # Only an acquire that was still waiting when the object was
+                # released depends on the releasing thread.
+                release = self.lastRelease.get(call.objID)
+                if release is not None and release.entity != call.entity and \
+                   call.start <= release.end <= call.end:
+                    self.__Flow(call, release, pid)
+            elif call.opID in produceOps or call.opID in consumeOps:
+                if call.objID not in self.queues:
+                    self.queues[call.objID] = QueueObject(keepItems=False)
+                # Matched items leave the QueueObject, and the dequeue may come
+                # first when the enqueue is in a later batch.
+                item = self.queues[call.objID].AddOperation(call)
+                if item is not None:
+                    enqueue, dequeue = item
+                    self.__Flow(dequeue, enqueue, pid)
+
+    def __Flow(self, call, cause, pid):
+        self.flowID += 1
+        self.writer.Flow(self.flowID, call.opID.name, pid,
+                         cause.entity, cause.start, call.entity, call.end)
+
+
+class FunctionLogExporter:
+    def __init__(self, writer, funcNamesFile):
+        self.writer = writer
+
+        # Function log indices are 0 for the semantic interval, 1 to n - 1 for
+        # the lines of the function names file after the first one, and after
+        # those for the target function itself, named by the first line.
+        with open(funcNamesFile, 'r') as funcNames:
+            self.funcNames = [line.strip().split('|')[0] for line in funcNames]
+
+    def FunctionName(self, index):
+        if index == 0:
+            return 'SemanticInterval'
+        elif 0 < index < len(self.funcNames):
+            return self.funcNames[index]
+        return self.funcNames[0]
+
+    def Export(self, filename, pid, criticalPathBuilder):
+        with open(filename, 'rb') as logFile:
+            for row in csv.reader(logFile):
+                # Skips the probe calibration lines as well.
+                if len(row) < 5 or not row[0].isdigit():
+                    continue
+
+                index = int(row[0])
+                entity = row[1]
+                start = int(row[3])
+                end = int(row[4])
+                self.writer.Slice(self.FunctionName(index),
+                                  'semantic_interval' if index == 0 else 'function',
+                                  pid, entity, start, end, { 'semantic_interval': row[2] })
+
+                if index == 0 and criticalPathBuilder is not None:
+                    self.__ExportCriticalPath(criticalPathBuilder, pid, row[2], entity, start, end)
+
+    def __ExportCriticalPath(self, criticalPathBuilder, pid, semIntervalID, entity, start, end):
+        criticalPath = criticalPathBuilder.Build(nanotime(start), nanotime(end), entity)
+        for interval in sorted(criticalPath):
+            self.writer.Slice('CriticalPath', 'critical_path', pid,
+                              interval.data + ' (critical path)',
+                              int(interval.begin), int(interval.end),
+                              { 'semantic_interval': semIntervalID }, 'terrible')
+
+
+def EarliestTime(traceDir):
+    """ Earliest start of the function and synchronization call records of
+        the logs of a run, read without keeping them """
+    earliest = None
+    for filename in listdir(traceDir):
+        isFunctionLog = filename.startswith('FunctionLog_')
+        if not isFunctionLog and not filename.startswith('SynchronizationLog_'):
+            continue
+        with open(traceDir + filename, 'rb') as logFile:
+            for row in csv.reader(logFile):
+                # Function records start with their index, synchronization
+                # call times with 1, unlike operations and calibration lines.
+                if len(row) < 5 or not row[0].isdigit() or (not isFunctionLog and row[0] != '1'):
+                    continue
+                start = int(row[3])
+                if earliest is None or start < earliest:
+                    earliest = start
+    return earliest or 0
+
+
+def Export(traceDir, funcNamesFile, outFilename, highlightCriticalPath=False):
+    traceDir += '/' if traceDir[-1] != '/' else ''
+    writer = TraceWriter(outFilename, EarliestTime(traceDir))
+
+    criticalPathBuilder = None
+    if highlightCriticalPath:
+        from FactorSelector.CriticalPathBuilder.CriticalPathBuilder import CriticalPathBuilder
+        criticalPathBuilder = CriticalPathBuilder(traceDir, 'SynchronizationLog_')
+
+    functionExporter = FunctionLogExporter(writer, funcNamesFile)
+    synchronizationExporter = SynchronizationLogExporter(writer)
+    for filename in sorted(listdir(traceDir)):
+        pid = int(filename[filename.rfind('_') + 1:]) if filename[-1].isdigit() else 0
+        if filename.startswith('FunctionLog_'):
+            functionExporter.Export(traceDir + filename, pid, criticalPathBuilder)
+        elif filename.startswith('SynchronizationLog_'):
+            synchronizationExporter.Export(traceDir + filename, pid)
+
+    writer.Close()
@@ -0,0 +1,178 @@
+#include "CallGraph.h"
+#include "Utils.h"
+
+// STL libs
+#include <algorithm>
+#include <fstream>
+
+std::unique_ptr<CallGraph> CallGraph::singleton = nullptr;
+
+CallGraph *CallGraph::GetInstance() {
+    if (!singleton) {
+        singleton = std::unique_ptr<CallGraph>(new CallGraph());
+    }
+    return singleton.get();
+}
+
+CallGraph::CallGraph(): isLoaded(false) {}
+
+bool CallGraph::AddFunction(const std::string &usr, const std::string &name, bool isInline) {
+    CallGraphFunction &function = functions[usr];
+    if (function.isDefined) {
+        return false;
+    }
+    function.name = name;
+    function.isDefined = true;
+    function.isInline = isInline;
+    usrsByName[name].push_back(usr);
+    return true;
+}
+
+void CallGraph::AddStatement(const std::string &usr, bool isLoop) {
+    CallGraphFunction &function = functions[usr];
+    function.statements++;
+    function.hasLoop = function.hasLoop || isLoop;
+}
+
+void CallGraph::AddCall(const std::string &caller, const std::string &callee, int loopDepth) {
+    int weight = 1;
+    for (int i = 0; i < std::min(loopDepth, 3); i++) {
+        weight *= 10;
+    }
+    functions[caller].callees[callee] += weight;
+}
+
+void CallGraph::AddUnresolvedCall(const std::string &caller) {
+    functions[caller].hasUnresolvedCalls = true;
+}
+
+// state is 1 while the function is on the current chain and 2 once its
+// height is known.
+int CallGraph::computeHeight(const std::string &name, std::map<std::string, int> &state) {
+    auto function = functions.find(name);
+    if (function == functions.end() || state[name] == 1) {
+        return 0;
+    }
+    if (state[name] == 2) {
+        return function->second.height;
+    }
+
+    state[name] = 1;
+    int height = 0;
+    for (auto &callee : function->second.callees) {
+        height = std::max(height, computeHeight(callee.first, state) + 1);
+    }
+    function->second.height = height;
+    state[name] = 2;
+    return height;
+}
+
+void CallGraph::ComputeHeights() {
+    std::map<std::string, int> state;
+    for (auto &function : functions) {
+        computeHeight(function.first, state);
+    }
+}
+
+bool CallGraph::Save(const std::string &filename) {
+    std::ofstream graphFile(filename, std::ios::trunc);
+    if (!graphFile) {
+        return false;
+    }
+
+    graphFile << "# F\tusr\tfunction\theight\tfan-out\tstatements\tinline\tloop\tunresolved" << std::endl;
+    graphFile << "# E\tcaller\tcallee\tweight" << std::endl;
+    for (auto &function : functions) {
+        if (function.second.isDefined) {
+            graphFile << "F\t" << function.first << '\t' << function.second.name << '\t'
+                      << function.second.height << '\t' << function.second.callees.size() << '\t'
+                      << function.second.statements << '\t' << function.second.isInline << '\t'
+                      << function.second.hasLoop << '\t' << function.second.hasUnresolvedCalls << std::endl;
+        }
+    }
+    for (auto &function : functions) {
+        for (auto &callee : function.second.callees) {
+            graphFile << "E\t" << function.first << '\t' << callee.first << '\t'
+                      << callee.second << std::endl;
+        }
+    }
+    return graphFile.good();
+}
+
+bool CallGraph::Load(const std::string &filename) {
+    std::ifstream graphFile(filename);
+    if (!graphFile) {
+        return false;
+    }
+
+    std::string line;
+    while (getline(graphFile, line)) {
+        std::vector<std::string> fields = SplitString(line, '\t');
+        if (fields.size() == 9 && fields[0] == "F") {
+            CallGraphFunction &function = functions[fields[1]];
+            function.name = fields[2];
+            function.isDefined = true;
+            function.height = std::stoi(fields[3]);
+            function.statements = std::stoi(fields[5]);
+            function.isInline = fields[6] == "1";
+            function.hasLoop = fields[7] == "1";
+            function.hasUnresolvedCalls = fields[8] == "1";
+            usrsByName[function.name].push_back(fields[1]);
+        } else if (fields.size() == 4 && fields[0] == "E") {
+            functions[fields[1]].callees[fields[2]] = std::stoi(fields[3]);
+        }
+    }
+    isLoaded = true;
+    return true;
+}
+
+bool CallGraph::IsLoaded() const {
+    return isLoaded;
+}
+
+bool CallGraph::isLeaf(const std::string &usr) const {
+    auto function = functions.find(usr);
+    return function != functions.end() && function->second.isDefined &&
+           function->second.callees.empty() && !function->second.hasUnresolvedCalls;
+}
+
+bool CallGraph::IsLeaf(const std::string &name) const {
+    auto usrs = usrsByName.find(name);
+    if (usrs == usrsByName.end()) {
+        return false;
+    }
+    for (const std::string &usr : usrs->second) {
+        if (!isLeaf(usr)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CallGraph::IsTrivial(const std::string &usr) const {
+    if (!isLeaf(usr)) {
+        return false;
+    }
+    const CallGraphFunction &function = functions.find(usr)->second;
+    return !function.hasLoop && (function.isInline || function.statements <= TRIVIAL_STATEMENTS);
+}
+
+int CallGraph::CallWeight(const std::string &caller, const std::string &callee) const {
+    auto callers = usrsByName.find(caller);
+    auto callees = usrsByName.find(callee);
+    if (callers == usrsByName.end() || callees == usrsByName.end()) {
+        return 0;
+    }
+
+    int weight = 0;
+    for (const std::string &callerUSR : callers->second) {
+        const std::map<std::string, int> &calls = functions.find(callerUSR)->second.callees;
+        for (const std::string &calleeUSR : callees->second) {
+            auto call = calls.find(calleeUSR);
+            if (call != calls.end()) {
+                weight = std::max(weight, call->second);
+            }
+        }
+    }
+    return weight;
+}
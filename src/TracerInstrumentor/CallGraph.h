@@ -0,0 +1,101 @@
+#ifndef CALL_GRAPH_H
+#define CALL_GRAPH_H
+
+// STL libs
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Functions are keyed by their USR, so that overloads whose parameters have
+// the same names and static functions of different files are told apart.
+struct CallGraphFunction {
+    CallGraphFunction(): isDefined(false), isInline(false), hasLoop(false),
+                         hasUnresolvedCalls(false), statements(0), height(0) {}
+
+    // Qualified name and parameter names joined by '|', as in the function
+    // names file.
+    std::string name;
+
+    bool isDefined;
+
+    bool isInline;
+
+    bool hasLoop;
+
+    // Calls whose callee is unknown, such as calls through pointers or calls
+    // depending on template parameters, which may call anything.
+    bool hasUnresolvedCalls;
+
+    int statements;
+
+    // Length of the longest call chain below the function, not counting
+    // calls back into a function already on the chain.
+    int height;
+
+    // Callee USR -> static weight of the calls to it, i.e. the number of
+    // call sites, each counting ten times more per loop it is in.
+    std::map<std::string, int> callees;
+};
+
+// Static call graph of the whole program, built by the call graph extractor
+// from every file of the compilation database and saved so that later runs
+// only load it.
+class CallGraph {
+    public:
+        static CallGraph *GetInstance();
+
+        // Returns false if the function was defined already, e.g. in a header
+        // seen by an earlier file, in which case its calls are not added again.
+        bool AddFunction(const std::string &usr, const std::string &name, bool isInline);
+
+        void AddStatement(const std::string &usr, bool isLoop);
+
+        void AddCall(const std::string &caller, const std::string &callee, int loopDepth);
+
+        void AddUnresolvedCall(const std::string &caller);
+
+        void ComputeHeights();
+
+        // Lines of "F	usr	name	height	fan-out	statements	inline	loop
+        // unresolved" for the defined functions, then of "E	caller usr
+        // callee usr	weight".
+        bool Save(const std::string &filename);
+
+        bool Load(const std::string &filename);
+
+        bool IsLoaded() const;
+
+        // Whether every defined function with the name calls nothing.
+        bool IsLeaf(const std::string &name) const;
+
+        // Leaves without loops which are inline or only a few statements
+        // long, whose wrapper would cost about as much as they do.
+        bool IsTrivial(const std::string &usr) const;
+
+        // Static weight of the calls from the functions with the caller name
+        // to those with the callee name, the heaviest if there are several,
+        // 0 if unknown.
+        int CallWeight(const std::string &caller, const std::string &callee) const;
+
+    private:
+        CallGraph();
+
+        static const int TRIVIAL_STATEMENTS = 3;
+
+        static std::unique_ptr<CallGraph> singleton;
+
+        std::map<std::string, CallGraphFunction> functions;
+
+        // Name -> USRs of the defined functions with that name.
+        std::map<std::string, std::vector<std::string>> usrsByName;
+
+        bool isLoaded;
+
+        bool isLeaf(const std::string &usr) const;
+
+        int computeHeight(const std::string &name, std::map<std::string, int> &state);
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef CALL_GRAPH_EXTRACTOR_FRONT_END_FACTORY_H
+#define CALL_GRAPH_EXTRACTOR_FRONT_END_FACTORY_H
+
+#include "CallGraphExtractorVisitor.h"
+
+#include "clang/Tooling/Tooling.h"
+
+class CallGraphExtractorASTConsumer : public clang::ASTConsumer {
+    private:
+        std::unique_ptr<CallGraphExtractorVisitor> visitor;
+
+    public:
+        explicit CallGraphExtractorASTConsumer(clang::CompilerInstance &ci) {
+            visitor = std::unique_ptr<CallGraphExtractorVisitor>(new CallGraphExtractorVisitor(ci));
+        }
+
+        ~CallGraphExtractorASTConsumer() {}
+
+        virtual void HandleTranslationUnit(clang::ASTContext &context) {
+            visitor->TraverseDecl(context.getTranslationUnitDecl());
+        }
+};
+
+class CallGraphExtractorFrontendAction : public clang::ASTFrontendAction {
+    public:
+        CallGraphExtractorFrontendAction() {}
+
+        ~CallGraphExtractorFrontendAction() {}
+
+        virtual std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance &ci,
+                                                                      llvm::StringRef file) {
+            return std::unique_ptr<CallGraphExtractorASTConsumer>(new CallGraphExtractorASTConsumer(ci));
+        }
+};
+
+class CallGraphExtractorFrontendActionFactory : public clang::tooling::FrontendActionFactory {
+    public:
+        CallGraphExtractorFrontendActionFactory() {}
+
+        // Creates a CallGraphExtractorFrontendAction to be used by clang tool.
+        virtual CallGraphExtractorFrontendAction *create() {
+            return new CallGraphExtractorFrontendAction();
+        }
+};
+
+// Functions and calls found in any of the files run are added to
+// CallGraph::GetInstance().
+std::unique_ptr<CallGraphExtractorFrontendActionFactory> CreateCallGraphExtractorFrontendActionFactory() {
+    return std::unique_ptr<CallGraphExtractorFrontendActionFactory>(
+        new CallGraphExtractorFrontendActionFactory());
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include "CallGraphExtractorVisitor.h"
+#include "CallSiteUtils.h"
+
+using namespace clang;
+
+std::string CallGraphExtractorVisitor::getFunctionNameAndArgs(const clang::FunctionDecl *decl) {
+    std::string nameAndArgs = decl->getQualifiedNameAsString();
+
+    for (unsigned int i = 0, j = decl->getNumParams(); i < j; i++) {
+        const ParmVarDecl* paramDecl = decl->getParamDecl(i);
+        nameAndArgs += "|" + paramDecl->getNameAsString();
+    }
+    return nameAndArgs;
+}
+
+bool CallGraphExtractorVisitor::inRange(clang::SourceRange largeRange, clang::SourceRange smallRange) {
+    unsigned start = smallRange.getBegin().getRawEncoding();
+    unsigned end = smallRange.getEnd().getRawEncoding();
+    return largeRange.getBegin().getRawEncoding() <= start &&
+           end <= largeRange.getEnd().getRawEncoding();
+}
+
+bool CallGraphExtractorVisitor::inCurrentFunction(const Stmt *stmt) {
+    return !currentFunction.empty() && inRange(functionRange, stmt->getSourceRange());
+}
+
+void CallGraphExtractorVisitor::addCall(const Expr *call, const FunctionDecl *decl) {
+    if (!inCurrentFunction(call)) {
+        return;
+    }
+
+    std::string callee = GetUSR(decl);
+    if (callee.empty()) {
+        callGraph->AddUnresolvedCall(currentFunction);
+        return;
+    }
+
+    int loopDepth = 0;
+    for (const SourceRange &loopRange : loopRanges) {
+        if (inRange(loopRange, call->getSourceRange())) {
+            loopDepth++;
+        }
+    }
+    callGraph->AddCall(currentFunction, callee, loopDepth);
+}
+
+void CallGraphExtractorVisitor::addUnresolvedCall(const Expr *call) {
+    if (inCurrentFunction(call)) {
+        callGraph->AddUnresolvedCall(currentFunction);
+    }
+}
+
+bool CallGraphExtractorVisitor::VisitFunctionDecl(const clang::FunctionDecl *decl) {
+    if (!decl->isThisDeclarationADefinition() || !decl->hasBody() ||
+        astContext->getSourceManager().isInSystemHeader(decl->getLocation())) {
+        return true;
+    }
+
+    std::string usr = GetUSR(decl);
+    currentFunction = !usr.empty() && callGraph->AddFunction(usr, getFunctionNameAndArgs(decl), decl->isInlined()) ?
+                      usr : "";
+    functionRange = decl->getSourceRange();
+    loopRanges.clear();
+    return true;
+}
+
+// Expressions are not counted, so that the count is about the number of
+// statements the function runs.
+bool CallGraphExtractorVisitor::VisitStmt(const clang::Stmt *s) {
+    if (isa<Expr>(s) || isa<CompoundStmt>(s) || !inCurrentFunction(s)) {
+        return true;
+    }
+
+    bool isLoop = isa<ForStmt>(s) || isa<WhileStmt>(s) || isa<DoStmt>(s) || isa<CXXForRangeStmt>(s);
+    if (isLoop) {
+        loopRanges.push_back(s->getSourceRange());
+    }
+    callGraph->AddStatement(currentFunction, isLoop);
+    return true;
+}
+
+bool CallGraphExtractorVisitor::VisitCallExpr(const CallExpr *call) {
+    if (isa<CXXMemberCallExpr>(call)) {
+        return true;
+    }
+    // Calls through pointers, and calls whose callee depends on template
+    // parameters, may call anything.
+    const FunctionDecl *decl = call->getDirectCallee();
+    if (!decl) {
+        addUnresolvedCall(call);
+        return true;
+    }
+    addCall(call, decl);
+
+    return true;
+}
+
+bool CallGraphExtractorVisitor::VisitCXXMemberCallExpr(const clang::CXXMemberCallExpr *call) {
+    const CXXMethodDecl *method = call->getMethodDecl();
+    if (method == nullptr) {
+        addUnresolvedCall(call);
+        return true;
+    }
+    addCall(call, method);
+    // The call may go to any override.
+    if (method->isVirtual() && !method->hasAttr<FinalAttr>() && !method->getParent()->hasAttr<FinalAttr>()) {
+        addUnresolvedCall(call);
+    }
+
+    return true;
+}
+
+bool CallGraphExtractorVisitor::VisitCXXConstructExpr(const clang::CXXConstructExpr *construct) {
+    if (!construct->getConstructor()->isTrivial()) {
+        addCall(construct, construct->getConstructor());
+    }
+    return true;
+}
+
+bool CallGraphExtractorVisitor::VisitCXXNewExpr(const clang::CXXNewExpr *newExpr) {
+    if (newExpr->getOperatorNew() != nullptr) {
+        addCall(newExpr, newExpr->getOperatorNew());
+    }
+    return true;
+}
+
+bool CallGraphExtractorVisitor::VisitCXXDeleteExpr(const clang::CXXDeleteExpr *deleteExpr) {
+    if (deleteExpr->getOperatorDelete() != nullptr) {
+        addCall(deleteExpr, deleteExpr->getOperatorDelete());
+    }
+    return true;
+}
+
+CallGraphExtractorVisitor::CallGraphExtractorVisitor(CompilerInstance &ci):
+                                                     astContext(&ci.getASTContext()),
+                                                     callGraph(CallGraph::GetInstance()) {}
+
+CallGraphExtractorVisitor::~CallGraphExtractorVisitor() {}
@@ -0,0 +1,81 @@
+#ifndef CALL_GRAPH_EXTRACTOR_VISITOR_H
+#define CALL_GRAPH_EXTRACTOR_VISITOR_H
+
+// Clang libs
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/ExprCXX.h"
+#include "clang/AST/Stmt.h"
+#include "clang/AST/Decl.h"
+
+// STL libs
+#include <string>
+#include <vector>
+
+#include "CallGraph.h"
+
+// Adds the functions defined in a file, outside of system headers, and the
+// calls they make to the CallGraph, without rewriting anything. Template
+// instantiations are visited too, so that calls which depend on template
+// parameters are resolved in the instantiations, and only make the template
+// itself call something unknown.
+class CallGraphExtractorVisitor : public clang::RecursiveASTVisitor<CallGraphExtractorVisitor> {
+    private:
+        clang::ASTContext *astContext;
+
+        CallGraph *callGraph;
+
+        // USR of the function whose body is being visited, empty if its calls
+        // were added by an earlier file or if there is none.
+        std::string currentFunction;
+
+        clang::SourceRange functionRange;
+
+        // Loops of the current function, outermost first.
+        std::vector<clang::SourceRange> loopRanges;
+
+        std::string getFunctionNameAndArgs(const clang::FunctionDecl *decl);
+
+        bool inRange(clang::SourceRange largeRange, clang::SourceRange smallRange);
+
+        bool inCurrentFunction(const clang::Stmt *stmt);
+
+        void addCall(const clang::Expr *call, const clang::FunctionDecl *decl);
+
+        void addUnresolvedCall(const clang::Expr *call);
+
+    public:
+        explicit CallGraphExtractorVisitor(clang::CompilerInstance &ci);
+
+        ~CallGraphExtractorVisitor();
+
+        bool shouldVisitTemplateInstantiations() const {
+            return true;
+        }
+
+        // Override trigger for when a FunctionDecl is found in the AST
+        virtual bool VisitFunctionDecl(const clang::FunctionDecl *decl);
+
+        // Override trigger for when a Stmt is found in the AST
+        virtual bool VisitStmt(const clang::Stmt *s);
+
+        // Override trigger for when a CallExpr is found in the AST
+        virtual bool VisitCallExpr(const clang::CallExpr *call);
+
+        // Override trigger for when a CXXMemberCallExpr is found in the AST
+        virtual bool VisitCXXMemberCallExpr(const clang::CXXMemberCallExpr *call);
+
+        // Constructors, allocation functions and destructors called without a
+        // CallExpr.
+        virtual bool VisitCXXConstructExpr(const clang::CXXConstructExpr *construct);
+
+        virtual bool VisitCXXNewExpr(const clang::CXXNewExpr *newExpr);
+
+        virtual bool VisitCXXDeleteExpr(const clang::CXXDeleteExpr *deleteExpr);
+};
+
+#endif
@@ -0,0 +1,457 @@
+#include "CallSiteUtils.h"
+#include "CallGraph.h"
+
+#include "clang/Index/USRGeneration.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+
+static std::string mangledName(MangleContext &mangleContext, const FunctionDecl *decl) {
+    if (decl->isDependentContext() || !mangleContext.shouldMangleDeclName(decl)) {
+        return decl->getNameAsString();
+    }
+
+    std::string mangled;
+    llvm::raw_string_ostream s(mangled);
+    mangleContext.mangleName(decl, s);
+    return s.str();
+}
+
+std::string GetWrapperName(MangleContext &mangleContext, const FunctionDecl *decl, int index) {
+    std::string name = mangledName(mangleContext, decl);
+    if (name.empty() || name[0] != '_') {
+        name = "_" + name;
+    }
+    return "vprofiler" + name + "_" + std::to_string(index);
+}
+
+std::string GetArgAsString(const Expr *arg, const LangOptions &langOpts) {
+    PrintingPolicy policy(langOpts);
+    std::string argString;
+    llvm::raw_string_ostream s(argString);
+    arg->printPretty(s, 0, policy);
+    s.flush();
+
+    if (!langOpts.CPlusPlus11) {
+        return argString;
+    }
+
+    QualType paramType = arg->getType().getNonReferenceType().getUnqualifiedType();
+    std::string paramTypeString = paramType.getAsString(policy);
+    const ImplicitCastExpr *cast = dyn_cast<ImplicitCastExpr>(arg);
+    if (cast && (cast->getCastKind() == CK_NullToPointer ||
+                 cast->getCastKind() == CK_NullToMemberPointer)) {
+        return "static_cast<" + paramTypeString + ">(" + argString + ")";
+    }
+
+    const Expr *inner = arg->IgnoreImplicit();
+    const CXXConstructExpr *construct = dyn_cast<CXXConstructExpr>(inner);
+    if (!isa<InitListExpr>(inner) && !isa<CXXStdInitializerListExpr>(inner) &&
+        !(construct && construct->isListInitialization() && !isa<CXXTemporaryObjectExpr>(inner))) {
+        return argString;
+    }
+
+    // Braced lists of scalars hold at most one value, which is cast, as a
+    // type of several words such as unsigned int can not be named in T{...}.
+    const InitListExpr *initList = dyn_cast<InitListExpr>(inner);
+    if (initList && paramType->isScalarType()) {
+        if (initList->getNumInits() == 0) {
+            return "static_cast<" + paramTypeString + ">(0)";
+        }
+        std::string init;
+        llvm::raw_string_ostream initStream(init);
+        initList->getInit(0)->printPretty(initStream, 0, policy);
+        return "static_cast<" + paramTypeString + ">(" + initStream.str() + ")";
+    }
+
+    if (argString.empty() || argString[0] != '{') {
+        argString = "{" + argString + "}";
+    }
+    return paramTypeString + argString;
+}
+
+std::string GetExplicitTemplateArgs(const CallExpr *call, const LangOptions &langOpts) {
+    const Expr *callee = call->getCallee()->IgnoreParenImpCasts();
+    llvm::ArrayRef<TemplateArgumentLoc> args;
+    if (const DeclRefExpr *ref = dyn_cast<DeclRefExpr>(callee)) {
+        if (!ref->hasExplicitTemplateArgs()) {
+            return "";
+        }
+        args = ref->template_arguments();
+    } else if (const MemberExpr *member = dyn_cast<MemberExpr>(callee)) {
+        if (!member->hasExplicitTemplateArgs()) {
+            return "";
+        }
+        args = member->template_arguments();
+    } else {
+        return "";
+    }
+
+    std::string templateArgs;
+    llvm::raw_string_ostream s(templateArgs);
+    TemplateSpecializationType::PrintTemplateArgumentList(s, args, PrintingPolicy(langOpts));
+    return s.str();
+}
+
+bool InRange(SourceRange largeRange, SourceRange smallRange) {
+    unsigned start = smallRange.getBegin().getRawEncoding();
+    unsigned end = smallRange.getEnd().getRawEncoding();
+    return largeRange.getBegin().getRawEncoding() <= start &&
+           end <= largeRange.getEnd().getRawEncoding();
+}
+
+static std::string joinArgs(const std::vector<const Expr*> &args, const LangOptions &langOpts) {
+    std::string joined;
+    for (unsigned int i = 0, j = args.size(); i < j; i++) {
+        joined += GetArgAsString(args[i], langOpts);
+
+        if (i != (j - 1)) {
+            joined += ", ";
+        }
+    }
+    return joined;
+}
+
+void RewriteCall(Rewriter &rewriter, const CallExpr *call, const std::string &wrapperName,
+                 bool isMemberCall) {
+    std::string newCall = wrapperName + "(";
+    std::vector<const Expr*> args;
+
+    if (isMemberCall) {
+        const CXXMemberCallExpr *memCall = static_cast<const CXXMemberCallExpr*>(call);
+        Expr *obj = memCall->getImplicitObjectArgument();
+        args.push_back(obj);
+
+        // Add ampersand to get address of obj if it is not a pointer.  This ensures
+        // the first arg of a member function that the user wants profiled is a
+        // pointer to the instance of the object on which to operate.
+        if (!obj->getType()->isPointerType()) {
+            newCall += "&";
+        }
+    }
+
+    for (int i = 0, j = call->getNumArgs(); i < j; i++) {
+        // Default arguments are left to the wrapped function.
+        if (isa<CXXDefaultArgExpr>(call->getArg(i))) {
+            break;
+        }
+        args.push_back(call->getArg(i));
+    }
+
+    newCall += joinArgs(args, rewriter.getLangOpts()) + ")";
+
+    rewriter.ReplaceText(SourceRange(call->getLocStart(),
+                         call->getRParenLoc()), newCall);
+}
+
+void RewriteIndirectCall(Rewriter &rewriter, const CallExpr *call, const std::string &wrapperName) {
+    std::vector<const Expr*> args = GetIndirectCallArgs(call);
+    args.insert(args.begin(), GetIndirectCallee(call));
+
+    std::string newCall = wrapperName + "(" + joinArgs(args, rewriter.getLangOpts()) + ")";
+
+    rewriter.ReplaceText(SourceRange(call->getLocStart(),
+                         call->getRParenLoc()), newCall);
+}
+
+static std::string getParamDeclAsString(const ParmVarDecl *decl) {
+    return decl->getType().getAsString() + " " + decl->getNameAsString();
+}
+
+FunctionPrototype CreateWrapperPrototype(ASTContext &astContext, const CallExpr *call,
+                                         const FunctionDecl *decl,
+                                         const std::string &wrapperName, bool isMemberFunc) {
+    FunctionPrototype newPrototype;
+
+    newPrototype.filename = astContext.getSourceManager().getFilename(decl->getLocation()).str();
+
+    newPrototype.returnType = decl->getReturnType().getAsString();
+    // Static inline, so that with VPROF_ENABLED=0 the wrapper folds into the
+    // original call.
+    newPrototype.functionPrototype += "static inline " + newPrototype.returnType + " " + wrapperName + "(";
+
+    // Explicit template arguments of the call, which can not always be deduced
+    // from the forwarded arguments.
+    std::string templateArgs = GetExplicitTemplateArgs(call, astContext.getLangOpts());
+    bool isCXXMethodAndNotStatic = false;
+    std::string objParam;
+    if (isMemberFunc) {
+        const CXXMethodDecl *methodDecl = static_cast<const CXXMethodDecl*>(decl);
+        if (methodDecl->isStatic()) {
+            newPrototype.innerCallPrefix = decl->getQualifiedNameAsString() + templateArgs;
+        }
+        else {
+            isCXXMethodAndNotStatic = true;
+
+            newPrototype.innerCallPrefix = "obj->" + methodDecl->getNameAsString() + templateArgs;
+            objParam = methodDecl->getThisType(astContext).getAsString() + " obj";
+            newPrototype.functionPrototype += objParam;
+        }
+    }
+    else {
+        newPrototype.innerCallPrefix = decl->getQualifiedNameAsString() + templateArgs;
+    }
+
+    for (unsigned int i = 0, j = decl->getNumParams(); i < j; i++) {
+        if (isCXXMethodAndNotStatic && i == 0) {
+            newPrototype.functionPrototype +=", ";
+        }
+
+        const ParmVarDecl* paramDecl = decl->getParamDecl(i);
+        newPrototype.functionPrototype += getParamDeclAsString(paramDecl);
+
+        newPrototype.paramVars.push_back(paramDecl->getNameAsString() + (paramDecl->isParameterPack() ? "..." : ""));
+
+        if (i != (j - 1)) {
+            newPrototype.functionPrototype += ", ";
+        }
+    }
+
+    newPrototype.functionPrototype += ")";
+    newPrototype.isMemberCall = isMemberFunc;
+
+    // C++ wrappers take their arguments by forwarding reference and return
+    // the call directly, so no argument or result is copied.
+    if (astContext.getLangOpts().CPlusPlus11) {
+        MakeForwardingPrototype(newPrototype, wrapperName, objParam);
+    }
+    return newPrototype;
+}
+
+std::string GetFunctionNameInFile(const FunctionDecl *decl, int index) {
+    std::string functionNameInFile = decl->getQualifiedNameAsString() + '-' + std::to_string(index);
+    for (unsigned int i = 0, j = decl->getNumParams(); i < j; i++) {
+        functionNameInFile += "|" + decl->getParamDecl(i)->getNameAsString();
+    }
+    return functionNameInFile;
+}
+
+std::string GenerateWrapperImpl(const FunctionPrototype &prototype,
+                                const std::string &guard,
+                                const std::string &startProbe,
+                                const std::string &endProbe) {
+    std::string implementation;
+    implementation += prototype.functionPrototype + " {\n\t";
+
+    if (prototype.isForwarding) {
+        implementation += guard + "\n\t";
+        implementation += "return " + prototype.innerCallPrefix + "(" + prototype.paramVars[0] + ");\n}\n\n";
+        return implementation;
+    }
+
+    implementation += startProbe + "\n\t";
+    if (prototype.returnType != "void") {
+        implementation += prototype.returnType + " result = ";
+    }
+
+    implementation += prototype.innerCallPrefix + "(";
+
+    for (int i = 0, j = prototype.paramVars.size(); i < j; i++) {
+        implementation += prototype.paramVars[i];
+
+        if (i != (j - 1)) {
+            implementation += ", ";
+        }
+    }
+
+    implementation += ");\n\t";
+
+    implementation += endProbe + "\n";
+
+    if (prototype.returnType != "void") {
+        implementation += "\treturn result;\n";
+    }
+
+    implementation += "}\n\n";
+
+    return implementation;
+}
+
+void MakeForwardingPrototype(FunctionPrototype &prototype, const std::string &wrapperName,
+                             const std::string &objParam) {
+    std::string forwardedArgs = "std::forward<VProfArgs>(args)...";
+
+    prototype.functionPrototype = "template <typename... VProfArgs>\nstatic inline auto " + wrapperName + "(";
+    if (!objParam.empty()) {
+        prototype.functionPrototype += objParam + ", ";
+    }
+    prototype.functionPrototype += "VProfArgs&&... args) -> decltype(" +
+                                   prototype.innerCallPrefix + "(" + forwardedArgs + "))";
+
+    prototype.paramVars.clear();
+    prototype.paramVars.push_back(forwardedArgs);
+    prototype.isForwarding = true;
+}
+
+std::string GetUSR(const Decl *decl) {
+    llvm::SmallString<128> usr;
+    if (index::generateUSRForDecl(decl, usr)) {
+        return "";
+    }
+    return usr.str().str();
+}
+
+bool IsTrivialCallee(const FunctionDecl *decl) {
+    CallGraph *callGraph = CallGraph::GetInstance();
+    if (!callGraph->IsLoaded()) {
+        return false;
+    }
+    std::string usr = GetUSR(decl);
+    return !usr.empty() && callGraph->IsTrivial(usr);
+}
+
+bool IsUntracedCallee(const FunctionDecl *decl) {
+    const std::string functionName = decl->getQualifiedNameAsString();
+    return functionName == "SESSION_START" ||
+           functionName == "SESSION_END" ||
+           functionName == "PATH_INC" ||
+           functionName == "PATH_DEC" ||
+           functionName == "TRACE_TARGET_FUNCTION_START" ||
+           IsTrivialCallee(decl);
+}
+
+bool IsIndirectCall(const CallExpr *call) {
+    if (isa<CXXMemberCallExpr>(call) || call->isTypeDependent()) {
+        return false;
+    }
+
+    const CXXOperatorCallExpr *operatorCall = dyn_cast<CXXOperatorCallExpr>(call);
+    if (operatorCall) {
+        return operatorCall->getOperator() == OO_Call;
+    }
+
+    QualType calleeType = call->getCallee()->getType();
+    return call->getDirectCallee() == nullptr &&
+           (calleeType->isFunctionPointerType() || calleeType->isFunctionType());
+}
+
+const Expr *GetIndirectCallee(const CallExpr *call) {
+    if (isa<CXXOperatorCallExpr>(call)) {
+        return call->getArg(0);
+    }
+    return call->getCallee();
+}
+
+std::vector<const Expr*> GetIndirectCallArgs(const CallExpr *call) {
+    std::vector<const Expr*> args;
+    for (unsigned int i = isa<CXXOperatorCallExpr>(call) ? 1 : 0, j = call->getNumArgs(); i < j; i++) {
+        // Default arguments are left to the called operator().
+        if (isa<CXXDefaultArgExpr>(call->getArg(i))) {
+            break;
+        }
+        args.push_back(call->getArg(i));
+    }
+    return args;
+}
+
+std::string GetIndirectWrapperName(MangleContext &mangleContext, const CallExpr *call, int index) {
+    const FunctionDecl *decl = call->getDirectCallee();
+    if (decl) {
+        return GetWrapperName(mangleContext, decl, index);
+    }
+    return "vprofiler_indirect_" + std::to_string(index);
+}
+
+std::string GetIndirectCalleeName(const CallExpr *call, const LangOptions &langOpts) {
+    std::string name;
+    const FunctionDecl *decl = call->getDirectCallee();
+    if (decl) {
+        name = decl->getQualifiedNameAsString();
+    } else {
+        llvm::raw_string_ostream s(name);
+        GetIndirectCallee(call)->printPretty(s, 0, PrintingPolicy(langOpts));
+        s.flush();
+        name = "indirect:" + name;
+    }
+
+    // Separators of the function names file can not appear in the name.
+    std::string readableName;
+    for (char c : name) {
+        if (c == ',') {
+            readableName += ';';
+        } else if (c == '|') {
+            readableName += '/';
+        } else if (c == '-') {
+            readableName += '_';
+        } else if (c != ' ' && c != '\n' && c != '\t') {
+            readableName += c;
+        }
+    }
+    return readableName;
+}
+
+static const FunctionProtoType *getCalleePrototype(const CallExpr *call) {
+    QualType calleeType = call->getCallee()->getType();
+    if (calleeType->isPointerType()) {
+        calleeType = calleeType->getPointeeType();
+    }
+    return calleeType->getAs<FunctionProtoType>();
+}
+
+bool CanWrapIndirectCall(ASTContext &astContext, const CallExpr *call) {
+    if (astContext.getLangOpts().CPlusPlus11) {
+        return true;
+    }
+    // Callable objects are only wrapped by the forwarding wrappers.
+    if (isa<CXXOperatorCallExpr>(call)) {
+        return false;
+    }
+    const FunctionProtoType *prototype = getCalleePrototype(call);
+    return prototype != nullptr && !prototype->isVariadic();
+}
+
+static std::string generateForwardingWrapperImpl(const std::string &wrapperName,
+                                                 const std::string &guard) {
+    std::string call = "std::forward<VProfCallee>(callee)(std::forward<VProfArgs>(args)...)";
+    std::string implementation = "template <typename VProfCallee, typename... VProfArgs>\n";
+    implementation += "static inline auto " + wrapperName + "(VProfCallee &&callee, VProfArgs&&... args) -> decltype(" +
+                      call + ") {\n\t";
+    implementation += guard + "\n\t";
+    implementation += "return " + call + ";\n}\n\n";
+    return implementation;
+}
+
+std::string GenerateIndirectWrapperImpl(ASTContext &astContext,
+                                        const CallExpr *call,
+                                        const std::string &wrapperName,
+                                        const std::string &guard,
+                                        const std::string &startProbe,
+                                        const std::string &endProbe) {
+    if (astContext.getLangOpts().CPlusPlus11) {
+        return generateForwardingWrapperImpl(wrapperName, guard);
+    }
+
+    if (!CanWrapIndirectCall(astContext, call)) {
+        return "";
+    }
+    const FunctionProtoType *prototype = getCalleePrototype(call);
+
+    PrintingPolicy policy(astContext.getLangOpts());
+    std::string returnType = prototype->getReturnType().getAsString(policy);
+    std::string calleeParam = "callee";
+    astContext.getPointerType(QualType(prototype, 0)).getAsStringInternal(calleeParam, policy);
+
+    std::string params;
+    std::string args;
+    for (unsigned int i = 0, j = prototype->getNumParams(); i < j; i++) {
+        std::string param = "arg" + std::to_string(i);
+        args += (i == 0 ? "" : ", ") + param;
+        prototype->getParamType(i).getAsStringInternal(param, policy);
+        params += ", " + param;
+    }
+
+    std::string implementation = "static inline " + returnType + " " + wrapperName + "(" +
+                                 calleeParam + params + ") {\n\t";
+    implementation += startProbe + "\n\t";
+    if (returnType != "void") {
+        implementation += returnType + " result = ";
+    }
+    implementation += "callee(" + args + ");\n\t";
+    implementation += endProbe + "\n";
+    if (returnType != "void") {
+        implementation += "\treturn result;\n";
+    }
+    implementation += "}\n\n";
+    return implementation;
+}
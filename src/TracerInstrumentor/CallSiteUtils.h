@@ -0,0 +1,113 @@
+#ifndef CALL_SITE_UTILS_H
+#define CALL_SITE_UTILS_H
+
+// Clang libs
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/ExprCXX.h"
+#include "clang/AST/Mangle.h"
+#include "clang/Rewrite/Core/Rewriter.h"
+
+// STL libs
+#include <string>
+#include <vector>
+
+#include "FunctionPrototype.h"
+
+// Helpers shared by the tracer instrumentors for rewriting the calls they
+// trace, and for generating the wrappers these calls are rewritten to call.
+
+// Name of the wrapper of a call to decl, built from its mangled name so that
+// overloads and template instantiations never share a wrapper.
+std::string GetWrapperName(clang::MangleContext &mangleContext,
+                           const clang::FunctionDecl *decl, int index);
+
+// Argument of a call rewritten to call a wrapper. Forwarding wrappers deduce
+// the type of the argument itself, so null pointer constants and braced lists
+// are converted to the type of their parameter first.
+std::string GetArgAsString(const clang::Expr *arg, const clang::LangOptions &langOpts);
+
+// Template arguments written in the call, such as "<int, 2>" for f<int, 2>(x),
+// or an empty string if there are none.
+std::string GetExplicitTemplateArgs(const clang::CallExpr *call, const clang::LangOptions &langOpts);
+
+// Whether smallRange lies within largeRange.
+bool InRange(clang::SourceRange largeRange, clang::SourceRange smallRange);
+
+// Rewrites the call to call wrapperName instead, with a pointer to the object
+// first for member calls.
+void RewriteCall(clang::Rewriter &rewriter, const clang::CallExpr *call,
+                 const std::string &wrapperName, bool isMemberCall);
+
+// Rewrites the indirect call to call wrapperName with the callee first.
+void RewriteIndirectCall(clang::Rewriter &rewriter, const clang::CallExpr *call,
+                         const std::string &wrapperName);
+
+// Prototype of the wrapper named wrapperName of the call to decl, forwarding
+// its arguments in C++11.
+FunctionPrototype CreateWrapperPrototype(clang::ASTContext &astContext, const clang::CallExpr *call,
+                                         const clang::FunctionDecl *decl,
+                                         const std::string &wrapperName, bool isMemberFunc);
+
+// Line of the function names file for the callee decl logged at index, i.e.
+// "name-index|param|param".
+std::string GetFunctionNameInFile(const clang::FunctionDecl *decl, int index);
+
+// Returns the wrapper with the prototype.
+// guard is used by forwarding wrappers, startProbe and endProbe by others.
+std::string GenerateWrapperImpl(const FunctionPrototype &prototype,
+                                const std::string &guard,
+                                const std::string &startProbe,
+                                const std::string &endProbe);
+
+// Turns the prototype into a template forwarding its arguments to the wrapped
+// call, after objParam if the wrapper takes the object of a member call.
+void MakeForwardingPrototype(FunctionPrototype &prototype, const std::string &wrapperName,
+                             const std::string &objParam);
+
+// Unified Symbol Resolution of the declaration, which tells overloads,
+// template specializations and static functions of different files apart.
+// Empty if clang can not give one.
+std::string GetUSR(const clang::Decl *decl);
+
+// Whether the loaded static call graph shows the callee to be a leaf too
+// cheap for tracing its calls to be worth the wrapper. False without a graph.
+bool IsTrivialCallee(const clang::FunctionDecl *decl);
+
+// Whether calls to decl are left without a wrapper, being trivial or calls
+// of the probes themselves. Every pass numbering the callees of a function
+// skips the same calls, so that the caller pass finds the callee the tracer
+// passes gave an index to.
+bool IsUntracedCallee(const clang::FunctionDecl *decl);
+
+// Calls through function pointers, and calls of callable objects such as
+// lambdas and std::function, whose operator() is wrapped at the call site.
+bool IsIndirectCall(const clang::CallExpr *call);
+
+// Expression the indirect call calls, i.e. the pointer or the callable object.
+const clang::Expr *GetIndirectCallee(const clang::CallExpr *call);
+
+// Arguments of the indirect call, without the callable object.
+std::vector<const clang::Expr*> GetIndirectCallArgs(const clang::CallExpr *call);
+
+std::string GetIndirectWrapperName(clang::MangleContext &mangleContext,
+                                   const clang::CallExpr *call, int index);
+
+// Readable name written to the function names file.
+std::string GetIndirectCalleeName(const clang::CallExpr *call, const clang::LangOptions &langOpts);
+
+// Before C++11 only calls through pointers to prototyped, non-variadic
+// functions can be wrapped, other indirect calls are left alone.
+bool CanWrapIndirectCall(clang::ASTContext &astContext, const clang::CallExpr *call);
+
+// Returns the wrapper taking the callee as its first argument, or an empty
+// string if the call can not be wrapped.
+// guard is used by C++ wrappers, startProbe and endProbe by C ones.
+std::string GenerateIndirectWrapperImpl(clang::ASTContext &astContext,
+                                        const clang::CallExpr *call,
+                                        const std::string &wrapperName,
+                                        const std::string &guard,
+                                        const std::string &startProbe,
+                                        const std::string &endProbe);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef CALLEE_COLLECTOR_FRONT_END_FACTORY_H
+#define CALLEE_COLLECTOR_FRONT_END_FACTORY_H
+
+#include "CalleeCollectorVisitor.h"
+
+#include "clang/Tooling/Tooling.h"
+
+class CalleeCollectorASTConsumer : public clang::ASTConsumer {
+    private:
+        std::unique_ptr<CalleeCollectorVisitor> visitor;
+
+    public:
+        explicit CalleeCollectorASTConsumer(const std::set<std::string> &_callerNames,
+                                            std::shared_ptr<std::set<std::string>> _callees) {
+            visitor = std::unique_ptr<CalleeCollectorVisitor>(new CalleeCollectorVisitor(_callerNames,
+                                                                                        _callees));
+        }
+
+        ~CalleeCollectorASTConsumer() {}
+
+        virtual void HandleTranslationUnit(clang::ASTContext &context) {
+            visitor->TraverseDecl(context.getTranslationUnitDecl());
+        }
+};
+
+class CalleeCollectorFrontendAction : public clang::ASTFrontendAction {
+    private:
+        const std::set<std::string> &callerNames;
+
+        std::shared_ptr<std::set<std::string>> callees;
+
+    public:
+        CalleeCollectorFrontendAction(const std::set<std::string> &_callerNames,
+                                      std::shared_ptr<std::set<std::string>> _callees) :
+                                      callerNames(_callerNames),
+                                      callees(_callees) {}
+
+        ~CalleeCollectorFrontendAction() {}
+
+        virtual std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance &ci,
+                                                                      llvm::StringRef file) {
+            return std::unique_ptr<CalleeCollectorASTConsumer>(new CalleeCollectorASTConsumer(callerNames,
+                                                                                              callees));
+        }
+};
+
+class CalleeCollectorFrontendActionFactory : public clang::tooling::FrontendActionFactory {
+    private:
+        std::set<std::string> callerNames;
+
+        std::shared_ptr<std::set<std::string>> callees;
+
+    public:
+        CalleeCollectorFrontendActionFactory(std::set<std::string> _callerNames,
+                                             std::shared_ptr<std::set<std::string>> _callees) :
+                                             callerNames(_callerNames),
+                                             callees(_callees) {}
+
+        // Creates a CalleeCollectorFrontendAction to be used by clang tool.
+        virtual CalleeCollectorFrontendAction *create() {
+            return new CalleeCollectorFrontendAction(callerNames, callees);
+        }
+};
+
+// Callees found in any of the files run are added to callees.
+std::unique_ptr<CalleeCollectorFrontendActionFactory> CreateCalleeCollectorFrontendActionFactory(
+        std::set<std::string> callerNames, std::shared_ptr<std::set<std::string>> callees) {
+    return std::unique_ptr<CalleeCollectorFrontendActionFactory>(
+        new CalleeCollectorFrontendActionFactory(callerNames, callees));
+}
+
+#endif
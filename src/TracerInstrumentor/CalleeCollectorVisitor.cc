@@ -0,0 +1,67 @@
+#include "CalleeCollectorVisitor.h"
+
+using namespace clang;
+
+std::string CalleeCollectorVisitor::getFunctionNameAndArgs(const clang::FunctionDecl *decl) {
+    std::string nameAndArgs = decl->getQualifiedNameAsString();
+
+    for (unsigned int i = 0, j = decl->getNumParams(); i < j; i++) {
+        const ParmVarDecl* paramDecl = decl->getParamDecl(i);
+        nameAndArgs += "|" + paramDecl->getNameAsString();
+    }
+    return nameAndArgs;
+}
+
+bool CalleeCollectorVisitor::inRange(clang::SourceRange largeRange, clang::SourceRange smallRange) {
+    unsigned start = smallRange.getBegin().getRawEncoding();
+    unsigned end = smallRange.getEnd().getRawEncoding();
+    return largeRange.getBegin().getRawEncoding() <= start &&
+           end <= largeRange.getEnd().getRawEncoding();
+}
+
+void CalleeCollectorVisitor::collectCallee(const CallExpr *call, const FunctionDecl *decl) {
+    if (!inCaller || !inRange(callerRange, SourceRange(call->getLocStart(), call->getLocEnd()))) {
+        return;
+    }
+    callees->insert(getFunctionNameAndArgs(decl));
+}
+
+bool CalleeCollectorVisitor::VisitFunctionDecl(const clang::FunctionDecl *decl) {
+    if (!decl->isThisDeclarationADefinition() || !decl->hasBody()) {
+        return true;
+    }
+
+    if (callerNames.find(getFunctionNameAndArgs(decl)) != callerNames.end()) {
+        inCaller = true;
+        callerRange = decl->getSourceRange();
+    }
+    return true;
+}
+
+bool CalleeCollectorVisitor::VisitCallExpr(const CallExpr *call) {
+    const FunctionDecl *decl = call->getDirectCallee();
+    // Exit if call is to a function pointer
+    if (!decl || isa<CXXMemberCallExpr>(call)) {
+        return true;
+    }
+    collectCallee(call, decl);
+
+    return true;
+}
+
+bool CalleeCollectorVisitor::VisitCXXMemberCallExpr(const clang::CXXMemberCallExpr *call) {
+    if (call->getMethodDecl() == nullptr) {
+        return true;
+    }
+    collectCallee(call, call->getMethodDecl());
+
+    return true;
+}
+
+CalleeCollectorVisitor::CalleeCollectorVisitor(const std::set<std::string> &_callerNames,
+                                               std::shared_ptr<std::set<std::string>> _callees):
+                                               callerNames(_callerNames),
+                                               callees(_callees),
+                                               inCaller(false) {}
+
+CalleeCollectorVisitor::~CalleeCollectorVisitor() {}
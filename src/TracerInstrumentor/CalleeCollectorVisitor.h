@@ -0,0 +1,54 @@
+#ifndef CALLEE_COLLECTOR_VISITOR_H
+#define CALLEE_COLLECTOR_VISITOR_H
+
+// Clang libs
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/ExprCXX.h"
+#include "clang/AST/Decl.h"
+
+// STL libs
+#include <memory>
+#include <set>
+#include <string>
+
+// Collects the functions called directly by a set of caller functions, without
+// rewriting anything.  Used to walk the call graph down from a target.
+class CalleeCollectorVisitor : public clang::RecursiveASTVisitor<CalleeCollectorVisitor> {
+    private:
+        // Names and parameter names of the callers, joined by '|'.
+        const std::set<std::string> &callerNames;
+
+        std::shared_ptr<std::set<std::string>> callees;
+
+        clang::SourceRange callerRange;
+
+        bool inCaller;
+
+        std::string getFunctionNameAndArgs(const clang::FunctionDecl *decl);
+
+        bool inRange(clang::SourceRange largeRange, clang::SourceRange smallRange);
+
+        void collectCallee(const clang::CallExpr *call, const clang::FunctionDecl *decl);
+
+    public:
+        explicit CalleeCollectorVisitor(const std::set<std::string> &_callerNames,
+                                        std::shared_ptr<std::set<std::string>> _callees);
+
+        ~CalleeCollectorVisitor();
+
+        // Override trigger for when a FunctionDecl is found in the AST
+        virtual bool VisitFunctionDecl(const clang::FunctionDecl *decl);
+
+        // Override trigger for when a CallExpr is found in the AST
+        virtual bool VisitCallExpr(const clang::CallExpr *call);
+
+        // Override trigger for when a CXXMemberCallExpr is found in the AST
+        virtual bool VisitCXXMemberCallExpr(const clang::CXXMemberCallExpr *call);
+};
+
+#endif
@@ -2,6 +2,8 @@
 #define CALLER_INSTRUMENTOR_FRONT_END_FACTORY_H
 
 #include "CallerInstrumentorVisitor.h"
+#include "PreviousSources.h"
+#include "Utils.h"
 
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/Twine.h"
@@ -86,7 +88,7 @@ class CallerInstrumentorFrontendAction : public clang::ASTFrontendAction {
             return backupFileName + std::to_string(i);
         }
 
-        std::string writePathFile(const std::string &backupFileName) {
+        void writePathFile(const std::string &backupFileName) {
             std::string backupPathsFilename;
 
             if (backupPath[backupPath.length() - 1] != '/') {
@@ -95,19 +97,17 @@ class CallerInstrumentorFrontendAction : public clang::ASTFrontendAction {
                 backupPathsFilename = backupPath + "CallerFilenames";
             }
 
-            std::string unoverwrittenFileName = nextBackupFileName(backupFileName);
             std::error_code OutErrInfo;
             std::error_code ok;
             llvm::raw_fd_ostream outputFile(llvm::StringRef(backupPathsFilename), 
                                             OutErrInfo, llvm::sys::fs::F_Append); 
             if (OutErrInfo == ok) {
-                outputFile << unoverwrittenFileName + '\t' + fileDir + filename + '\n';
+                outputFile << backupFileName + '\t' + fileDir + filename + '\n';
                 outputFile.close();
             }
-            return unoverwrittenFileName;
         }
 
-        void backupFile() {
+        bool backupFile() {
             std::string backupFileName;
             if (backupPath[backupPath.length() - 1] != '/') {
                 backupFileName = backupPath + "/" + filename;
@@ -115,34 +115,47 @@ class CallerInstrumentorFrontendAction : public clang::ASTFrontendAction {
                 backupFileName = backupPath + filename;
             }
 
-            std::string unoverwrittenFileName = writePathFile(backupFileName);
+            std::string unoverwrittenFileName = nextBackupFileName(backupFileName);
 
             std::error_code OutErrInfo;
             std::error_code ok;
             llvm::raw_fd_ostream outputFile(llvm::StringRef(unoverwrittenFileName), 
                                             OutErrInfo, llvm::sys::fs::F_None); 
-            if (OutErrInfo == ok) {
-                clang::SourceManager &manager = rewriter->getSourceMgr();
-                outputFile << manager.getBufferData(fileID);
-                outputFile.close();
+            if (OutErrInfo != ok) {
+                return false;
+            }
+            clang::SourceManager &manager = rewriter->getSourceMgr();
+            outputFile << manager.getBufferData(fileID);
+            outputFile.close();
+            if (outputFile.has_error()) {
+                return false;
             }
+
+            // Listed once written, so that the restorer never finds a partial
+            // backup.
+            writePathFile(unoverwrittenFileName);
+            return true;
+        }
+
+        void reportError(const std::string &message) {
+            clang::DiagnosticsEngine &diagnostics = getCompilerInstance().getDiagnostics();
+            diagnostics.Report(diagnostics.getCustomDiagID(clang::DiagnosticsEngine::Error, "%0")) << message;
         }
 
         void EndSourceFileAction() override {
             if (*shouldFlush) {
-                std::error_code OutErrInfo;
-                std::error_code ok;
-
-                llvm::raw_fd_ostream outputFile(llvm::StringRef(filename), 
-                                                OutErrInfo, llvm::sys::fs::F_None); 
-
-                if (OutErrInfo == ok) {
-                    backupFile();
-                    const clang::RewriteBuffer *RewriteBuf = rewriter->getRewriteBufferFor(fileID);
-                    outputFile << "// TraceTool included header\n#include \"trace_tool.h\"\n\n";
-                    std::string content = std::string(RewriteBuf->begin(), RewriteBuf->end());
-                    outputFile << content;
-                    outputFile.close();
+                const clang::RewriteBuffer *RewriteBuf = rewriter->getRewriteBufferFor(fileID);
+                std::string content = "// TraceTool included header\n#include \"trace_tool.h\"\n\n";
+                content += std::string(RewriteBuf->begin(), RewriteBuf->end());
+                PreviousSources::GetInstance()->Forget(filename);
+                // Backups of the caller pile up, so an unchanged file needs none.
+                if (FileContentEquals(filename, content)) {
+                    return;
+                }
+                if (!backupFile()) {
+                    reportError("could not back up " + filename + ", leaving it uninstrumented");
+                } else if (!WriteFile(filename, content)) {
+                    reportError("could not write the instrumented " + filename);
                 }
             }
         }
@@ -80,9 +80,19 @@ bool CallerInstrumentorVisitor::VisitCallExpr(const CallExpr *call) {
     if (!inCaller(call)) {
         return true;
     }
+    // Wrapped indirect calls take an index as well.
+    if (IsIndirectCall(call)) {
+        if (CanWrapIndirectCall(*astContext, call)) {
+            if (functionIndex == targetInCallerIndex) {
+                insertPathCountUpdates(call);
+            }
+            functionIndex++;
+        }
+        return true;
+    }
     const FunctionDecl *decl = call->getDirectCallee();
-    // Exit if call is to a function pointer
-    if (!decl || isa<CXXMemberCallExpr>(call)) {
+    // Exit if the callee is only known at instantiation, or has no index.
+    if (!decl || isa<CXXMemberCallExpr>(call) || IsUntracedCallee(decl)) {
         return true;
     }
 
@@ -99,7 +109,7 @@ bool CallerInstrumentorVisitor::VisitCXXMemberCallExpr(const clang::CXXMemberCal
     if (!inCaller(call)) {
         return true;
     }
-    if (call->getMethodDecl() == nullptr) {
+    if (call->getMethodDecl() == nullptr || IsUntracedCallee(call->getMethodDecl())) {
         return true;
     }
 
@@ -22,6 +22,7 @@
 #include <utility>
 
 #include "FunctionPrototype.h"
+#include "CallSiteUtils.h"
 
 class CallerInstrumentorVisitor : public clang::RecursiveASTVisitor<CallerInstrumentorVisitor> {
     private:
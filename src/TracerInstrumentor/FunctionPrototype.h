@@ -13,7 +13,7 @@ class FunctionPrototype {
     public:
         FunctionPrototype():
         functionPrototype(""), innerCallPrefix(""), paramVars(),
-        returnType(""), filename(""), isMemberCall(false) {}
+        returnType(""), filename(""), isMemberCall(false), isForwarding(false) {}
 
         std::string functionPrototype;
         std::string innerCallPrefix;
@@ -25,6 +25,10 @@ class FunctionPrototype {
         std::string filename;
 
         bool isMemberCall;
+
+        // Whether the wrapper is a C++ template forwarding its arguments, in
+        // which case paramVars holds the forwarded argument pack.
+        bool isForwarding;
 };
 
 #endif
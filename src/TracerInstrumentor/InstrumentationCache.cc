@@ -0,0 +1,285 @@
+#include "InstrumentationCache.h"
+#include "PreviousSources.h"
+#include "Utils.h"
+
+// LLVM libs
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+
+// STL libs
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+// Bumped whenever the format of the entries changes.
+static const char *CACHE_VERSION = "1";
+
+static bool readFile(const std::string &filename, std::string &content) {
+    std::ifstream inputFile(filename, std::ios::binary);
+    if (!inputFile) {
+        return false;
+    }
+    content.assign((std::istreambuf_iterator<char>(inputFile)), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static std::string hashString(const std::string &content) {
+    llvm::MD5 hash;
+    hash.update(llvm::StringRef(content));
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> hexResult;
+    llvm::MD5::stringifyResult(result, hexResult);
+    return hexResult.str().str();
+}
+
+std::string InstrumentationCache::HashFile(const std::string &filename) {
+    std::string content;
+    return readFile(filename, content) ? hashString(content) : "";
+}
+
+InstrumentationCache::InstrumentationCache(const std::string &_cacheDir, const std::string &_spec,
+                                           const std::string &_functionNamesFile,
+                                           const std::vector<std::string> &_backupLists):
+                                           cacheDir(_cacheDir),
+                                           spec(_spec),
+                                           functionNamesFile(_functionNamesFile),
+                                           backupLists(_backupLists) {
+    if (cacheDir[cacheDir.length() - 1] != '/') {
+        cacheDir += "/";
+    }
+    llvm::sys::fs::create_directories(llvm::Twine(cacheDir));
+    dependencyFile = cacheDir + "dependencies";
+
+    // Hashed from the binary rather than from the build time of this file,
+    // which is not recompiled when only the visitors change.
+    std::string instrumentor = llvm::sys::fs::getMainExecutable(
+        nullptr, reinterpret_cast<void *>(&InstrumentationCache::HashFile));
+    instrumentorHash = instrumentor.empty() ? "" : HashFile(instrumentor);
+}
+
+std::string InstrumentationCache::entryDir(const std::string &key) {
+    return cacheDir + key + "/";
+}
+
+// The instrumentor itself is part of the key, so that rebuilding it with
+// other instrumentation does not replay stale entries.
+std::string InstrumentationCache::computeKey(const std::string &content, const std::string &pass,
+                                             const std::string &filename,
+                                             const clang::tooling::CompilationDatabase &compilations) {
+    std::string key = std::string(CACHE_VERSION) + '\0' + instrumentorHash + '\0' +
+                      spec + '\0' + pass + '\0' + filename + '\0' + hashString(content) + '\0';
+    for (const clang::tooling::CompileCommand &command : compilations.getCompileCommands(filename)) {
+        key += command.Directory + '\0';
+        for (const std::string &arg : command.CommandLine) {
+            key += arg + '\0';
+        }
+    }
+    return hashString(key);
+}
+
+clang::tooling::ArgumentsAdjuster InstrumentationCache::DependencyAdjuster() const {
+    std::string depFile = dependencyFile;
+    return [depFile](const clang::tooling::CommandLineArguments &args, llvm::StringRef) {
+        clang::tooling::CommandLineArguments adjustedArgs(args);
+        adjustedArgs.push_back("-MMD");
+        adjustedArgs.push_back("-MF");
+        adjustedArgs.push_back(depFile);
+        return adjustedArgs;
+    };
+}
+
+// Parses the make rule written by -MMD, whose first prerequisite is the file
+// itself.
+std::vector<std::string> InstrumentationCache::readDependencies() {
+    std::vector<std::string> dependencies;
+    std::string rule;
+    if (!readFile(dependencyFile, rule)) {
+        return dependencies;
+    }
+
+    size_t prerequisites = rule.find(": ");
+    if (prerequisites == std::string::npos) {
+        return dependencies;
+    }
+
+    std::string dependency;
+    bool isFirst = true;
+    for (size_t i = prerequisites + 2; i <= rule.length(); i++) {
+        char c = i < rule.length() ? rule[i] : ' ';
+        if (c == '\\' && i + 1 < rule.length() && rule[i + 1] == ' ') {
+            dependency += ' ';
+            i++;
+        } else if (c == '\\' || c == '\n' || c == '\r') {
+            continue;
+        } else if (c != ' ' && c != '\t') {
+            dependency += c;
+        } else if (!dependency.empty()) {
+            if (!isFirst) {
+                dependencies.push_back(dependency);
+            }
+            isFirst = false;
+            dependency.clear();
+        }
+    }
+    return dependencies;
+}
+
+bool InstrumentationCache::dependenciesUnchanged(const std::string &entry) {
+    std::ifstream manifest(entry + "manifest");
+    if (!manifest) {
+        return false;
+    }
+
+    std::string line;
+    while (getline(manifest, line)) {
+        size_t separator = line.rfind('\t');
+        if (separator == std::string::npos ||
+            HashFile(line.substr(0, separator)) != line.substr(separator + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::map<std::string, std::string> InstrumentationCache::functionNamesFiles() {
+    std::map<std::string, std::string> files;
+    llvm::SmallString<128> dir(llvm::sys::path::parent_path(functionNamesFile));
+    if (dir.empty()) {
+        dir = ".";
+    }
+    std::string prefix = llvm::sys::path::filename(functionNamesFile).str();
+
+    std::error_code ec;
+    for (llvm::sys::fs::directory_iterator it(dir, ec), end; it != end && !ec; it.increment(ec)) {
+        if (llvm::sys::path::filename(it->path()).startswith(prefix)) {
+            readFile(it->path(), files[it->path()]);
+        }
+    }
+    return files;
+}
+
+// Entry layout: output holds the rewritten file, manifest the headers and
+// their hashes, outputs the other files written, as "write" or "backups"
+// lines naming the file and the entry file holding what was written.
+void InstrumentationCache::replay(const std::string &entry, const std::string &filename,
+                                  const std::string &content) {
+    std::ifstream outputs(entry + "outputs");
+    std::string line;
+    while (getline(outputs, line)) {
+        std::vector<std::string> fields = SplitString(line, '\t');
+        std::string written;
+        if (fields.size() != 3 || !readFile(entry + fields[2], written)) {
+            continue;
+        }
+
+        if (fields[0] == "write") {
+            WriteFileIfChanged(fields[1], written);
+        } else {
+            // Backups hold the file as it was before the passes, which is the
+            // content the entry was found with.
+            std::ofstream backupList(fields[1], std::ios::binary | std::ios::app);
+            std::istringstream backupLines(written);
+            std::string backupLine;
+            while (getline(backupLines, backupLine)) {
+                std::vector<std::string> paths = SplitString(backupLine, '\t');
+                if (paths.size() == 2) {
+                    WriteFileIfChanged(paths[0], content);
+                    backupList << backupLine << '\n';
+                }
+            }
+        }
+    }
+
+    std::string output;
+    if (readFile(entry + "output", output)) {
+        WriteFileIfChanged(filename, output);
+    }
+}
+
+void InstrumentationCache::store(const std::string &entry, const std::string &filename,
+                                 const std::map<std::string, std::string> &backupListsBefore) {
+    llvm::sys::fs::create_directories(llvm::Twine(entry));
+
+    std::ofstream outputs(entry + "outputs", std::ios::trunc);
+    int numOutputs = 0;
+    for (auto &file : functionNamesFiles()) {
+        std::string outputName = "output" + std::to_string(numOutputs++);
+        WriteFileIfChanged(entry + outputName, file.second);
+        outputs << "write\t" << file.first << '\t' << outputName << '\n';
+    }
+    for (auto &backupList : backupListsBefore) {
+        std::string after;
+        readFile(backupList.first, after);
+        if (after.length() > backupList.second.length() &&
+            after.compare(0, backupList.second.length(), backupList.second) == 0) {
+            std::string outputName = "output" + std::to_string(numOutputs++);
+            WriteFileIfChanged(entry + outputName, after.substr(backupList.second.length()));
+            outputs << "backups\t" << backupList.first << '\t' << outputName << '\n';
+        }
+    }
+    outputs.close();
+
+    // A file of the previous round the passes left alone is restored.
+    std::string output;
+    const std::string *previousSource = PreviousSources::GetInstance()->Find(filename);
+    if (previousSource != nullptr) {
+        WriteFileIfChanged(entry + "output", *previousSource);
+    } else if (readFile(filename, output)) {
+        WriteFileIfChanged(entry + "output", output);
+    }
+
+    // Written last, since an entry without a manifest is never hit.
+    std::ofstream manifest(entry + "manifest", std::ios::trunc);
+    for (const std::string &dependency : readDependencies()) {
+        manifest << dependency << '\t' << HashFile(dependency) << '\n';
+    }
+    manifest.close();
+}
+
+bool InstrumentationCache::Instrument(const std::string &filename, const std::string &pass,
+                                      const clang::tooling::CompilationDatabase &compilations,
+                                      const std::function<void()> &instrument) {
+    // Files of the previous round are instrumented from their backups.
+    std::string content;
+    const std::string *previousSource = PreviousSources::GetInstance()->Find(filename);
+    if (previousSource != nullptr) {
+        content = *previousSource;
+    } else if (!readFile(filename, content)) {
+        instrument();
+        return false;
+    }
+
+    std::string entry = entryDir(computeKey(content, pass, filename, compilations));
+    if (dependenciesUnchanged(entry)) {
+        replay(entry, filename, content);
+        PreviousSources::GetInstance()->Forget(filename);
+        return true;
+    }
+
+    // The function names files are moved out of the way, so that the ones
+    // the passes write are told apart from older ones with the same content.
+    std::map<std::string, std::string> functionNamesBefore = functionNamesFiles();
+    for (auto &file : functionNamesBefore) {
+        llvm::sys::fs::remove(llvm::Twine(file.first));
+    }
+    std::map<std::string, std::string> backupListsBefore;
+    for (const std::string &backupList : backupLists) {
+        readFile(backupList, backupListsBefore[backupList]);
+    }
+    llvm::sys::fs::remove(llvm::Twine(dependencyFile));
+
+    instrument();
+
+    llvm::sys::fs::remove(llvm::Twine(entry + "manifest"));
+    store(entry, filename, backupListsBefore);
+
+    for (auto &file : functionNamesBefore) {
+        if (!llvm::sys::fs::exists(llvm::Twine(file.first))) {
+            WriteFileIfChanged(file.first, file.second);
+        }
+    }
+    return false;
+}
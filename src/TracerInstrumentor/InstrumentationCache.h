@@ -0,0 +1,76 @@
+#ifndef INSTRUMENTATION_CACHE_H
+#define INSTRUMENTATION_CACHE_H
+
+// Clang libs
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/CompilationDatabase.h"
+
+// STL libs
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
+// Content addressed cache of the instrumentation of single files.  An entry is
+// keyed on the hash of the file, of its compile command, of the pass, of the
+// instrumentation spec and of the instrumentor binary, and is only used while the headers the file
+// included still hash the same.  It holds the rewritten file and everything
+// else the passes wrote for it, i.e. the function names files and the lines
+// appended to the backup lists, so that a hit replays them without parsing.
+class InstrumentationCache {
+    public:
+        // functionNamesFile is the prefix of the function names files the
+        // passes write, backupLists the files they append backups to.
+        InstrumentationCache(const std::string &_cacheDir, const std::string &_spec,
+                             const std::string &_functionNamesFile,
+                             const std::vector<std::string> &_backupLists);
+
+        // Replays the cached instrumentation of filename by pass if there is
+        // one, otherwise calls instrument and caches what it wrote.  Returns
+        // true on a hit.
+        bool Instrument(const std::string &filename, const std::string &pass,
+                        const clang::tooling::CompilationDatabase &compilations,
+                        const std::function<void()> &instrument);
+
+        // Makes the tools run by instrument list the headers of the file.
+        clang::tooling::ArgumentsAdjuster DependencyAdjuster() const;
+
+        // Hash of the content of the file, empty if it can not be read, for
+        // the spec to depend on the files the passes read.
+        static std::string HashFile(const std::string &filename);
+
+    private:
+        std::string cacheDir;
+
+        std::string spec;
+
+        std::string functionNamesFile;
+
+        std::vector<std::string> backupLists;
+
+        std::string dependencyFile;
+
+        // Hash of the running instrumentor binary.
+        std::string instrumentorHash;
+
+        std::string entryDir(const std::string &key);
+
+        std::string computeKey(const std::string &content, const std::string &pass,
+                               const std::string &filename,
+                               const clang::tooling::CompilationDatabase &compilations);
+
+        bool dependenciesUnchanged(const std::string &entry);
+
+        std::vector<std::string> readDependencies();
+
+        // Function names files currently on disk, mapped to their content.
+        std::map<std::string, std::string> functionNamesFiles();
+
+        void replay(const std::string &entry, const std::string &filename,
+                    const std::string &content);
+
+        void store(const std::string &entry, const std::string &filename,
+                   const std::map<std::string, std::string> &backupListsBefore);
+};
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef MULTI_TRACER_INSTRUMENTOR_FRONT_END_FACTORY_H
+#define MULTI_TRACER_INSTRUMENTOR_FRONT_END_FACTORY_H
+
+#include <system_error>
+
+#include "MultiTracerInstrumentorVisitor.h"
+#include "PreviousSources.h"
+#include "Utils.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "clang/Tooling/Tooling.h"
+
+class MultiTracerInstrumentorASTConsumer : public clang::ASTConsumer {
+    private:
+        std::unique_ptr<MultiTracerInstrumentorVisitor> visitor;
+
+    public:
+        explicit MultiTracerInstrumentorASTConsumer(clang::CompilerInstance &ci,
+                                std::shared_ptr<clang::Rewriter> _rewriter,
+                                std::vector<std::string> &_targetFunctionNames,
+                                std::shared_ptr<bool> _shouldFlush,
+                                std::shared_ptr<std::vector<MultiTracerTarget>> _targets,
+                                std::string _functionNamesFile) {
+
+            visitor = std::unique_ptr<MultiTracerInstrumentorVisitor>(new MultiTracerInstrumentorVisitor(ci,
+                                                                    _rewriter,
+                                                                    _targetFunctionNames,
+                                                                    _shouldFlush,
+                                                                    _targets,
+                                                                    _functionNamesFile));
+        }
+
+        ~MultiTracerInstrumentorASTConsumer() {}
+
+        virtual void HandleTranslationUnit(clang::ASTContext &context) {
+            visitor->TraverseDecl(context.getTranslationUnitDecl());
+        }
+};
+
+class MultiTracerInstrumentorFrontendAction : public clang::ASTFrontendAction {
+    private:
+        // Name of the transformed file.
+        std::string filename;
+
+        std::string fileDir;
+
+        // Rewriter used by the consumer.
+        std::shared_ptr<clang::Rewriter> rewriter;
+
+        // Names of the target functions, indexed by target ID.
+        std::vector<std::string> &targetFunctionNames;
+
+        clang::FileID fileID;
+
+        std::string backupPath;
+
+        std::string functionNamesFile;
+
+        std::shared_ptr<bool> shouldFlush;
+
+        std::shared_ptr<std::vector<MultiTracerTarget>> targets;
+
+    public:
+        MultiTracerInstrumentorFrontendAction(std::vector<std::string> &_targetFunctionNames,
+                                              std::string _backupPath,
+                                              std::string _functionNamesFile) :
+                                            targetFunctionNames(_targetFunctionNames),
+                                            backupPath(_backupPath),
+                                            functionNamesFile(_functionNamesFile),
+                                            shouldFlush(std::make_shared<bool>(false)),
+                                            targets(std::make_shared<std::vector<MultiTracerTarget>>()) {}
+
+        ~MultiTracerInstrumentorFrontendAction() {}
+
+        void writePathFile(const std::string &backupFilename) {
+            std::string backupPathsFilename;
+
+            if (backupPath[backupPath.length() - 1] != '/') {
+                backupPathsFilename = backupPath + "/TracerFilenames";
+            } else {
+                backupPathsFilename = backupPath + "TracerFilenames";
+            }
+
+            std::error_code OutErrInfo;
+            std::error_code ok;
+            llvm::raw_fd_ostream outputFile(llvm::StringRef(backupPathsFilename),
+                                            OutErrInfo, llvm::sys::fs::F_Append);
+            if (OutErrInfo == ok) {
+                outputFile << backupFilename + '\t' + fileDir + filename + '\n';
+                outputFile.close();
+            }
+        }
+
+        // Only lists the backup if listOnly, for files instrumented the same
+        // way in the previous round, whose backup is still there.
+        bool backupFile(bool listOnly) {
+            std::string backupFileName;
+            if (backupPath[backupPath.length() - 1] != '/') {
+                backupFileName = backupPath + "/" + filename;
+            } else {
+                backupFileName = backupPath + filename;
+            }
+
+            // Listed once written, so that the restorer never finds a partial
+            // backup.
+            if (!listOnly) {
+                std::error_code OutErrInfo;
+                std::error_code ok;
+                llvm::raw_fd_ostream outputFile(llvm::StringRef(backupFileName),
+                                                OutErrInfo, llvm::sys::fs::F_None);
+                if (OutErrInfo != ok) {
+                    return false;
+                }
+                clang::SourceManager &manager = rewriter->getSourceMgr();
+                outputFile << manager.getBufferData(fileID);
+                outputFile.close();
+                if (outputFile.has_error()) {
+                    return false;
+                }
+            }
+
+            writePathFile(backupFileName);
+            return true;
+        }
+
+        void reportError(const std::string &message) {
+            clang::DiagnosticsEngine &diagnostics = getCompilerInstance().getDiagnostics();
+            diagnostics.Report(diagnostics.getCustomDiagID(clang::DiagnosticsEngine::Error, "%0")) << message;
+        }
+
+        // The guard ends the target's trace on every return through the
+        // cleanup attribute, which GCC and Clang support in C and C++ alike,
+        // so no return statement needs rewriting.
+        void insertHeader(const MultiTracerTarget &target) {
+            std::string startInstru = "\n\tint vprofTargetGuard __attribute__((cleanup(TRACE_TARGET_FUNCTION_CLEANUP))) = ";
+            startInstru += "TRACE_TARGET_FUNCTION_START(" + std::to_string(target.targetID) + ", " +
+                           std::to_string(target.numFuncs) + ");\n";
+            rewriter->InsertText(target.bodyStart, startInstru, true);
+        }
+
+        // Wrappers of a target nested in another, such as a member function
+        // of a local class, go at file scope before the outer one.
+        const MultiTracerTarget &outermostTarget(const MultiTracerTarget &target) {
+            for (const MultiTracerTarget &outer : *targets) {
+                if (outer.range.getBegin().getRawEncoding() <= target.range.getBegin().getRawEncoding() &&
+                    target.range.getEnd().getRawEncoding() <= outer.range.getEnd().getRawEncoding()) {
+                    return outer;
+                }
+            }
+            return target;
+        }
+
+        void EndSourceFileAction() override {
+            if (*shouldFlush) {
+                for (const MultiTracerTarget &target : *targets) {
+                    rewriter->InsertText(outermostTarget(target).range.getBegin(), target.wrapperImpls, true);
+                    insertHeader(target);
+                }
+
+                const clang::RewriteBuffer *RewriteBuf = rewriter->getRewriteBufferFor(fileID);
+                std::string content = "// TraceTool included header\n#include \"trace_tool.h\"\n\n";
+                content += std::string(RewriteBuf->begin(), RewriteBuf->end());
+                PreviousSources::GetInstance()->Forget(filename);
+                // A file instrumented the same way in the previous round was
+                // parsed from its backup and is left untouched, so that it is
+                // not rebuilt.
+                bool isUnchanged = FileContentEquals(filename, content);
+                if (!backupFile(isUnchanged)) {
+                    reportError("could not back up " + filename + ", leaving it uninstrumented");
+                } else if (!isUnchanged && !WriteFile(filename, content)) {
+                    reportError("could not write the instrumented " + filename);
+                }
+            }
+        }
+
+        virtual std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance &ci,
+                                                                      llvm::StringRef file) {
+            rewriter = std::make_shared<clang::Rewriter>();
+            rewriter->setSourceMgr(ci.getSourceManager(), ci.getLangOpts());
+
+            filename = file.str();
+            llvm::SmallString<64> cwd;
+            if (llvm::sys::fs::current_path(cwd) == std::error_code()) {
+                fileDir = cwd.str().str();
+                if (fileDir[fileDir.length() - 1] != '/') {
+                    fileDir += "/";
+                }
+            }
+            fileID = ci.getSourceManager().getMainFileID();
+
+            return std::unique_ptr<MultiTracerInstrumentorASTConsumer>(new MultiTracerInstrumentorASTConsumer(ci,
+                                                                                                    rewriter,
+                                                                                                    targetFunctionNames,
+                                                                                                    shouldFlush,
+                                                                                                    targets,
+                                                                                                    functionNamesFile));
+        }
+};
+
+class MultiTracerInstrumentorFrontendActionFactory : public clang::tooling::FrontendActionFactory {
+    private:
+        std::vector<std::string> targetFunctionNames;
+        std::string backupPath;
+        std::string functionNamesFile;
+
+    public:
+        MultiTracerInstrumentorFrontendActionFactory(std::vector<std::string> _targetFunctionNames,
+                                                     std::string _backupPath,
+                                                     std::string _functionNamesFile) :
+                                                targetFunctionNames(_targetFunctionNames),
+                                                backupPath(_backupPath),
+                                                functionNamesFile(_functionNamesFile) {}
+
+        // Creates a MultiTracerInstrumentorFrontendAction to be used by clang tool.
+        virtual MultiTracerInstrumentorFrontendAction *create() {
+            return new MultiTracerInstrumentorFrontendAction(targetFunctionNames, backupPath, functionNamesFile);
+        }
+};
+
+// Target IDs are the positions of the functions in targetFunctionNames, each
+// given as its qualified name and parameter names joined by '|'.
+std::unique_ptr<MultiTracerInstrumentorFrontendActionFactory> CreateMultiTracerInstrumentorFrontendActionFactory(
+        std::vector<std::string> targetFunctionNames, std::string backupPath, std::string functionNamesFile) {
+    return std::unique_ptr<MultiTracerInstrumentorFrontendActionFactory>(
+        new MultiTracerInstrumentorFrontendActionFactory(targetFunctionNames, backupPath, functionNamesFile));
+}
+
+#endif
@@ -0,0 +1,158 @@
+#include "MultiTracerInstrumentorVisitor.h"
+#include "Utils.h"
+
+#include <iostream>
+
+using namespace clang;
+
+std::string MultiTracerInstrumentorVisitor::declToWrapperName(const FunctionDecl *decl,
+                                                              const MultiTracerTarget &target) {
+    return GetWrapperName(*mangleContext, decl, target.numFuncs);
+}
+
+void MultiTracerInstrumentorVisitor::instrumentIndirectCall(const CallExpr *call) {
+    MultiTracerTarget *target = getEnclosingTarget(call);
+    if (target == nullptr) {
+        return;
+    }
+
+    std::string targetID = std::to_string(target->targetID);
+    std::string index = std::to_string(target->numFuncs);
+    std::string wrapperName = GetIndirectWrapperName(*mangleContext, call, target->numFuncs);
+    std::string wrapperImpl = GenerateIndirectWrapperImpl(*astContext, call, wrapperName,
+                                                          "VProfTargetTraceGuard vprofGuard(" + targetID + ", " + index + ");",
+                                                          "VProfTargetCall vprofCall;\n\tTRACE_TARGET_START(" + targetID + ", &vprofCall);",
+                                                          "TRACE_TARGET_END(" + targetID + ", " + index + ", &vprofCall);");
+    if (wrapperImpl.empty()) {
+        return;
+    }
+
+    RewriteIndirectCall(*rewriter, call, wrapperName);
+    target->wrapperImpls += wrapperImpl;
+    *target->functionNamesStream << GetIndirectCalleeName(call, rewriter->getLangOpts())
+                                 << '-' << index << std::endl;
+    target->functionNamesStream->flush();
+
+    target->numFuncs++;
+}
+
+MultiTracerTarget *MultiTracerInstrumentorVisitor::getEnclosingTarget(const Expr *call) {
+    // Targets can be nested, such as a member function of a local class or a
+    // lambda defined in another target, so the innermost one, found last,
+    // encloses the call.
+    clang::SourceRange range(call->getLocStart(), call->getLocEnd());
+    for (std::vector<MultiTracerTarget>::reverse_iterator it = targets->rbegin(); it != targets->rend(); ++it) {
+        if (InRange(it->range, range)) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+std::string MultiTracerInstrumentorVisitor::getFunctionNameAndArgs(const clang::FunctionDecl *decl) {
+    std::string nameAndArgs = decl->getQualifiedNameAsString();
+
+    for (unsigned int i = 0, j = decl->getNumParams(); i < j; i++) {
+        const ParmVarDecl* paramDecl = decl->getParamDecl(i);
+        nameAndArgs += "|" + paramDecl->getNameAsString();
+    }
+    return nameAndArgs;
+}
+
+void MultiTracerInstrumentorVisitor::instrumentCall(const CallExpr *call, const FunctionDecl *decl,
+                                                    bool isMemberCall) {
+    MultiTracerTarget *target = getEnclosingTarget(call);
+    if (target == nullptr || IsUntracedCallee(decl)) {
+        return;
+    }
+
+    std::string targetID = std::to_string(target->targetID);
+    std::string index = std::to_string(target->numFuncs);
+    std::string wrapperName = declToWrapperName(decl, *target);
+    RewriteCall(*rewriter, call, wrapperName, isMemberCall);
+
+    FunctionPrototype prototype = CreateWrapperPrototype(*astContext, call, decl, wrapperName, isMemberCall);
+    target->wrapperImpls += GenerateWrapperImpl(prototype,
+                                                "VProfTargetTraceGuard vprofGuard(" + targetID + ", " + index + ");",
+                                                "VProfTargetCall vprofCall;\n\tTRACE_TARGET_START(" + targetID + ", &vprofCall);",
+                                                "TRACE_TARGET_END(" + targetID + ", " + index + ", &vprofCall);");
+    *target->functionNamesStream << GetFunctionNameInFile(decl, target->numFuncs) << std::endl;
+    target->functionNamesStream->flush();
+
+    target->numFuncs++;
+}
+
+bool MultiTracerInstrumentorVisitor::VisitCallExpr(const CallExpr *call) {
+    if (IsIndirectCall(call)) {
+        instrumentIndirectCall(call);
+        return true;
+    }
+    const FunctionDecl *decl = call->getDirectCallee();
+    // Exit if the callee is only known at instantiation
+    if (!decl || isa<CXXMemberCallExpr>(call)) {
+        return true;
+    }
+    instrumentCall(call, decl, false);
+
+    return true;
+}
+
+bool MultiTracerInstrumentorVisitor::VisitCXXMemberCallExpr(const clang::CXXMemberCallExpr *call) {
+    if (call->getMethodDecl() == nullptr) {
+        return true;
+    }
+    instrumentCall(call, call->getMethodDecl(), true);
+
+    return true;
+}
+
+void MultiTracerInstrumentorVisitor::initForInstru(const clang::FunctionDecl *decl) {
+    if (!decl->isThisDeclarationADefinition() || !decl->hasBody()) {
+        return;
+    }
+
+    std::string nameAndArgs = getFunctionNameAndArgs(decl);
+    std::unordered_map<std::string, int>::iterator it = targetIDs.find(nameAndArgs);
+    if (it == targetIDs.end()) {
+        return;
+    }
+
+    *shouldFlush = true;
+
+    MultiTracerTarget target;
+    target.targetID = it->second;
+    target.numFuncs = 1;
+    target.range = decl->getSourceRange();
+    target.bodyStart = decl->getBody()->getLocStart().getLocWithOffset(1);
+    target.functionNamesStream = std::make_shared<std::ofstream>(
+        functionNamesFile + "." + std::to_string(target.targetID));
+    *target.functionNamesStream << nameAndArgs << std::endl;
+    target.functionNamesStream->flush();
+    targets->push_back(target);
+}
+
+bool MultiTracerInstrumentorVisitor::VisitFunctionDecl(const clang::FunctionDecl *decl) {
+    initForInstru(decl);
+    return true;
+}
+
+MultiTracerInstrumentorVisitor::MultiTracerInstrumentorVisitor(CompilerInstance &ci,
+                            std::shared_ptr<Rewriter> _rewriter,
+                            std::vector<std::string> &_targetFunctionNames,
+                            std::shared_ptr<bool> _shouldFlush,
+                            std::shared_ptr<std::vector<MultiTracerTarget>> _targets,
+                            std::string _functionNamesFile):
+                            astContext(&ci.getASTContext()),
+                            rewriter(_rewriter),
+                            mangleContext(ci.getASTContext().createMangleContext()),
+                            shouldFlush(_shouldFlush),
+                            targets(_targets),
+                            functionNamesFile(_functionNamesFile) {
+    rewriter->setSourceMgr(astContext->getSourceManager(),
+                          astContext->getLangOpts());
+    for (size_t i = 0; i < _targetFunctionNames.size(); i++) {
+        targetIDs[_targetFunctionNames[i]] = i;
+    }
+}
+
+MultiTracerInstrumentorVisitor::~MultiTracerInstrumentorVisitor() {}
@@ -0,0 +1,106 @@
+#ifndef MULTI_TRACER_INSTRUMENTOR_VISITOR_H
+#define MULTI_TRACER_INSTRUMENTOR_VISITOR_H
+
+// Clang libs
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/ExprCXX.h"
+#include "clang/AST/Type.h"
+#include "clang/AST/Decl.h"
+#include "clang/Rewrite/Core/Rewriter.h"
+
+// STL libs
+#include <memory>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <utility>
+
+#include "FunctionPrototype.h"
+#include "CallSiteUtils.h"
+
+// State of one target function defined in the current file.
+struct MultiTracerTarget {
+    int targetID;
+
+    // Index of the next callee, 0 is reserved for the semantic interval.
+    int numFuncs;
+
+    clang::SourceRange range;
+
+    // Location right after the opening brace of the body.
+    clang::SourceLocation bodyStart;
+
+    std::string wrapperImpls;
+
+    std::shared_ptr<std::ofstream> functionNamesStream;
+};
+
+// Instruments every target function given to it in a single pass.  Each
+// target gets a compile-time target ID that is passed to all of its probes, so
+// that the runtime only traces the target selected at startup.
+class MultiTracerInstrumentorVisitor : public clang::RecursiveASTVisitor<MultiTracerInstrumentorVisitor> {
+    private:
+        // Context storing additional state
+        clang::ASTContext *astContext;
+
+        // Client to rewrite source
+        std::shared_ptr<clang::Rewriter> rewriter;
+
+        std::unique_ptr<clang::MangleContext> mangleContext;
+
+        // Maps the name and parameter names of a target, joined by '|', to its ID.
+        std::unordered_map<std::string, int> targetIDs;
+
+        std::shared_ptr<bool> shouldFlush;
+
+        // Targets found in the current file, in the order they were found.
+        std::shared_ptr<std::vector<MultiTracerTarget>> targets;
+
+        std::string functionNamesFile;
+
+        // Mangled names are used, so that overloads and template instantiations
+        // get wrappers of their own.
+        std::string declToWrapperName(const clang::FunctionDecl *decl, const MultiTracerTarget &target);
+
+        // Wraps a call through a function pointer or of a callable object.
+        void instrumentIndirectCall(const clang::CallExpr *call);
+
+        std::string getFunctionNameAndArgs(const clang::FunctionDecl *decl);
+
+        void initForInstru(const clang::FunctionDecl *decl);
+
+        // Returns the target whose body contains call, nullptr if there is none.
+        MultiTracerTarget *getEnclosingTarget(const clang::Expr *call);
+
+        // Rewrites the call to call a new wrapper of decl if it is in a target,
+        // and logs decl at the next index of the target.
+        void instrumentCall(const clang::CallExpr *call, const clang::FunctionDecl *decl,
+                            bool isMemberCall);
+
+    public:
+        explicit MultiTracerInstrumentorVisitor(clang::CompilerInstance &ci,
+                              std::shared_ptr<clang::Rewriter> _rewriter,
+                              std::vector<std::string> &_targetFunctionNames,
+                              std::shared_ptr<bool> _shouldFlush,
+                              std::shared_ptr<std::vector<MultiTracerTarget>> _targets,
+                              std::string _functionNamesFile);
+
+        ~MultiTracerInstrumentorVisitor();
+
+        // Override trigger for when a FunctionDecl is found in the AST
+        virtual bool VisitFunctionDecl(const clang::FunctionDecl *decl);
+
+        // Override trigger for when a CallExpr is found in the AST
+        virtual bool VisitCallExpr(const clang::CallExpr *call);
+
+        // Override trigger for when a CXXMemberCallExpr is found in the AST
+        virtual bool VisitCXXMemberCallExpr(const clang::CXXMemberCallExpr *call);
+};
+
+#endif
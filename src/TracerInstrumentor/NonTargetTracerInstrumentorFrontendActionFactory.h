@@ -4,6 +4,7 @@
 #include <system_error>
 
 #include "NonTargetTracerInstrumentorVisitor.h"
+#include "PreviousSources.h"
 #include "Utils.h"
 
 #include "llvm/ADT/SmallString.h"
@@ -109,7 +110,9 @@ class NonTargetTracerInstrumentorFrontendAction : public clang::ASTFrontendActio
             }
         }
 
-        void backupFile() {
+        // Only lists the backup if listOnly, for files instrumented the same
+        // way in the previous round, whose backup is still there.
+        bool backupFile(bool listOnly) {
             std::string backupFileName;
             if (backupPath[backupPath.length() - 1] != '/') {
                 backupFileName = backupPath + "/" + filename;
@@ -117,17 +120,31 @@ class NonTargetTracerInstrumentorFrontendAction : public clang::ASTFrontendActio
                 backupFileName = backupPath + filename;
             }
 
-            writePathFile(backupFileName);
-
-            std::error_code OutErrInfo;
-            std::error_code ok;
-            llvm::raw_fd_ostream outputFile(llvm::StringRef(backupFileName),
-                                            OutErrInfo, llvm::sys::fs::F_None);
-            if (OutErrInfo == ok) {
+            // Listed once written, so that the restorer never finds a partial
+            // backup.
+            if (!listOnly) {
+                std::error_code OutErrInfo;
+                std::error_code ok;
+                llvm::raw_fd_ostream outputFile(llvm::StringRef(backupFileName),
+                                                OutErrInfo, llvm::sys::fs::F_None);
+                if (OutErrInfo != ok) {
+                    return false;
+                }
                 clang::SourceManager &manager = rewriter->getSourceMgr();
                 outputFile << manager.getBufferData(fileID);
                 outputFile.close();
+                if (outputFile.has_error()) {
+                    return false;
+                }
             }
+
+            writePathFile(backupFileName);
+            return true;
+        }
+
+        void reportError(const std::string &message) {
+            clang::DiagnosticsEngine &diagnostics = getCompilerInstance().getDiagnostics();
+            diagnostics.Report(diagnostics.getCustomDiagID(clang::DiagnosticsEngine::Error, "%0")) << message;
         }
 
         void insertHeader() {
@@ -139,22 +156,21 @@ class NonTargetTracerInstrumentorFrontendAction : public clang::ASTFrontendActio
 
         void EndSourceFileAction() override {
             if (*shouldFlush) {
-                std::error_code OutErrInfo;
-                std::error_code ok;
-
                 rewriter->InsertText(wrapperImplLoc->first, wrapperImplLoc->second, true);
                 insertHeader();
 
-                llvm::raw_fd_ostream outputFile(llvm::StringRef(filename),
-                                                OutErrInfo, llvm::sys::fs::F_None);
-
-                if (OutErrInfo == ok) {
-                    backupFile();
-                    const clang::RewriteBuffer *RewriteBuf = rewriter->getRewriteBufferFor(fileID);
-                    outputFile << "// TraceTool included header\n#include \"trace_tool.h\"\n\n";
-                    std::string content = std::string(RewriteBuf->begin(), RewriteBuf->end());
-                    outputFile << content;
-                    outputFile.close();
+                const clang::RewriteBuffer *RewriteBuf = rewriter->getRewriteBufferFor(fileID);
+                std::string content = "// TraceTool included header\n#include \"trace_tool.h\"\n\n";
+                content += std::string(RewriteBuf->begin(), RewriteBuf->end());
+                PreviousSources::GetInstance()->Forget(filename);
+                // A file instrumented the same way in the previous round was
+                // parsed from its backup and is left untouched, so that it is
+                // not rebuilt.
+                bool isUnchanged = FileContentEquals(filename, content);
+                if (!backupFile(isUnchanged)) {
+                    reportError("could not back up " + filename + ", leaving it uninstrumented");
+                } else if (!isUnchanged && !WriteFile(filename, content)) {
+                    reportError("could not write the instrumented " + filename);
                 }
             }
         }
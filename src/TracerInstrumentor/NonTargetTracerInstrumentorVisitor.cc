@@ -7,14 +7,8 @@
 
 using namespace clang;
 
-std::string NonTargetTracerInstrumentorVisitor::functionNameToWrapperName(std::string functionName) {
-    std::vector<std::string> nameParts = SplitString(functionName, ':');
-    std::string wrapperName;
-    for (size_t i = 0; i < nameParts.size() - 1; i++) {
-        wrapperName += nameParts[i] + '_';
-    }
-    wrapperName += nameParts.back() + std::to_string((*numFuncs)) + "_vprofiler";
-    return wrapperName;
+std::string NonTargetTracerInstrumentorVisitor::declToWrapperName(const FunctionDecl *decl) {
+    return GetWrapperName(*mangleContext, decl, (*numFuncs));
 }
 
 std::string NonTargetTracerInstrumentorVisitor::getRootFuncName(int rootIndex) {
@@ -26,59 +20,24 @@ std::string NonTargetTracerInstrumentorVisitor::getRootFuncName(int rootIndex) {
     return funcName;
 }
 
-void NonTargetTracerInstrumentorVisitor::fixFunction(const CallExpr *call, const std::string &functionName,
-                               bool isMemberCall) {
-    // Get args
-    std::string newCall = functionNameToWrapperName(functionName) + "(";
-    std::vector<const Expr*> args;
-
-    if (isMemberCall) {
-        const CXXMemberCallExpr *memCall = static_cast<const CXXMemberCallExpr*>(call);
-        Expr *obj = memCall->getImplicitObjectArgument();
-        args.push_back(obj);
-        
-        // Add ampersand to get address of obj if it is not a pointer.  This ensures
-        // the first arg of a member function that the user wants profiled is a 
-        // pointer to the instance of the object on which to operate.
-        if (!obj->getType()->isPointerType()) {
-            newCall += "&";
-        }
-
-    }
-
-    for (int i = 0, j = call->getNumArgs(); i < j; i++) {
-        args.push_back(call->getArg(i));
-    }
-
-    appendNonObjArgs(newCall, args);
-    newCall += ")";
-
-    rewriter->ReplaceText(SourceRange(call->getLocStart(), 
-                          call->getRParenLoc()), newCall);
-}
-
-void NonTargetTracerInstrumentorVisitor::appendNonObjArgs(std::string &newCall, std::vector<const Expr*> &args) {
-    for (unsigned int i = 0, j = args.size(); i < j; i++) {
-        std::string TypeS;
-        llvm::raw_string_ostream s(TypeS);
-        args[i]->printPretty(s, 0, rewriter->getLangOpts());
-        newCall += s.str();
-
-        if (i != (j - 1)) {
-            newCall += ", ";
-        }
+void NonTargetTracerInstrumentorVisitor::instrumentIndirectCall(const CallExpr *call) {
+    std::string index = std::to_string((*numFuncs));
+    std::string wrapperName = GetIndirectWrapperName(*mangleContext, call, (*numFuncs));
+    std::string wrapperImpl = GenerateIndirectWrapperImpl(*astContext, call, wrapperName,
+                                                          "VProfTraceGuard vprofGuard(" + index + ");",
+                                                          "TRACE_INDEX_START(" + index + ");",
+                                                          "TRACE_END(" + index + ");");
+    if (wrapperImpl.empty()) {
+        return;
     }
-}
 
-std::string NonTargetTracerInstrumentorVisitor::getContainingFilename(const FunctionDecl *decl) {
-    SourceManager *sourceMgr = &rewriter->getSourceMgr();
-
-    return sourceMgr->getFilename(decl->getLocation()).str();
-}
+    RewriteIndirectCall(*rewriter, call, wrapperName);
+    wrapperImplLoc->second += wrapperImpl;
+    functionNamesStream << currentRootFunc << '_' << GetIndirectCalleeName(call, rewriter->getLangOpts())
+                        << '-' << index << std::endl;
+    functionNamesStream.flush();
 
-// TODO change name to getParamDeclAsString
-std::string NonTargetTracerInstrumentorVisitor::getEntireParamDeclAsString(const ParmVarDecl *decl) {
-    return decl->getType().getAsString() + " " + decl->getNameAsString();
+    (*numFuncs)++;
 }
 
 std::string NonTargetTracerInstrumentorVisitor::getFileAndLine(const clang::FunctionDecl *decl) {
@@ -96,109 +55,30 @@ std::string NonTargetTracerInstrumentorVisitor::getFileAndLine(const clang::Func
     return fileName;
 }
 
-void NonTargetTracerInstrumentorVisitor::createNewPrototype(const FunctionDecl *decl, 
-                                      const std::string &functionName,
-                                      bool isMemberFunc) {
-    FunctionPrototype newPrototype;
-
-    std::string functionNameInFile = decl->getQualifiedNameAsString() + '-' + std::to_string((*numFuncs));
-
-    newPrototype.filename = getContainingFilename(decl);
-
-    newPrototype.returnType = decl->getReturnType().getAsString();
-    newPrototype.functionPrototype += newPrototype.returnType + " " + functionNameToWrapperName(functionName) + "(";
-
-    bool isCXXMethodAndNotStatic = false;
-    if (isMemberFunc) {
-        const CXXMethodDecl *methodDecl = static_cast<const CXXMethodDecl*>(decl);
-        if (methodDecl->isStatic()) {
-            newPrototype.innerCallPrefix = decl->getQualifiedNameAsString();
-        }
-        else {
-            isCXXMethodAndNotStatic = true;
-
-            newPrototype.innerCallPrefix = "obj->" + methodDecl->getNameAsString();
-            newPrototype.functionPrototype += methodDecl->getThisType(*astContext).getAsString() + " obj";
-        }
-    }
-    // Is there a more succinct way to write this?
-    else {
-        newPrototype.innerCallPrefix = decl->getQualifiedNameAsString();
-    }
-
-    for (unsigned int i = 0, j = decl->getNumParams(); i < j; i++) {
-        if (isCXXMethodAndNotStatic && i == 0) {
-            newPrototype.functionPrototype +=", ";
-        }
-
-        const ParmVarDecl* paramDecl = decl->getParamDecl(i);
-        newPrototype.functionPrototype += getEntireParamDeclAsString(paramDecl);
+void NonTargetTracerInstrumentorVisitor::instrumentCall(const CallExpr *call, const FunctionDecl *decl,
+                                                        bool isMemberCall) {
+    std::string index = std::to_string((*numFuncs));
+    std::string wrapperName = declToWrapperName(decl);
+    RewriteCall(*rewriter, call, wrapperName, isMemberCall);
 
-        functionNameInFile += "|" + paramDecl->getNameAsString();
-        newPrototype.paramVars.push_back(paramDecl->getNameAsString() + (paramDecl->isParameterPack() ? "..." : ""));
-
-        if (i != (j - 1)) {
-            newPrototype.functionPrototype += ", ";
-        }
-    }
-
-    newPrototype.functionPrototype += ")";
-    newPrototype.isMemberCall = isMemberFunc;
-
-    wrapperImplLoc->second += generateWrapperImpl(newPrototype);
-    functionNamesStream << currentRootFunc << '_' << functionNameInFile << std::endl;
+    FunctionPrototype prototype = CreateWrapperPrototype(*astContext, call, decl, wrapperName, isMemberCall);
+    wrapperImplLoc->second += GenerateWrapperImpl(prototype,
+                                                  "VProfTraceGuard vprofGuard(" + index + ");",
+                                                  "TRACE_INDEX_START(" + index + ");",
+                                                  "TRACE_END(" + index + ");");
+    functionNamesStream << currentRootFunc << '_' << GetFunctionNameInFile(decl, (*numFuncs)) << std::endl;
     functionNamesStream.flush();
-}
 
-bool NonTargetTracerInstrumentorVisitor::inRange(clang::SourceRange largeRange, clang::SourceRange smallRange) {
-    unsigned start = smallRange.getBegin().getRawEncoding();
-    unsigned end = smallRange.getEnd().getRawEncoding();
-    return largeRange.getBegin().getRawEncoding() <= start &&
-           end <= largeRange.getEnd().getRawEncoding();
+    (*numFuncs)++;
 }
 
 bool NonTargetTracerInstrumentorVisitor::inRootFunction(const Expr *call) {
     clang::SourceRange range(call->getLocStart(), call->getLocEnd());
-    return inRange(currentRootRange, range);
+    return InRange(currentRootRange, range);
 }
 
 bool NonTargetTracerInstrumentorVisitor::inRootFunction(const Stmt *stmt) {
-    return inRange(currentRootRange, stmt->getSourceRange());
-}
-
-std::string NonTargetTracerInstrumentorVisitor::generateWrapperImpl(FunctionPrototype prototype) {
-    std::string implementation;
-    implementation += prototype.functionPrototype + " {\n\t";
-    if (prototype.returnType != "void") {
-        implementation += prototype.returnType + " result;\n\n\t";
-    }
-
-    implementation += "TRACE_START();\n\t";
-    if (prototype.returnType != "void") {
-        implementation += "result = ";
-    }
-
-    implementation += prototype.innerCallPrefix + "(";
-
-    for (int i = 0, j = prototype.paramVars.size(); i < j; i++) {
-        implementation += prototype.paramVars[i];
-
-        if (i != (j - 1)) {
-            implementation += ", ";
-        }
-    }
-
-    implementation += ");\n\t";
-
-    implementation += "TRACE_END(" + std::to_string((*numFuncs)) + ");\n";
-
-    if (prototype.returnType != "void") {
-        implementation += "\treturn result;\n";
-    }
-
-    implementation += "}\n\n";
-
-    return implementation;
+    return InRange(currentRootRange, stmt->getSourceRange());
 }
 
 std::vector<std::string> NonTargetTracerInstrumentorVisitor::getFunctionNameAndArgs(
@@ -239,23 +119,19 @@ bool NonTargetTracerInstrumentorVisitor::VisitCallExpr(const CallExpr *call) {
     if (!inRootFunction(call)) {
         return true;
     }
+    if (IsIndirectCall(call)) {
+        instrumentIndirectCall(call);
+        return true;
+    }
     const FunctionDecl *decl = call->getDirectCallee();
-    // Exit if call is to a function pointer
+    // Exit if the callee is only known at instantiation
     if (!decl || isa<CXXMemberCallExpr>(call)) {
         return true;
     }
-    const std::string functionName = decl->getQualifiedNameAsString();
-    if (functionName == "SESSION_START" ||
-        functionName == "SESSION_END" ||
-        functionName == "PATH_INC" ||
-        functionName == "PATH_DEC") {
-            return true;
+    if (IsUntracedCallee(decl)) {
+        return true;
     }
-    fixFunction(call, functionName, false);
-
-    createNewPrototype(decl, functionName, false);
-
-    (*numFuncs)++;
+    instrumentCall(call, decl, false);
 
     return true;
 }
@@ -264,15 +140,10 @@ bool NonTargetTracerInstrumentorVisitor::VisitCXXMemberCallExpr(const clang::CXX
     if (!inRootFunction(call)) {
         return true;
     }
-    if (call->getMethodDecl() == nullptr) {
+    if (call->getMethodDecl() == nullptr || IsUntracedCallee(call->getMethodDecl())) {
         return true;
     }
-    const std::string functionName = call->getMethodDecl()->getQualifiedNameAsString();
-    fixFunction(call, functionName, true);
-
-    createNewPrototype(call->getMethodDecl(), functionName, true);
-
-    (*numFuncs)++;
+    instrumentCall(call, call->getMethodDecl(), true);
 
     return true;
 }
@@ -325,6 +196,7 @@ NonTargetTracerInstrumentorVisitor::NonTargetTracerInstrumentorVisitor(CompilerI
                             std::string _functionNamesFile):
                             astContext(&ci.getASTContext()), 
                             rewriter(_rewriter),
+                            mangleContext(ci.getASTContext().createMangleContext()),
                             rootFunctionNamesAndArgs(_rootFunctionNamesAndArgs),
                             funcDone(_funcDone),
                             shouldFlush(_shouldFlush),
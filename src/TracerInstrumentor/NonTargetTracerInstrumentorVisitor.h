@@ -23,6 +23,7 @@
 #include <tuple>
 
 #include "FunctionPrototype.h"
+#include "CallSiteUtils.h"
 
 class NonTargetTracerInstrumentorVisitor : public clang::RecursiveASTVisitor<NonTargetTracerInstrumentorVisitor> {
     private:
@@ -32,6 +33,8 @@ class NonTargetTracerInstrumentorVisitor : public clang::RecursiveASTVisitor<Non
         // Client to rewrite source
         std::shared_ptr<clang::Rewriter> rewriter;
 
+        std::unique_ptr<clang::MangleContext> mangleContext;
+
         std::vector<std::vector<std::string>> rootFunctionNamesAndArgs;
         std::shared_ptr<std::unordered_map<int, bool>> funcDone;
 
@@ -49,40 +52,32 @@ class NonTargetTracerInstrumentorVisitor : public clang::RecursiveASTVisitor<Non
         clang::SourceRange currentRootRange;
         std::string currentRootFunc;
 
-        std::string functionNameToWrapperName(std::string functionName);
+        // Mangled names are used, so that overloads and template instantiations
+        // get wrappers of their own.
+        std::string declToWrapperName(const clang::FunctionDecl *decl);
 
         std::string getRootFuncName(int rootIndex);
 
-        void fixFunction(const clang::CallExpr *call, const std::string &functionName,
-                         bool  isMemberCall);
-
-        void appendNonObjArgs(std::string &newCall, std::vector<const clang::Expr*> &args);
+        // Wraps a call through a function pointer or of a callable object.
+        void instrumentIndirectCall(const clang::CallExpr *call);
 
-        // Creates the wrapper prototype based on function decl.
-        void createNewPrototype(const clang::FunctionDecl *decl,
-                                const std::string &functionName,
-                                bool isMemberFunc);
+        // Rewrites the call to call a new wrapper of decl, and logs decl at the
+        // next index.
+        void instrumentCall(const clang::CallExpr *call, const clang::FunctionDecl *decl,
+                            bool isMemberCall);
 
         std::string getFileAndLine(const clang::FunctionDecl *decl);
 
-        std::string getEntireParamDeclAsString(const clang::ParmVarDecl *decl);
-
-        std::string getContainingFilename(const clang::FunctionDecl *decl);
-
         std::vector<std::string> getFunctionNameAndArgs(const clang::FunctionDecl *decl);
 
         void initForInstru(const clang::FunctionDecl *decl);
 
         int isRootFunction(const clang::FunctionDecl *decl);
 
-        bool inRange(clang::SourceRange largeRange, clang::SourceRange smallRange);
-
         bool inRootFunction(const clang::Expr *call);
         bool inRootFunction(const clang::Stmt *stmt);
         
 
-        std::string generateWrapperImpl(FunctionPrototype prototype);
-
     public:
         explicit NonTargetTracerInstrumentorVisitor(clang::CompilerInstance &ci, 
                               std::shared_ptr<clang::Rewriter> _rewriter,
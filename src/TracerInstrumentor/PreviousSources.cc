@@ -0,0 +1,72 @@
+#include "PreviousSources.h"
+#include "Utils.h"
+
+// STL libs
+#include <fstream>
+#include <iterator>
+
+// POSIX
+#include <limits.h>
+#include <stdlib.h>
+
+std::unique_ptr<PreviousSources> PreviousSources::singleton;
+
+PreviousSources *PreviousSources::GetInstance() {
+    if (!singleton) {
+        singleton = std::unique_ptr<PreviousSources>(new PreviousSources());
+    }
+    return singleton.get();
+}
+
+// Files are named by the path the backup list gives them, and by the one of
+// the compilation database by the passes.
+std::string PreviousSources::normalize(const std::string &filename) {
+    char path[PATH_MAX];
+    return realpath(filename.c_str(), path) != nullptr ? std::string(path) : filename;
+}
+
+bool PreviousSources::Load(const std::string &backupList) {
+    std::ifstream listFile(backupList);
+    if (!listFile) {
+        return false;
+    }
+
+    std::string line;
+    while (getline(listFile, line)) {
+        std::vector<std::string> paths = SplitString(line, '\t');
+        if (paths.size() != 2) {
+            continue;
+        }
+        // The first backup of a file is the one the restorer ends with.
+        std::string filename = normalize(paths[1]);
+        std::ifstream backupFile(paths[0], std::ios::binary);
+        if (backupFile && sources.find(filename) == sources.end()) {
+            sources[filename].assign((std::istreambuf_iterator<char>(backupFile)),
+                                     std::istreambuf_iterator<char>());
+        }
+    }
+    return true;
+}
+
+std::vector<std::string> PreviousSources::Files() const {
+    std::vector<std::string> files;
+    for (auto &source : sources) {
+        if (forgotten.find(source.first) == forgotten.end()) {
+            files.push_back(source.first);
+        }
+    }
+    return files;
+}
+
+const std::string *PreviousSources::Find(const std::string &filename) const {
+    std::string path = normalize(filename);
+    auto source = sources.find(path);
+    if (source == sources.end() || forgotten.find(path) != forgotten.end()) {
+        return nullptr;
+    }
+    return &source->second;
+}
+
+void PreviousSources::Forget(const std::string &filename) {
+    forgotten.insert(normalize(filename));
+}
@@ -0,0 +1,45 @@
+#ifndef PREVIOUS_SOURCES_H
+#define PREVIOUS_SOURCES_H
+
+// STL libs
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// Original content of the files instrumented in the previous round, read from
+// their backups.  Instead of restoring the files before instrumenting them
+// again, the passes parse these, so that a file instrumented the same way as
+// before is never written and keeps its timestamp.  A file is forgotten once
+// a pass instrumented it, after which its content on disk is the one to parse.
+class PreviousSources {
+    public:
+        static PreviousSources *GetInstance();
+
+        // Reads the "backup	file" lines of a backup list.
+        bool Load(const std::string &backupList);
+
+        // Files not instrumented again yet.
+        std::vector<std::string> Files() const;
+
+        // Original content of the file, nullptr if it has none or was
+        // instrumented again.  Tools map it without copying, so it is kept
+        // until the end.
+        const std::string *Find(const std::string &filename) const;
+
+        void Forget(const std::string &filename);
+
+    private:
+        PreviousSources() {}
+
+        static std::unique_ptr<PreviousSources> singleton;
+
+        std::map<std::string, std::string> sources;
+
+        std::set<std::string> forgotten;
+
+        static std::string normalize(const std::string &filename);
+};
+
+#endif
@@ -44,16 +44,9 @@ bool ReturnInstrumentorVisitor::isTargetFunction(const clang::FunctionDecl *decl
     return true;
 }
 
-std::string ReturnInstrumentorVisitor::exprToString(const clang::Expr *expr) {
-    clang::SourceLocation start = expr->getLocStart();
-    clang::SourceLocation end = expr->getLocEnd();
-    clang::SourceManager &manager = rewriter->getSourceMgr();
-    clang::SourceLocation realEnd(
-        clang::Lexer::getLocForEndOfToken(end, 0, manager, rewriter->getLangOpts()));
-    return std::string(manager.getCharacterData(start),
-        manager.getCharacterData(realEnd) - manager.getCharacterData(start));
-}
-
+// Only the return keyword and the end of the statement are rewritten, so that
+// the calls in the returned expression keep the wrappers the tracer visitor
+// rewrote them to in the same traversal.
 bool ReturnInstrumentorVisitor::VisitReturnStmt(const clang::ReturnStmt *stmt) {
     if (!inTargetFunction(stmt)) {
         return true;
@@ -66,15 +59,19 @@ bool ReturnInstrumentorVisitor::VisitReturnStmt(const clang::ReturnStmt *stmt) {
     }
 
     std::string returnType = stmt->getRetValue()->getType().getAsString();
-    std::string endInstru = "{\n\t\t";
-    endInstru += returnType +  " resVprof = " + exprToString(returnValue) + ";\n";
-    endInstru += "\t\tTRACE_FUNCTION_END();\n";
+    clang::SourceLocation stmtEnd = clang::Lexer::findLocationAfterToken(
+        stmt->getLocEnd(), clang::tok::semi, rewriter->getSourceMgr(), rewriter->getLangOpts(), false);
+    if (stmtEnd.isInvalid()) {
+        return true;
+    }
+
+    rewriter->ReplaceText(stmt->getLocStart(), std::string("return").length(),
+                          "{\n\t\t" + returnType + " resVprof =");
+    std::string endInstru = "\n\t\tTRACE_FUNCTION_END();\n";
     endInstru += "\t\treturn resVprof;\n";
     endInstru += "\t}";
-    clang::SourceLocation stmtStart = stmt->getLocStart();
-    // Move past the semicolon;
-    clang::SourceLocation stmtEnd = stmt->getLocEnd().getLocWithOffset(1);
-    rewriter->ReplaceText(clang::SourceRange(stmtStart, stmtEnd), endInstru);
+    // Before the brace closing a body the tracer visitor braced.
+    rewriter->InsertText(stmtEnd, endInstru, false);
 
     return true;
 }
@@ -21,6 +21,8 @@
 #include <fstream>
 #include <utility>
 
+// Ends the trace of the target function before each of its returns.  Driven by
+// TracerInstrumentorVisitor, so that both rewrite the file in one traversal.
 class ReturnInstrumentorVisitor : public clang::RecursiveASTVisitor<ReturnInstrumentorVisitor> {
     private:
         // Context storing additional state
@@ -47,8 +49,6 @@ class ReturnInstrumentorVisitor : public clang::RecursiveASTVisitor<ReturnInstru
 
         bool inTargetFunction(const clang::Stmt *stmt);
 
-        std::string exprToString(const clang::Expr *expr);
-
     public:
         explicit ReturnInstrumentorVisitor(clang::CompilerInstance &ci, 
                               std::shared_ptr<clang::Rewriter> _rewriter,
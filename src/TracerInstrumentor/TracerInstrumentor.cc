@@ -1,17 +1,30 @@
 #include "NonTargetTracerInstrumentorFrontendActionFactory.h"
 #include "CallerInstrumentorFrontendActionFactory.h"
 #include "TracerInstrumentorFrontendActionFactory.h"
-#include "ReturnInstrumentorFrontendActionFactory.h"
+#include "MultiTracerInstrumentorFrontendActionFactory.h"
+#include "CalleeCollectorFrontendActionFactory.h"
+#include "CallGraphExtractorFrontendActionFactory.h"
+#include "CallGraph.h"
+#include "InstrumentationCache.h"
+#include "PreviousSources.h"
 #include "FileFinder.h"
 
 // Clang libs
 #include "llvm/Support/CommandLine.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/FrontendDiagnostic.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Tooling/Tooling.h"
 #include "clang/Tooling/CommonOptionsParser.h"
 
 // STL libs
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <functional>
 
 using namespace llvm;
 using namespace clang::tooling;
@@ -35,6 +48,46 @@ cl::opt<std::string> RootNamesAndArgs("r",
                              cl::Optional,
                              cl::ValueRequired);
 
+cl::opt<std::string> MultiTargetNamesAndArgs("m",
+                             cl::desc("Specify names of all functions to instrument as targets in one pass "
+                                      "and their parameters, separated by commas."),
+                             cl::value_desc("Multi_Target_Names_And_Args"),
+                             cl::Optional,
+                             cl::ValueRequired);
+
+cl::opt<int> MultiTargetDepth("d",
+                             cl::desc("Specify the depth of the call graph below the -m functions whose "
+                                      "callees are also instrumented as targets."),
+                             cl::value_desc("Multi_Target_Depth"),
+                             cl::Optional,
+                             cl::ValueRequired,
+                             cl::init(0));
+
+cl::opt<int> MultiTargetLimit("l",
+                             cl::desc("Specify the maximum number of functions instrumented as targets with -m, "
+                                      "the callees on the statically hottest call paths being chosen first."),
+                             cl::value_desc("Multi_Target_Limit"),
+                             cl::Optional,
+                             cl::ValueRequired,
+                             cl::init(0));
+
+cl::opt<std::string> CallGraphFile("g",
+                             cl::desc("Specify the static call graph file, used to leave trivial leaf callees "
+                                      "uninstrumented and to order -m targets by static weight."),
+                             cl::value_desc("Call_Graph_File"),
+                             cl::Optional,
+                             cl::ValueRequired);
+
+cl::opt<bool> BuildCallGraph("G",
+                             cl::desc("Only build the static call graph of every file in the compilation "
+                                      "database and save it to the -g file."),
+                             cl::Optional);
+
+cl::opt<bool> ListCalleesOnly("x",
+                             cl::desc("Only write the -f function and its direct callees to the function "
+                                      "names file without instrumenting anything, for the XRay tracer."),
+                             cl::Optional);
+
 cl::opt<int> TargetPathCount("t",
                              cl::desc("Specify name of the caller and its parameters."),
                              cl::value_desc("Target_Path_Count"),
@@ -67,6 +120,80 @@ cl::opt<std::string> FunctionNamesFile("n",
                               cl::value_desc("Function_Names_File"),
                               cl::Required,
                               cl::ValueRequired);
+
+cl::opt<std::string> CacheDir("k",
+                              cl::desc("Specifies the dir caching the instrumentation of each file, "
+                                       "so that files instrumented the same way before are not parsed again."),
+                              cl::value_desc("Cache_Dir"),
+                              cl::Optional,
+                              cl::ValueRequired);
+
+cl::opt<std::string> PrecompiledHeader("pch",
+                              cl::desc("Specifies a header most files include, which is precompiled once "
+                                       "with the flags of the first file in the compilation database and "
+                                       "loaded instead of being parsed again by the files compiled with "
+                                       "the same flags."),
+                              cl::value_desc("Header"),
+                              cl::Optional,
+                              cl::ValueRequired);
+
+cl::opt<std::string> PreviousBackupList("P",
+                              cl::desc("Specifies the backup list of the previous round of instrumentation. "
+                                       "Its files are parsed from their backups instead of being restored "
+                                       "first, so that those instrumented the same way again are not written, "
+                                       "and the others are restored at the end."),
+                              cl::value_desc("Backup_List"),
+                              cl::Optional,
+                              cl::ValueRequired);
+
+// Path of the precompiled -pch header, empty if there is none.
+std::string precompiledHeaderFile;
+
+// Flags the -pch header was precompiled with, and the files of the
+// compilation database compiled the same way in the same directory, by their
+// name in the database, to their absolute path.
+std::vector<std::string> precompiledHeaderFlags;
+std::map<std::string, std::string> precompiledHeaderUsers;
+
+// Prints the diagnostics of the tools as they would, and notes the files
+// which could not load the precompiled header. Such files fail before they
+// are parsed, so none of them has been instrumented.
+class PrecompiledHeaderDiagnostics : public clang::DiagnosticConsumer {
+    public:
+        PrecompiledHeaderDiagnostics():
+            options(new clang::DiagnosticOptions()), printer(llvm::errs(), options.get()) {}
+
+        void BeginSourceFile(const clang::LangOptions &langOpts, const clang::Preprocessor *pp) override {
+            printer.BeginSourceFile(langOpts, pp);
+        }
+
+        void EndSourceFile() override {
+            printer.EndSourceFile();
+        }
+
+        void HandleDiagnostic(clang::DiagnosticsEngine::Level level, const clang::Diagnostic &info) override {
+            clang::DiagnosticConsumer::HandleDiagnostic(level, info);
+            printer.HandleDiagnostic(level, info);
+            unsigned int category = clang::DiagnosticIDs::getCategoryNumberForDiag(info.getID());
+            if (level >= clang::DiagnosticsEngine::Error && !currentFile.empty() &&
+                (info.getID() == clang::diag::err_fe_unable_to_load_pch ||
+                 clang::DiagnosticIDs::getCategoryNameFromID(category) == "AST Deserialization Issue")) {
+                failedFiles.insert(currentFile);
+            }
+        }
+
+        // Set by the arguments adjuster, which is called right before each file is run.
+        std::string currentFile;
+
+        std::set<std::string> failedFiles;
+
+    private:
+        llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> options;
+
+        clang::TextDiagnosticPrinter printer;
+};
+
+PrecompiledHeaderDiagnostics precompiledHeaderDiagnostics;
                               
 
 std::string getUnqualifiedFunctionName(std::string &functionNameAndArgs) {
@@ -87,11 +214,320 @@ std::vector<std::string> findAllPotentialFiles(std::string &rootFunctionNamesAnd
     return fileNames;
 }
 
-int main(int argc, const char **argv) {
-    CommonOptionsParser OptionsParser(argc, argv, TracerInstrumentorOptions);
+// Strips the function index from the qualified name, if there is one.
+std::string getTargetName(std::string &functionNameAndArgs) {
+    std::vector<std::string> nameAndArgs = SplitString(functionNameAndArgs, '|');
+    std::string targetName = SplitString(nameAndArgs[0], '-')[0];
+    for (size_t i = 1; i < nameAndArgs.size(); i++) {
+        targetName += "|" + nameAndArgs[i];
+    }
+    return targetName;
+}
 
-    FileFinder fileFinder(SourceBaseDir);
-    fileFinder.BuildCScopeDB();
+typedef std::function<void(ClangTool &tool)> InstrumentationPass;
+
+std::string backupListName(const std::string &backupDir, const std::string &listName) {
+    return backupDir[backupDir.length() - 1] != '/' ? backupDir + "/" + listName : backupDir + listName;
+}
+
+// Flags of the command line of the file without the compiler, its input and
+// its output, dependency and syntax only options, which are what decides
+// whether a precompiled header can be loaded.
+std::vector<std::string> compileFlags(const CommandLineArguments &commandLine, const std::string &filename) {
+    std::vector<std::string> flags;
+    for (size_t i = 1; i < commandLine.size(); i++) {
+        const std::string &arg = commandLine[i];
+        if (arg == "-o" || arg == "-MF" || arg == "-MT" || arg == "-MQ") {
+            i++;
+        } else if (arg != "-c" && arg != "-fsyntax-only" && arg != filename && arg.compare(0, 2, "-M") != 0) {
+            flags.push_back(arg);
+        }
+    }
+    return flags;
+}
+
+std::string headerLanguage(const std::string &filename) {
+    return filename.substr(filename.find_last_of('.') + 1) == "c" ? "c-header" : "c++-header";
+}
+
+// Precompiles the -pch header into the backup dir, with the flags of the first
+// file in the compilation database. Only the files compiled with the same
+// flags, language and directory load it.
+void precompileHeader(CompilationDatabase &compilations) {
+    std::vector<CompileCommand> commands = compilations.getAllCompileCommands();
+    if (commands.empty()) {
+        std::cout << "No compile command to precompile " << PrecompiledHeader << " with" << std::endl;
+        return;
+    }
+
+    const CompileCommand &command = commands[0];
+    std::vector<std::string> flags = compileFlags(command.CommandLine, command.Filename);
+    std::string language = headerLanguage(command.Filename);
+    std::string pchFile = backupListName(TargetBackupDir, "vprof.pch");
+
+    FixedCompilationDatabase pchCompilations(command.Directory, flags);
+    ClangTool precompiler(pchCompilations, std::vector<std::string>(1, PrecompiledHeader));
+    // The default adjusters would drop the output and only check the syntax.
+    precompiler.clearArgumentsAdjusters();
+    precompiler.appendArgumentsAdjuster([&](const CommandLineArguments &args, StringRef) {
+        CommandLineArguments adjustedArgs(args);
+        adjustedArgs.insert(adjustedArgs.begin() + 1, { "-x", language });
+        adjustedArgs.push_back("-o");
+        adjustedArgs.push_back(pchFile);
+        return adjustedArgs;
+    });
+
+    if (precompiler.run(newFrontendActionFactory<clang::GeneratePCHAction>().get()) == 0) {
+        precompiledHeaderFile = pchFile;
+        precompiledHeaderFlags = flags;
+        for (const CompileCommand &other : commands) {
+            if (other.Directory == command.Directory && headerLanguage(other.Filename) == language &&
+                compileFlags(other.CommandLine, other.Filename) == flags) {
+                precompiledHeaderUsers[other.Filename] = other.Filename[0] == '/' ?
+                                                         other.Filename : other.Directory + "/" + other.Filename;
+            }
+        }
+    } else {
+        std::cout << "Could not precompile " << PrecompiledHeader << ", parsing it for every file" << std::endl;
+    }
+}
+
+// Adds what every tool shares to its command lines, and makes it parse the
+// files of the previous round not instrumented again yet from their backups.
+void addSharedArguments(ClangTool &tool) {
+    PreviousSources *previousSources = PreviousSources::GetInstance();
+    for (const std::string &file : previousSources->Files()) {
+        tool.mapVirtualFile(file, *previousSources->Find(file));
+    }
+    if (precompiledHeaderFile.length() > 0) {
+        tool.setDiagnosticConsumer(&precompiledHeaderDiagnostics);
+        tool.appendArgumentsAdjuster([](const CommandLineArguments &args, StringRef file) {
+            std::string filename = file.str();
+            precompiledHeaderDiagnostics.currentFile = filename;
+            if (precompiledHeaderUsers.find(filename) == precompiledHeaderUsers.end() ||
+                compileFlags(args, filename) != precompiledHeaderFlags) {
+                return args;
+            }
+            CommandLineArguments adjustedArgs(args);
+            adjustedArgs.push_back("-include-pch");
+            adjustedArgs.push_back(precompiledHeaderFile);
+            return adjustedArgs;
+        });
+    }
+}
+
+// Runs the pass over the files, then again without the precompiled header over
+// those which could not load it, such as when a header it includes changed.
+void runTool(CompilationDatabase &compilations, const std::vector<std::string> &files,
+             const InstrumentationPass &pass, const ArgumentsAdjuster &adjuster = nullptr) {
+    ClangTool tool(compilations, files);
+    addSharedArguments(tool);
+    if (adjuster) {
+        tool.appendArgumentsAdjuster(adjuster);
+    }
+    pass(tool);
+
+    std::set<std::string> failedFiles;
+    failedFiles.swap(precompiledHeaderDiagnostics.failedFiles);
+    if (failedFiles.empty()) {
+        return;
+    }
+    std::vector<std::string> retriedFiles;
+    for (const std::string &file : failedFiles) {
+        std::cout << "Could not load the precompiled " << PrecompiledHeader << " in " << file
+                  << ", parsing it instead" << std::endl;
+        retriedFiles.push_back(precompiledHeaderUsers[file]);
+        precompiledHeaderUsers.erase(file);
+    }
+    runTool(compilations, retriedFiles, pass, adjuster);
+}
+
+// Everything given on the command line which decides how a file is
+// instrumented. The call graph decides which callees are trivial, so its
+// content is part of it rather than its path.
+std::string instrumentationSpec() {
+    return FunctionNameAndArgs + '\n' + CallerNameAndArgs + '\n' + RootNamesAndArgs + '\n' +
+           MultiTargetNamesAndArgs + '\n' + std::to_string(MultiTargetDepth) + '\n' +
+           std::to_string(MultiTargetLimit) + '\n' + InstrumentationCache::HashFile(CallGraphFile) + '\n' +
+           std::to_string(TargetPathCount) + '\n' + CallerBackupDir + '\n' +
+           TargetBackupDir + '\n' + FunctionNamesFile + '\n' + PrecompiledHeader;
+}
+
+// Runs the passes, in order, over the files. With a cache each file is run on
+// its own, so that what the passes write can be told apart per file, and the
+// files whose instrumentation is cached are not parsed at all.
+void runPasses(CommonOptionsParser &optionsParser, const std::string &passName,
+               const std::vector<std::string> &files,
+               const std::vector<InstrumentationPass> &passes) {
+    if (CacheDir.length() == 0) {
+        for (const InstrumentationPass &pass : passes) {
+            runTool(optionsParser.getCompilations(), files, pass);
+        }
+        return;
+    }
+
+    std::vector<std::string> backupLists;
+    backupLists.push_back(backupListName(TargetBackupDir, "TracerFilenames"));
+    if (CallerBackupDir.length() > 0) {
+        backupLists.push_back(backupListName(CallerBackupDir, "CallerFilenames"));
+    }
+    InstrumentationCache cache(CacheDir, instrumentationSpec(), FunctionNamesFile, backupLists);
+
+    int numHits = 0;
+    for (const std::string &file : files) {
+        bool isHit = cache.Instrument(file, passName, optionsParser.getCompilations(), [&]() {
+            for (const InstrumentationPass &pass : passes) {
+                runTool(optionsParser.getCompilations(), std::vector<std::string>(1, file), pass,
+                        cache.DependencyAdjuster());
+            }
+        });
+        numHits += isHit ? 1 : 0;
+    }
+    std::cout << passName << ": " << numHits << " of " << files.size()
+              << " files replayed from the cache" << std::endl;
+}
+
+// Saves the static call graph of every file in the compilation database to
+// the -g file.
+void buildCallGraph(CommonOptionsParser &optionsParser) {
+    runTool(optionsParser.getCompilations(), optionsParser.getCompilations().getAllFiles(),
+            [](ClangTool &tool) {
+                tool.run(CreateCallGraphExtractorFrontendActionFactory().get());
+            });
+
+    CallGraph::GetInstance()->ComputeHeights();
+    if (!CallGraph::GetInstance()->Save(CallGraphFile)) {
+        std::cout << "Could not write the call graph to " << CallGraphFile << std::endl;
+    }
+}
+
+// Instruments the -m functions and, down to -d levels, the functions they call
+// as targets, all in one pass. Target IDs are written to <-n>.targets.
+void instrumentMultiTargets(CommonOptionsParser &optionsParser, FileFinder &fileFinder) {
+    std::vector<std::string> rootFunctions = SplitString(MultiTargetNamesAndArgs, ',');
+    std::vector<std::string> targetNames;
+    std::set<std::string> visited;
+    std::set<std::string> frontier;
+    CallGraph *callGraph = CallGraph::GetInstance();
+    std::map<std::string, long long> pathWeights;
+    for (size_t i = 0; i < rootFunctions.size(); i++) {
+        std::string targetName = getTargetName(rootFunctions[i]);
+        if (visited.insert(targetName).second) {
+            targetNames.push_back(targetName);
+            frontier.insert(targetName);
+            pathWeights[targetName] = 1;
+        }
+    }
+
+    for (int depth = 0; depth < MultiTargetDepth && !frontier.empty(); depth++) {
+        std::set<std::string> potentialFiles;
+        for (std::string callerName : frontier) {
+            std::vector<std::string> files = fileFinder.FindFunctionPotentialFiles(
+                getUnqualifiedFunctionName(callerName));
+            potentialFiles.insert(files.begin(), files.end());
+        }
+
+        std::shared_ptr<std::set<std::string>> callees = std::make_shared<std::set<std::string>>();
+        runTool(optionsParser.getCompilations(), std::vector<std::string>(potentialFiles.begin(), potentialFiles.end()),
+                [&](ClangTool &tool) {
+                    tool.run(CreateCalleeCollectorFrontendActionFactory(frontier, callees).get());
+                });
+
+        // Static weight of the hottest path from the -m functions to each
+        // callee. Leaves are not made targets, they have nothing to break down.
+        std::vector<std::pair<long long, std::string>> newTargets;
+        for (const std::string &callee : *callees) {
+            if (visited.find(callee) != visited.end() || callGraph->IsLeaf(callee)) {
+                continue;
+            }
+            long long weight = 0;
+            for (const std::string &callerName : frontier) {
+                weight = std::max(weight, pathWeights[callerName] * callGraph->CallWeight(callerName, callee));
+            }
+            pathWeights[callee] = std::max(weight, 1LL);
+            newTargets.push_back(std::make_pair(pathWeights[callee], callee));
+        }
+        std::stable_sort(newTargets.begin(), newTargets.end(),
+                         [](const std::pair<long long, std::string> &a, const std::pair<long long, std::string> &b) {
+                             return a.first > b.first;
+                         });
+
+        frontier.clear();
+        for (const std::pair<long long, std::string> &newTarget : newTargets) {
+            if (MultiTargetLimit > 0 && targetNames.size() >= static_cast<size_t>(MultiTargetLimit)) {
+                break;
+            }
+            visited.insert(newTarget.second);
+            targetNames.push_back(newTarget.second);
+            frontier.insert(newTarget.second);
+        }
+    }
+
+    std::ofstream targetsFile(FunctionNamesFile + ".targets");
+    std::set<std::string> allPotentialFiles;
+    for (size_t i = 0; i < targetNames.size(); i++) {
+        targetsFile << i << '\t' << targetNames[i] << std::endl;
+        std::vector<std::string> files = fileFinder.FindFunctionPotentialFiles(
+            getUnqualifiedFunctionName(targetNames[i]));
+        allPotentialFiles.insert(files.begin(), files.end());
+    }
+    targetsFile.close();
+
+    // Each file is rewritten at most once, with the wrappers of all the
+    // targets it defines.
+    runPasses(optionsParser, "multi", std::vector<std::string>(allPotentialFiles.begin(), allPotentialFiles.end()),
+              { [&](ClangTool &tool) {
+                  tool.run(CreateMultiTracerInstrumentorFrontendActionFactory(
+                      targetNames, TargetBackupDir, FunctionNamesFile).get());
+              } });
+}
+
+// Writes the -f function and the functions it calls to the function names
+// file, in the order the XRay tracer gives them their log indices.
+void listCallees(CommonOptionsParser &optionsParser, FileFinder &fileFinder) {
+    std::string targetName = getTargetName(FunctionNameAndArgs);
+    std::vector<std::string> potentialFiles = fileFinder.FindFunctionPotentialFiles(
+        getUnqualifiedFunctionName(targetName));
+
+    std::shared_ptr<std::set<std::string>> callees = std::make_shared<std::set<std::string>>();
+    std::set<std::string> callers;
+    callers.insert(targetName);
+    runTool(optionsParser.getCompilations(), potentialFiles, [&](ClangTool &tool) {
+        tool.run(CreateCalleeCollectorFrontendActionFactory(callers, callees).get());
+    });
+
+    std::ofstream functionNamesFile(FunctionNamesFile);
+    functionNamesFile << FunctionNameAndArgs << std::endl;
+    int index = 1;
+    for (std::string callee : *callees) {
+        size_t argsStart = std::min(callee.find('|'), callee.length());
+        callee.insert(argsStart, "-" + std::to_string(index++));
+        functionNamesFile << callee << std::endl;
+    }
+    functionNamesFile.close();
+}
+
+// Writes back the original content of the files of the previous round which
+// were not instrumented again.
+void restoreUninstrumentedSources() {
+    PreviousSources *previousSources = PreviousSources::GetInstance();
+    for (const std::string &file : previousSources->Files()) {
+        if (!WriteFileIfChanged(file, *previousSources->Find(file))) {
+            std::cout << "Could not restore " << file << std::endl;
+        }
+    }
+}
+
+void instrument(CommonOptionsParser &OptionsParser, FileFinder &fileFinder) {
+    if (ListCalleesOnly) {
+        listCallees(OptionsParser, fileFinder);
+        return;
+    }
+
+    if (MultiTargetNamesAndArgs.length() > 0) {
+        instrumentMultiTargets(OptionsParser, fileFinder);
+        return;
+    }
 
     if (CallerNameAndArgs.size() > 0) {
         std::string callerFunctionName = getUnqualifiedFunctionName(CallerNameAndArgs);
@@ -99,33 +535,66 @@ int main(int argc, const char **argv) {
 
         if (potentialCallerFiles.size() == 0) {
             std::cout << "Function " << callerFunctionName << " not found" << std::endl;
-            return 0;
+            return;
         }
-        ClangTool CallerInstrumentator(OptionsParser.getCompilations(), potentialCallerFiles);
-        CallerInstrumentator.run(CreateCallerInstrumentorFrontendActionFactory(
-            FunctionNameAndArgs, CallerNameAndArgs, TargetPathCount, CallerBackupDir).get());
+        runPasses(OptionsParser, "caller", potentialCallerFiles,
+                  { [&](ClangTool &tool) {
+                      tool.run(CreateCallerInstrumentorFrontendActionFactory(
+                          FunctionNameAndArgs, CallerNameAndArgs, TargetPathCount, CallerBackupDir).get());
+                  } });
     }
 
     if (FunctionNameAndArgs.length() == 0) {
+        // Not cached, since the log indices of a file depend on the files
+        // instrumented before it.
         std::vector<std::string> allPotentialFiles = findAllPotentialFiles(RootNamesAndArgs, fileFinder);
-        ClangTool NonTargetTracerInstrumentator(OptionsParser.getCompilations(), allPotentialFiles);
-        NonTargetTracerInstrumentator.run(CreateNonTargetTracerInstrumentorFrontendActionFactory(
-            RootNamesAndArgs, TargetBackupDir, FunctionNamesFile).get());
+        // The same factory numbers the files run again without the precompiled header.
+        std::unique_ptr<NonTargetTracerInstrumentorFrontendActionFactory> factory =
+            CreateNonTargetTracerInstrumentorFrontendActionFactory(RootNamesAndArgs, TargetBackupDir, FunctionNamesFile);
+        runTool(OptionsParser.getCompilations(), allPotentialFiles, [&](ClangTool &tool) {
+            tool.run(factory.get());
+        });
     } else {
         std::string targetFunctionName = getUnqualifiedFunctionName(FunctionNameAndArgs);
         std::vector<std::string> potentialTargetFiles = fileFinder.FindFunctionPotentialFiles(targetFunctionName);
 
         if (potentialTargetFiles.size() == 0) {
             std::cout << "Function " << targetFunctionName << " not found" << std::endl;
-            return 0;
+            return;
         }
-        ClangTool TracerInstrumentator(OptionsParser.getCompilations(), potentialTargetFiles);
-        TracerInstrumentator.run(CreateTracerInstrumentorFrontendActionFactory(
-            FunctionNameAndArgs, TargetPathCount, TargetBackupDir, FunctionNamesFile).get());
+        // The returns of the target are rewritten in the same traversal.
+        runPasses(OptionsParser, "target", potentialTargetFiles,
+                  { [&](ClangTool &tool) {
+                      tool.run(CreateTracerInstrumentorFrontendActionFactory(
+                          FunctionNameAndArgs, TargetPathCount, TargetBackupDir, FunctionNamesFile).get());
+                  } });
+    }
+}
+
+int main(int argc, const char **argv) {
+    CommonOptionsParser OptionsParser(argc, argv, TracerInstrumentorOptions);
+
+    FileFinder fileFinder(SourceBaseDir);
+    fileFinder.BuildCScopeDB();
+
+    if (PrecompiledHeader.length() > 0) {
+        precompileHeader(OptionsParser.getCompilations());
+    }
+
+    if (BuildCallGraph) {
+        buildCallGraph(OptionsParser);
+        return 0;
+    }
+
+    if (CallGraphFile.length() > 0 && !CallGraph::GetInstance()->Load(CallGraphFile)) {
+        std::cout << "Call graph " << CallGraphFile << " not found, instrumenting every callee" << std::endl;
+    }
 
-        ClangTool ReturnInstrumentator(OptionsParser.getCompilations(), potentialTargetFiles);
-        ReturnInstrumentator.run(CreateReturnInstrumentorFrontendActionFactory(FunctionNameAndArgs).get());
+    if (PreviousBackupList.length() > 0 && !PreviousSources::GetInstance()->Load(PreviousBackupList)) {
+        std::cout << "Backup list " << PreviousBackupList << " not found" << std::endl;
     }
 
+    instrument(OptionsParser, fileFinder);
+    restoreUninstrumentedSources();
     return 0;
 }
@@ -24,4 +24,6 @@ void TRACE_FUNCTION_END() {}
 
 int TRACE_START() {return 0;}
 
+int TRACE_INDEX_START(int index) {return 0;}
+
 int TRACE_END(int index) {return 0;}
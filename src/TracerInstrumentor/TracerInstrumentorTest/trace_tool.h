@@ -25,6 +25,8 @@ void TRACE_FUNCTION_END();
 
 int TRACE_START();
 
+int TRACE_INDEX_START(int index);
+
 int TRACE_END(int index);
 
 #endif
@@ -0,0 +1,21 @@
+static int total;
+
+inline int Zero() {
+    return 0;
+}
+
+void Work(int n) {
+    for (int i = 0; i < n; i++) {
+        total += i;
+    }
+}
+
+void Parent(int n) {
+    n += Zero();
+    Work(n);
+}
+
+int main() {
+    Parent(10);
+    return total > 0 ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+#! /bin/sh
+
+# Instruments Parent, whose first call is to the trivial Zero, then its callee
+# Work as the next target, and checks that the caller pass brackets the call
+# to Work, under the index the tracer gave it, with the path count updates.
+
+set -e
+
+work=$(mktemp -d)
+cp "$(dirname "$0")/trivial_callee_test.cc" "$work"
+cd "$work"
+mkdir backup callerbackup
+cat > compile_commands.json <<JSON
+[
+    {
+        "command": "c++ -c -o trivial_callee_test.o trivial_callee_test.cc",
+        "directory": "$work",
+        "file": "$work/trivial_callee_test.cc"
+    }
+]
+JSON
+
+TracerInstrumentor -s "$work" -G -g callGraph -b backup -n functionNames compile_commands.json
+TracerInstrumentor -s "$work" -g callGraph -f 'Parent|n' -b backup -n functionNames compile_commands.json
+
+# Zero is not wrapped, so Work is the first callee.
+grep -qx 'Work-1|n' functionNames
+
+# Set aside as the annotator does, the file is parsed from its backup.
+mv backup/TracerFilenames backup/TracerFilenames.previous
+TracerInstrumentor -s "$work" -g callGraph -P backup/TracerFilenames.previous -f 'Work-1|n' -c 'Parent|n' -t 1 \
+                   -b backup -e callerbackup -n functionNames compile_commands.json
+
+if grep -A1 'PATH_INC' trivial_callee_test.cc | grep -q 'Work(n)'; then
+    echo "PASS"
+    rm -rf "$work"
+else
+    echo "FAIL, see $work/trivial_callee_test.cc"
+    exit 1
+fi
@@ -7,69 +7,27 @@
 
 using namespace clang;
 
-std::string TracerInstrumentorVisitor::functionNameToWrapperName(std::string functionName) {
-    std::vector<std::string> nameParts = SplitString(functionName, ':');
-    std::string wrapperName;
-    for (size_t i = 0; i < nameParts.size() - 1; i++) {
-        wrapperName += nameParts[i] + '_';
-    }
-    wrapperName += nameParts.back() + std::to_string(tracerHeaderInfo->second) + "_vprofiler";
-    return wrapperName;
+std::string TracerInstrumentorVisitor::declToWrapperName(const FunctionDecl *decl) {
+    return GetWrapperName(*mangleContext, decl, tracerHeaderInfo->second);
 }
 
-void TracerInstrumentorVisitor::fixFunction(const CallExpr *call, const std::string &functionName,
-                               bool isMemberCall) {
-    // Get args
-    std::string newCall = functionNameToWrapperName(functionName) + "(";
-    std::vector<const Expr*> args;
-
-    if (isMemberCall) {
-        const CXXMemberCallExpr *memCall = static_cast<const CXXMemberCallExpr*>(call);
-        Expr *obj = memCall->getImplicitObjectArgument();
-        args.push_back(obj);
-        
-        // Add ampersand to get address of obj if it is not a pointer.  This ensures
-        // the first arg of a member function that the user wants profiled is a 
-        // pointer to the instance of the object on which to operate.
-        if (!obj->getType()->isPointerType()) {
-            newCall += "&";
-        }
-
-    }
-
-    for (int i = 0, j = call->getNumArgs(); i < j; i++) {
-        args.push_back(call->getArg(i));
-    }
-
-    appendNonObjArgs(newCall, args);
-    newCall += ")";
-
-    rewriter->ReplaceText(SourceRange(call->getLocStart(), 
-                          call->getRParenLoc()), newCall);
-}
-
-void TracerInstrumentorVisitor::appendNonObjArgs(std::string &newCall, std::vector<const Expr*> &args) {
-    for (unsigned int i = 0, j = args.size(); i < j; i++) {
-        std::string TypeS;
-        llvm::raw_string_ostream s(TypeS);
-        args[i]->printPretty(s, 0, rewriter->getLangOpts());
-        newCall += s.str();
-
-        if (i != (j - 1)) {
-            newCall += ", ";
-        }
+void TracerInstrumentorVisitor::instrumentIndirectCall(const CallExpr *call) {
+    std::string index = std::to_string(tracerHeaderInfo->second);
+    std::string wrapperName = GetIndirectWrapperName(*mangleContext, call, tracerHeaderInfo->second);
+    std::string wrapperImpl = GenerateIndirectWrapperImpl(*astContext, call, wrapperName,
+                                                          "VProfTraceGuard vprofGuard(" + index + ");",
+                                                          "TRACE_INDEX_START(" + index + ");",
+                                                          "TRACE_END(" + index + ");");
+    if (wrapperImpl.empty()) {
+        return;
     }
-}
-
-std::string TracerInstrumentorVisitor::getContainingFilename(const FunctionDecl *decl) {
-    SourceManager *sourceMgr = &rewriter->getSourceMgr();
 
-    return sourceMgr->getFilename(decl->getLocation()).str();
-}
+    RewriteIndirectCall(*rewriter, call, wrapperName);
+    wrapperImplLoc->second += wrapperImpl;
+    functionNamesStream << GetIndirectCalleeName(call, rewriter->getLangOpts()) << '-' << index << std::endl;
+    functionNamesStream.flush();
 
-// TODO change name to getParamDeclAsString
-std::string TracerInstrumentorVisitor::getEntireParamDeclAsString(const ParmVarDecl *decl) {
-    return decl->getType().getAsString() + " " + decl->getNameAsString();
+    tracerHeaderInfo->second++;
 }
 
 std::string TracerInstrumentorVisitor::getFileAndLine(const clang::FunctionDecl *decl) {
@@ -87,109 +45,30 @@ std::string TracerInstrumentorVisitor::getFileAndLine(const clang::FunctionDecl
     return fileName;
 }
 
-void TracerInstrumentorVisitor::createNewPrototype(const FunctionDecl *decl, 
-                                      const std::string &functionName,
-                                      bool isMemberFunc) {
-    FunctionPrototype newPrototype;
-
-    std::string functionNameInFile = decl->getQualifiedNameAsString() + '-' + std::to_string(tracerHeaderInfo->second);
-
-    newPrototype.filename = getContainingFilename(decl);
-
-    newPrototype.returnType = decl->getReturnType().getAsString();
-    newPrototype.functionPrototype += newPrototype.returnType + " " + functionNameToWrapperName(functionName) + "(";
-
-    bool isCXXMethodAndNotStatic = false;
-    if (isMemberFunc) {
-        const CXXMethodDecl *methodDecl = static_cast<const CXXMethodDecl*>(decl);
-        if (methodDecl->isStatic()) {
-            newPrototype.innerCallPrefix = decl->getQualifiedNameAsString();
-        }
-        else {
-            isCXXMethodAndNotStatic = true;
-
-            newPrototype.innerCallPrefix = "obj->" + methodDecl->getNameAsString();
-            newPrototype.functionPrototype += methodDecl->getThisType(*astContext).getAsString() + " obj";
-        }
-    }
-    // Is there a more succinct way to write this?
-    else {
-        newPrototype.innerCallPrefix = decl->getQualifiedNameAsString();
-    }
-
-    for (unsigned int i = 0, j = decl->getNumParams(); i < j; i++) {
-        if (isCXXMethodAndNotStatic && i == 0) {
-            newPrototype.functionPrototype +=", ";
-        }
-
-        const ParmVarDecl* paramDecl = decl->getParamDecl(i);
-        newPrototype.functionPrototype += getEntireParamDeclAsString(paramDecl);
-
-        functionNameInFile += "|" + paramDecl->getNameAsString();
-        newPrototype.paramVars.push_back(paramDecl->getNameAsString() + (paramDecl->isParameterPack() ? "..." : ""));
-
-        if (i != (j - 1)) {
-            newPrototype.functionPrototype += ", ";
-        }
-    }
-
-    newPrototype.functionPrototype += ")";
-    newPrototype.isMemberCall = isMemberFunc;
-
-    wrapperImplLoc->second += generateWrapperImpl(newPrototype);
-    functionNamesStream << functionNameInFile << std::endl;
+void TracerInstrumentorVisitor::instrumentCall(const CallExpr *call, const FunctionDecl *decl,
+                                               bool isMemberCall) {
+    std::string index = std::to_string(tracerHeaderInfo->second);
+    std::string wrapperName = declToWrapperName(decl);
+    RewriteCall(*rewriter, call, wrapperName, isMemberCall);
+
+    FunctionPrototype prototype = CreateWrapperPrototype(*astContext, call, decl, wrapperName, isMemberCall);
+    wrapperImplLoc->second += GenerateWrapperImpl(prototype,
+                                                  "VProfTraceGuard vprofGuard(" + index + ");",
+                                                  "TRACE_INDEX_START(" + index + ");",
+                                                  "TRACE_END(" + index + ");");
+    functionNamesStream << GetFunctionNameInFile(decl, tracerHeaderInfo->second) << std::endl;
     functionNamesStream.flush();
-}
 
-bool TracerInstrumentorVisitor::inRange(clang::SourceRange largeRange, clang::SourceRange smallRange) {
-    unsigned start = smallRange.getBegin().getRawEncoding();
-    unsigned end = smallRange.getEnd().getRawEncoding();
-    return largeRange.getBegin().getRawEncoding() <= start &&
-           end <= largeRange.getEnd().getRawEncoding();
+    tracerHeaderInfo->second++;
 }
 
 bool TracerInstrumentorVisitor::inTargetFunction(const Expr *call) {
     clang::SourceRange range(call->getLocStart(), call->getLocEnd());
-    return inRange(targetFunctionRange, range);
+    return InRange(targetFunctionRange, range);
 }
 
 bool TracerInstrumentorVisitor::inTargetFunction(const Stmt *stmt) {
-    return inRange(targetFunctionRange, stmt->getSourceRange());
-}
-
-std::string TracerInstrumentorVisitor::generateWrapperImpl(FunctionPrototype prototype) {
-    std::string implementation;
-    implementation += prototype.functionPrototype + " {\n\t";
-    // if (prototype.returnType != "void") {
-    //     implementation += prototype.returnType + " result;\n\n\t";
-    // }
-
-    implementation += "TRACE_START();\n\t";
-    if (prototype.returnType != "void") {
-        implementation += prototype.returnType + " result = ";
-    }
-
-    implementation += prototype.innerCallPrefix + "(";
-
-    for (int i = 0, j = prototype.paramVars.size(); i < j; i++) {
-        implementation += prototype.paramVars[i];
-
-        if (i != (j - 1)) {
-            implementation += ", ";
-        }
-    }
-
-    implementation += ");\n\t";
-
-    implementation += "TRACE_END(" + std::to_string(tracerHeaderInfo->second) + ");\n";
-
-    if (prototype.returnType != "void") {
-        implementation += "\treturn result;\n";
-    }
-
-    implementation += "}\n\n";
-
-    return implementation;
+    return InRange(targetFunctionRange, stmt->getSourceRange());
 }
 
 std::vector<std::string> TracerInstrumentorVisitor::getFunctionNameAndArgs(
@@ -222,23 +101,19 @@ bool TracerInstrumentorVisitor::VisitCallExpr(const CallExpr *call) {
     if (!inTargetFunction(call)) {
         return true;
     }
+    if (IsIndirectCall(call)) {
+        instrumentIndirectCall(call);
+        return true;
+    }
     const FunctionDecl *decl = call->getDirectCallee();
-    // Exit if call is to a function pointer
+    // Exit if the callee is only known at instantiation
     if (!decl || isa<CXXMemberCallExpr>(call)) {
         return true;
     }
-    const std::string functionName = decl->getQualifiedNameAsString();
-    if (functionName == "SESSION_START" ||
-        functionName == "SESSION_END" ||
-        functionName == "PATH_INC" ||
-        functionName == "PATH_DEC") {
-            return true;
+    if (IsUntracedCallee(decl)) {
+        return true;
     }
-    fixFunction(call, functionName, false);
-
-    createNewPrototype(decl, functionName, false);
-
-    tracerHeaderInfo->second++;
+    instrumentCall(call, decl, false);
 
     return true;
 }
@@ -247,15 +122,10 @@ bool TracerInstrumentorVisitor::VisitCXXMemberCallExpr(const clang::CXXMemberCal
     if (!inTargetFunction(call)) {
         return true;
     }
-    if (call->getMethodDecl() == nullptr) {
+    if (call->getMethodDecl() == nullptr || IsUntracedCallee(call->getMethodDecl())) {
         return true;
     }
-    const std::string functionName = call->getMethodDecl()->getQualifiedNameAsString();
-    fixFunction(call, functionName, true);
-
-    createNewPrototype(call->getMethodDecl(), functionName, true);
-
-    tracerHeaderInfo->second++;
+    instrumentCall(call, call->getMethodDecl(), true);
 
     return true;
 }
@@ -353,7 +223,11 @@ void TracerInstrumentorVisitor::initForInstru(const clang::FunctionDecl *decl) {
 
 bool TracerInstrumentorVisitor::VisitFunctionDecl(const clang::FunctionDecl *decl) {
     initForInstru(decl);
-    return true;
+    return returnInstrumentor.VisitFunctionDecl(decl);
+}
+
+bool TracerInstrumentorVisitor::VisitReturnStmt(const clang::ReturnStmt *stmt) {
+    return returnInstrumentor.VisitReturnStmt(stmt);
 }
 
 // bool TracerInstrumentorVisitor::VisitCXXMethodDecl(const clang::CXXMethodDecl *decl) {
@@ -370,12 +244,14 @@ TracerInstrumentorVisitor::TracerInstrumentorVisitor(CompilerInstance &ci,
                             std::string _functionNamesFile):
                             astContext(&ci.getASTContext()),
                             rewriter(_rewriter),
+                            mangleContext(ci.getASTContext().createMangleContext()),
                             targetFunctionNameString(_targetFunctionName),
                             targetFunctionNameAndArgs(SplitString(_targetFunctionName, '|')),
                             shouldFlush(_shouldFlush),
                             wrapperImplLoc(_wrapperImplLoc),
                             tracerHeaderInfo(_tracerHeaderInfo),
-                            functionNamesFile(_functionNamesFile) {
+                            functionNamesFile(_functionNamesFile),
+                            returnInstrumentor(ci, _rewriter, _targetFunctionName, _shouldFlush) {
     rewriter->setSourceMgr(astContext->getSourceManager(),
                           astContext->getLangOpts());
     targetFunctionNameAndArgs[0] = SplitString(targetFunctionNameAndArgs[0], '-')[0];
@@ -23,6 +23,8 @@
 #include <tuple>
 
 #include "FunctionPrototype.h"
+#include "CallSiteUtils.h"
+#include "ReturnInstrumentorVisitor.h"
 
 class TracerInstrumentorVisitor : public clang::RecursiveASTVisitor<TracerInstrumentorVisitor> {
     private:
@@ -32,6 +34,8 @@ class TracerInstrumentorVisitor : public clang::RecursiveASTVisitor<TracerInstru
         // Client to rewrite source
         std::shared_ptr<clang::Rewriter> rewriter;
 
+        std::unique_ptr<clang::MangleContext> mangleContext;
+
         std::string targetFunctionNameString;
         // Name of the target function to instrument and names of its parameters.
         std::vector<std::string> targetFunctionNameAndArgs;
@@ -48,39 +52,33 @@ class TracerInstrumentorVisitor : public clang::RecursiveASTVisitor<TracerInstru
 
         clang::SourceRange targetFunctionRange;
 
-        std::string functionNameToWrapperName(std::string functionName);
+        ReturnInstrumentorVisitor returnInstrumentor;
 
-        void fixFunction(const clang::CallExpr *call, const std::string &functionName,
-                         bool  isMemberCall);
+        // Mangled names are used, so that overloads and template instantiations
+        // get wrappers of their own.
+        std::string declToWrapperName(const clang::FunctionDecl *decl);
 
-        void appendNonObjArgs(std::string &newCall, std::vector<const clang::Expr*> &args);
+        // Wraps a call through a function pointer or of a callable object.
+        void instrumentIndirectCall(const clang::CallExpr *call);
 
-        // Creates the wrapper prototype based on function decl.
-        void createNewPrototype(const clang::FunctionDecl *decl,
-                                const std::string &functionName,
-                                bool isMemberFunc);
+        // Rewrites the call to call a new wrapper of decl, and logs decl at the
+        // next index.
+        void instrumentCall(const clang::CallExpr *call, const clang::FunctionDecl *decl,
+                            bool isMemberCall);
 
         std::string getFileAndLine(const clang::FunctionDecl *decl);
 
-        std::string getEntireParamDeclAsString(const clang::ParmVarDecl *decl);
-
-        std::string getContainingFilename(const clang::FunctionDecl *decl);
-
         std::vector<std::string> getFunctionNameAndArgs(const clang::FunctionDecl *decl);
 
         void initForInstru(const clang::FunctionDecl *decl);
 
         bool isTargetFunction(const clang::FunctionDecl *decl);
 
-        bool inRange(clang::SourceRange largeRange, clang::SourceRange smallRange);
-
         bool inTargetFunction(const clang::Expr *call);
         bool inTargetFunction(const clang::Stmt *stmt);
 
         void insertTracerHeader();
 
-        std::string generateWrapperImpl(FunctionPrototype prototype);
-
         void addBraces(const clang::Stmt *s);
 
     public:
@@ -104,6 +102,9 @@ class TracerInstrumentorVisitor : public clang::RecursiveASTVisitor<TracerInstru
         // Override trigger for when a Stmt is found in the AST
         virtual bool VisitStmt(const clang::Stmt *s);
 
+        // Override trigger for when a ReturnStmt is found in the AST
+        virtual bool VisitReturnStmt(const clang::ReturnStmt *stmt);
+
         // Override trigger for when a CallExpr is found in the AST
         virtual bool VisitCallExpr(const clang::CallExpr *call);
 
@@ -1,5 +1,8 @@
 #include "Utils.h"
 
+#include <fstream>
+#include <iterator>
+
 // Credit to Evan Teran on stackoverflow for this solution. Find it at
 // https://www.stackoverflow.com/questions/236129/split-a-string-in-c.
 template<typename Out>
@@ -44,3 +47,25 @@ std::string execute(const std::string &command) {
 
     return result;
 }
+
+bool FileContentEquals(const std::string &filename, const std::string &content) {
+    std::ifstream inputFile(filename, std::ios::binary);
+    if (!inputFile) {
+        return false;
+    }
+    std::string oldContent((std::istreambuf_iterator<char>(inputFile)),
+                           std::istreambuf_iterator<char>());
+    return oldContent == content;
+}
+
+bool WriteFile(const std::string &filename, const std::string &content) {
+    std::ofstream outputFile(filename, std::ios::binary | std::ios::trunc);
+    outputFile << content;
+    // Flushed by close, which may fail too.
+    outputFile.close();
+    return !outputFile.fail();
+}
+
+bool WriteFileIfChanged(const std::string &filename, const std::string &content) {
+    return FileContentEquals(filename, content) || WriteFile(filename, content);
+}
@@ -14,4 +14,15 @@ std::vector<std::string> SplitString(const std::string &s, char delim);
 
 std::string execute(const std::string &command); 
 
+// Returns true if filename exists and holds exactly content.
+bool FileContentEquals(const std::string &filename, const std::string &content);
+
+// Returns false if the file could not be written.
+bool WriteFile(const std::string &filename, const std::string &content);
+
+// Writes content to filename unless the file already holds exactly that
+// content, so that sources which did not change keep their timestamps and
+// are not rebuilt.  Returns false if the file could not be written.
+bool WriteFileIfChanged(const std::string &filename, const std::string &content);
+
 #endif